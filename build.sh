@@ -1,3 +1,7 @@
+echo "[Building libclue]"
+cd libclue
+bash build.sh
+cd -
 echo "[Building server]"
 cd server
 bash build.sh
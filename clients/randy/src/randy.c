@@ -8,9 +8,11 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-#include "frames.h"
+#include "clue/codec.h"
+#include "clue/shm.h"
 
 #define NAME "Randy"
 
@@ -25,11 +27,14 @@ typedef struct {
     int turns_played;
 } Knowledge_t;
 
-int connect_to_server(char** argv);
-void handle_frame(Frame_t* header, int fd);
+int connect_to_server(char** argv); // argv[1] and argv[2] are the IP and port, or -u/-m and a Unix socket path, or argv[1] is - for stdin/stdout
+void handle_frame(Frame_t* header, char* buffer, int fd);
+void send_frame(int fd, const char* frame, int32_t length); // One send per frame
 
 Knowledge_t knowledge;
 FILE* debug_file = NULL;
+ClueShmClient_t shm; // With -m every frame goes through here instead of the socket
+int use_shm = 0;
 
 int main(int argc, char** argv) {
     srand(time(0));
@@ -37,42 +42,48 @@ int main(int argc, char** argv) {
     // Zero out what we know about the game
     memset(&knowledge, 0, sizeof(knowledge));
 
-    int rc;
-    Frame_t header = {};
-
-    if (argc < 3) {
-        printf("Usage: ./randy <ip> <port>\n");
+    // Started by server -x, which already connected us
+    int spawned = argc > 1 && strcmp(argv[1], "-") == 0;
+    if (argc < 3 && !spawned) {
+        printf("Usage: ./randy <ip> <port> [debug_file]\n       ./randy -u <socket_path> [debug_file]\n       ./randy -m <socket_path> [debug_file] (shared memory)\n       ./randy - [debug_file] (started by server -x)\n");
         exit(1);
     }
     int fd = connect_to_server(argv);
-    if (argc > 3) {
-        debug_file = fopen(argv[3], "w");
+    int debug_arg = spawned ? 2 : 3;
+    if (argc > debug_arg) {
+        debug_file = fopen(argv[debug_arg], "w");
     }
 
-    ConnectFrame_t connect_frame;
-    connect_frame.name_length = strlen(NAME);
-    header.type = FRAME_TYPE_CONNECT;
-    header.data_length = sizeof(connect_frame) + strlen(NAME);
-
-    send(fd, &header, sizeof(header), MSG_DONTWAIT); // Send header
-    send(fd, &connect_frame, sizeof(connect_frame), MSG_DONTWAIT); // Send connect frame header
-    send(fd, NAME, strlen(NAME), 0); // Send variable name length
+    char connect_frame[64];
+    // The server can show our card for us when we only have the one, which saves a round trip
+    send_frame(fd, connect_frame, clue_encode_connect_flags(connect_frame, sizeof(connect_frame), NAME, strlen(NAME), CLUE_PROTOCOL_V1, CLUE_CONNECT_AUTO_SHOW));
 
+    // Frames get handled right where they landed in the stream, nothing is copied or allocated
+    ClueStream_t stream;
+    clue_stream_init(&stream, 4096);
     while (1) {
-        int data_length = recv(fd, &header, sizeof(header), MSG_WAITALL);
-        if (data_length < sizeof(header)) {
-            if (data_length == -1 && errno == EAGAIN) {
-                continue;
-            } else if (data_length == -1) {
-                perror(NULL);
-                exit(1);
-            }
+        int32_t space;
+        char* buffer = clue_stream_reserve(&stream, 1024, &space);
+        ssize_t received = use_shm ? clue_shm_recv(&shm, buffer, space) : recv(fd, buffer, space, 0);
+        if (received == -1 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        } else if (received == -1) {
+            perror(NULL);
+            exit(1);
+        } else if (received == 0) {
             printf("Server sent incomplete frame\n");
             break;
         }
-        handle_frame(&header, fd); // This consumes the rest of the stream
+        clue_stream_commit(&stream, received);
+
+        Frame_t header;
+        char* data;
+        while (clue_stream_next(&stream, &header, &data, INT32_MAX) == 1) {
+            handle_frame(&header, data, fd);
+        }
     }
     printf("Exited loop\n");
+    clue_stream_free(&stream);
     
     close(fd);
     
@@ -82,6 +93,41 @@ int main(int argc, char** argv) {
 int connect_to_server(char** argv) {
     int rc;
 
+    if (strcmp(argv[1], "-") == 0) {
+        // stdin and stdout are the same socket. Our printing goes to stderr so it can't end up in a frame
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        return STDIN_FILENO;
+    }
+
+    if (strcmp(argv[1], "-u") == 0 || strcmp(argv[1], "-m") == 0) {
+        // Server on the same machine, started with -u
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (strlen(argv[2]) >= sizeof(address.sun_path)) {
+            printf("%s is too long for a socket path\n", argv[2]);
+            exit(1);
+        }
+        strcpy(address.sun_path, argv[2]);
+        int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (socket_fd == -1) {
+            perror(NULL);
+            exit(1);
+        }
+        rc = connect(socket_fd, (const struct sockaddr*)&address, sizeof(address));
+        if (rc == -1) {
+            perror(NULL);
+            exit(1);
+        }
+        if (strcmp(argv[1], "-m") == 0) {
+            if (clue_shm_attach(&shm, socket_fd) == -1) {
+                printf("Server would not share memory\n");
+                exit(1);
+            }
+            use_shm = 1;
+        }
+        return socket_fd;
+    }
+
     struct sockaddr_in6 address = {};
     address.sin6_family = AF_INET6;
     address.sin6_port = atoi(argv[2]);
@@ -112,67 +158,76 @@ int connect_to_server(char** argv) {
     return socket_fd;
 }
 
-void handle_frame(Frame_t* header, int fd) {
-    char* buffer = calloc(header->data_length, 1);
-    size_t data_length = recv(fd, buffer, header->data_length, MSG_WAITALL);
-    if (debug_file) {
-        fwrite(header, sizeof(*header), 1, debug_file);
-        fwrite(buffer, data_length, 1, debug_file);
-    }
-    if (data_length < header->data_length) {
-        if (data_length == -1) {
-            perror(NULL);
+void send_frame(int fd, const char* frame, int32_t length) {
+    if (use_shm) {
+        if (!clue_shm_send(&shm, frame, length)) {
+            printf("Server went away\n");
             exit(1);
         }
-        printf("Server sent incomplete frame (type %d, %ld bytes), have to exit\n", header->type, data_length);
-        if (debug_file) {
-            fclose(debug_file);
-            debug_file = NULL;
-        }
-        exit(0);
+        return;
+    }
+    if (send(fd, frame, length, 0) != length) {
+        perror(NULL);
+        exit(1);
+    }
+}
+
+void handle_frame(Frame_t* header, char* buffer, int fd) {
+    if (debug_file) {
+        fwrite(header, sizeof(*header), 1, debug_file);
+        fwrite(buffer, header->data_length, 1, debug_file);
     }
 
     if (header->type == FRAME_TYPE_ERROR) {
         // Server sends this to us when we mess up. Print
-        ErrorFrame_t* error = (ErrorFrame_t*)buffer;
-        printf("Server reported error: %.*s\n", error->error_length, error->error);
+        ClueTextView_t error;
+        clue_text_view(buffer, header->data_length, &error);
+        printf("Server reported error: %.*s\n", error.length, error.text);
         exit(1);
     } else if (header->type == FRAME_TYPE_ABORT) {
         // Server sends this to us when it messes up. Print
-        AbortFrame_t* abort = (AbortFrame_t*)buffer;
-        printf("Server aborted: %.*s\n", abort->error_length, abort->error);
+        ClueTextView_t abort;
+        clue_text_view(buffer, header->data_length, &abort);
+        printf("Server aborted: %.*s\n", abort.length, abort.text);
         exit(0);
     } else if (header->type == FRAME_TYPE_RULES) {
         // Populate our knowledge with what we can
-        RulesFrame_t* rules = (RulesFrame_t*)buffer;
-        knowledge.player_id = rules->player_id;
-        knowledge.total_cards = rules->num_cards;
-        knowledge.num_categories = rules->num_categories;
+        ClueRulesView_t rules;
+        if (!clue_rules_view(buffer, header->data_length, &rules)) {
+            printf("Server sent a broken rules frame\n");
+            exit(1);
+        }
+        knowledge.player_id = rules.player_id;
+        knowledge.total_cards = rules.num_cards;
+        knowledge.num_categories = rules.num_categories;
         knowledge.num_cards_in_category = malloc(knowledge.num_categories * sizeof(int));
-        int16_t* num_cards_in_category = (int16_t*)&rules->num_cards_in_category;
         for (int i = 0; i < knowledge.num_categories; i++) {
-            knowledge.num_cards_in_category[i] = num_cards_in_category[i];
+            knowledge.num_cards_in_category[i] = rules.num_cards_in_category[i];
         }
-        char* card_name_data = (char*)num_cards_in_category + rules->num_categories * sizeof(int16_t) + rules->num_cards * sizeof(int16_t);
         knowledge.card_names = malloc(knowledge.total_cards * sizeof(char*));
+        const char* cursor = rules.names;
         for (int i = 0; i < knowledge.total_cards; i++) {
-            int card_name_length = *card_name_data;
-            card_name_data++;
+            int8_t card_name_length = 0;
+            const char* card_name = clue_name_next(&cursor, rules.names_end, &card_name_length);
             knowledge.card_names[i] = malloc(card_name_length + 1);
-            memcpy(knowledge.card_names[i], card_name_data, card_name_length);
+            if (card_name) {
+                memcpy(knowledge.card_names[i], card_name, card_name_length);
+            }
             knowledge.card_names[i][card_name_length] = '\0';
-            card_name_data += card_name_length;
         }
-        printf("Connected as player %d, %d categories, %d cards\n", rules->player_id, rules->num_categories, rules->num_cards);
+        printf("Connected as player %d, %d categories, %d cards\n", rules.player_id, rules.num_categories, rules.num_cards);
     } else if (header->type == FRAME_TYPE_START) {
         // Since we are playing randomly, we don't care about the meta information, just our hand
-        StartFrame_t* start = (StartFrame_t*)buffer;
-        knowledge.hand_size = start->your_hand_size;
+        ClueStartView_t start;
+        if (!clue_start_view(buffer, header->data_length, &start)) {
+            printf("Server sent a broken start frame\n");
+            exit(1);
+        }
+        knowledge.hand_size = start.your_hand_size;
         knowledge.hand = malloc(knowledge.hand_size * sizeof(int));
-        int16_t* my_hand = (int16_t*)&start->your_hand;
         printf("I got dealt:\n");
         for (int i = 0; i < knowledge.hand_size; i++) {
-            knowledge.hand[i] = my_hand[i];
+            knowledge.hand[i] = start.your_hand[i];
             assert(knowledge.card_names != NULL);
             printf("  %s\n", knowledge.card_names[knowledge.hand[i]]);
         }
@@ -183,41 +238,28 @@ void handle_frame(Frame_t* header, int fd) {
             printf("My turn\n");
             knowledge.turns_played++;
 
+            // Same layout whether we suggest or guess, the only difference is the frame type
+            int16_t cards[knowledge.num_categories];
+            int base_idx = 0;
+            for (int i = 0; i < knowledge.num_categories; i++) {
+                cards[i] = rand() % knowledge.num_cards_in_category[i] + base_idx;
+                base_idx += knowledge.num_cards_in_category[i];
+            }
+            int8_t type = FRAME_TYPE_TURN_RESPONSE;
             if (knowledge.turns_played > 5) {
                 // Yolo guess since 100 turns have happened and the game probably isn't ending
-                Frame_t solve_attempt_header = {};
-                solve_attempt_header.type = FRAME_TYPE_SOLVE_ATTEMPT;
-                solve_attempt_header.data_length = sizeof(SolveAttemptFrame_t) + knowledge.num_categories * sizeof(int16_t);
-                SolveAttemptFrame_t* solve_attempt = malloc(solve_attempt_header.data_length);
-                int base_idx = 0;
+                type = FRAME_TYPE_SOLVE_ATTEMPT;
                 printf("Guessing: ");
-                for (int i = 0; i < knowledge.num_categories; i++) {
-                    solve_attempt->cards[i] = rand() % knowledge.num_cards_in_category[i] + base_idx;
-                    base_idx += knowledge.num_cards_in_category[i];
-                    printf("(%d) %s, ", solve_attempt->cards[i], knowledge.card_names[solve_attempt->cards[i]]);
-                }
-                printf("\n");
-                send(fd, &solve_attempt_header, sizeof(solve_attempt_header), MSG_DONTWAIT);
-                send(fd, solve_attempt, solve_attempt_header.data_length, MSG_DONTWAIT);
-                free(solve_attempt);
             } else {
                 // Make a random suggestion
-                Frame_t suggestion_header = {};
-                suggestion_header.type = FRAME_TYPE_TURN_RESPONSE;
-                suggestion_header.data_length = sizeof(TurnResponseFrame_t) + knowledge.num_categories * sizeof(int16_t);
-                TurnResponseFrame_t* suggestion = malloc(suggestion_header.data_length);
-                int base_idx = 0;
                 printf("Suggesting: ");
-                for (int i = 0; i < knowledge.num_categories; i++) {
-                    suggestion->suggestion[i] = rand() % knowledge.num_cards_in_category[i] + base_idx;
-                    base_idx += knowledge.num_cards_in_category[i];
-                    printf("(%d) %s, ", suggestion->suggestion[i], knowledge.card_names[suggestion->suggestion[i]]);
-                }
-                printf("\n");
-                send(fd, &suggestion_header, sizeof(suggestion_header), MSG_DONTWAIT);
-                send(fd, suggestion, suggestion_header.data_length, MSG_DONTWAIT);
-                free(suggestion);
             }
+            for (int i = 0; i < knowledge.num_categories; i++) {
+                printf("(%d) %s, ", cards[i], knowledge.card_names[cards[i]]);
+            }
+            printf("\n");
+            char frame[sizeof(Frame_t) + sizeof(cards)];
+            send_frame(fd, frame, clue_encode_cards(frame, sizeof(frame), type, cards, knowledge.num_categories));
         }
     } else if (header->type == FRAME_TYPE_QUERY) {
         QueryFrame_t* query = (QueryFrame_t*)buffer;
@@ -244,16 +286,15 @@ void handle_frame(Frame_t* header, int fd) {
             }
             if (num_cards_held == 0) {
                 // We don't need to pass, the server will do it for us
+            } else if (num_cards_held == 1) {
+                // Nothing to choose, and we asked the server to show it for us
+                printf("The server shows (%d) %s for me\n", cards_held[0], knowledge.card_names[cards_held[0]]);
             } else {
                 // Now we can be random
-                QueryResponseFrame_t query_response = {};
-                query_response.card_id = cards_held[rand() % num_cards_held];
-                Frame_t query_response_header = {};
-                query_response_header.type = FRAME_TYPE_QUERY_RESPONSE;
-                query_response_header.data_length = sizeof(query_response);
-                printf("I am responding with (%d) %s\n", query_response.card_id, knowledge.card_names[query_response.card_id]);
-                send(fd, &query_response_header, sizeof(query_response_header), MSG_DONTWAIT);
-                send(fd, &query_response, query_response_header.data_length, MSG_DONTWAIT);
+                int16_t card_id = cards_held[rand() % num_cards_held];
+                printf("I am responding with (%d) %s\n", card_id, knowledge.card_names[card_id]);
+                char frame[sizeof(Frame_t) + sizeof(QueryResponseFrame_t)];
+                send_frame(fd, frame, clue_encode_query_response(frame, sizeof(frame), card_id));
             }
         }
     } else if (header->type == FRAME_TYPE_QUERY_RETURN) {
@@ -264,9 +305,18 @@ void handle_frame(Frame_t* header, int fd) {
         if (result->player == knowledge.player_id && result->correct) {
             printf("gg id like to thank monte carlo for this victory\n");
         }
+    } else if (header->type == FRAME_TYPE_GAME_OVER) {
+        // Another game with the same players is coming, forget this one
+        GameOverFrame_t* game_over = (GameOverFrame_t*)buffer;
+        if (game_over->winner == knowledge.player_id) {
+            printf("gg id like to thank monte carlo for this victory\n");
+        }
+        printf("Game over, %d more to go\n", game_over->games_left);
+        knowledge.turns_played = 0;
+        free(knowledge.hand);
+        knowledge.hand = NULL;
+        knowledge.hand_size = 0;
     } else {
         printf("Unhandled frame %d\n", header->type);
     }
-
-    free(buffer);
-}
\ No newline at end of file
+}
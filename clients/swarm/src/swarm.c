@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "clue/codec.h"
+#include "clue/compact.h"
+#include "clue/rng.h"
+
+// A whole crowd of Randys on one epoll loop, for seeing how many games a second the server can
+// take. Every bot plays exactly like clients/randy, minus the printing. When the server is done
+// with a bot it connects again right away, so the load stays put until time is up
+
+#define NAME "Swarm"
+#define SWARM_MAX_EVENTS 256
+#define SWARM_OUT_SIZE 256 // Nothing we send is anywhere near this big
+#define SWARM_REPORT_INTERVAL 1000 // Milliseconds between progress lines
+
+typedef struct {
+    int fd;
+    ClueStream_t in;
+    char out[SWARM_OUT_SIZE]; // Whatever the socket didn't take yet
+    int out_length;
+    int player_id;
+    int num_categories;
+    int16_t* num_cards_in_category;
+    int hand_size;
+    int16_t* hand;
+    int turns_played;
+    int64_t turn_sent; // When our last turn went out, 0 once the server answered it
+    ClueRng_t rng;
+    ClueCompact_t compact; // From the last RULES, for protocol v2
+} Bot_t;
+
+// Round trip times, from sending a turn to the first frame the server sends back
+typedef struct {
+    uint32_t* samples; // Microseconds
+    int64_t count;
+    int64_t size;
+} Samples_t;
+
+int64_t now_us();
+void bot_connect(Bot_t* bot); // Open a fresh connection and queue FRAME_TYPE_CONNECT
+void bot_close(Bot_t* bot); // Close the connection and forget the game
+int bot_read(Bot_t* bot); // Read and handle everything available. Returns 0 if the connection is done
+int bot_flush(Bot_t* bot); // Send what is waiting. Returns 0 if the connection broke
+void bot_send(Bot_t* bot, const char* frame, int32_t length); // A v1 frame, repacked first for protocol v2
+void handle_frame(Bot_t* bot, Frame_t* header, char* data);
+void samples_add(Samples_t* samples, int64_t micros);
+void report(const char* label, int64_t games, int64_t elapsed_us, Samples_t* samples); // Print one line and empty the samples
+
+struct sockaddr_in6 server_address;
+int epoll_fd;
+int protocol = CLUE_PROTOCOL_V1;
+int connect_flags = 0; // CLUE_CONNECT_AUTO_SHOW if asked for
+char* decoded; // With protocol v2, the v1 data of the frame being handled
+int32_t decoded_size;
+int64_t bytes_received = 0;
+int64_t games_finished = 0; // Counted by whoever sat in seat 0, so every game counts once
+int64_t errors = 0;
+int64_t reconnects = 0;
+Samples_t window; // Since the last progress line
+Samples_t total; // Since the start
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        printf("Usage: ./swarm <ip> <port> <connections> [seconds] [protocol] [auto_show]\n");
+        exit(1);
+    }
+    server_address.sin6_family = AF_INET6;
+    server_address.sin6_port = atoi(argv[2]);
+    if (server_address.sin6_port == 0) {
+        printf("%s not a valid port\n", argv[2]);
+        exit(1);
+    }
+    int rc = inet_pton(AF_INET6, argv[1], &server_address.sin6_addr);
+    if (rc == 0) {
+        printf("%s not a valid IP address\n", argv[1]);
+        exit(1);
+    } else if (rc == -1) {
+        perror(NULL);
+        exit(1);
+    }
+    int num_bots = atoi(argv[3]);
+    if (num_bots < 1) {
+        printf("Need at least one connection\n");
+        exit(1);
+    }
+    int seconds = argc > 4 ? atoi(argv[4]) : 10;
+    protocol = argc > 5 ? atoi(argv[5]) : CLUE_PROTOCOL_V1;
+    if (protocol != CLUE_PROTOCOL_V1 && protocol != CLUE_PROTOCOL_V2) {
+        printf("Protocol is %d or %d\n", CLUE_PROTOCOL_V1, CLUE_PROTOCOL_V2);
+        exit(1);
+    }
+    connect_flags = argc > 6 && atoi(argv[6]) ? CLUE_CONNECT_AUTO_SHOW : 0;
+
+    // Thousands of sockets is more than most default limits allow
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < (rlim_t)num_bots + 16) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < (rlim_t)num_bots + 16) {
+            printf("Can only open %d files, asking for %d connections\n", (int)limit.rlim_cur, num_bots);
+        }
+    }
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd == -1) {
+        perror(NULL);
+        exit(1);
+    }
+    ClueRng_t seeder;
+    clue_rng_seed(&seeder, time(NULL));
+    Bot_t* bots = calloc(num_bots, sizeof(Bot_t));
+    for (int i = 0; i < num_bots; i++) {
+        bots[i].fd = -1;
+        clue_rng_seed(&bots[i].rng, clue_rng_next(&seeder));
+        clue_stream_init(&bots[i].in, 1024);
+        bot_connect(&bots[i]);
+    }
+    printf("%d connections for %d seconds, protocol v%d%s\n", num_bots, seconds, protocol, connect_flags ? ", server shows forced cards" : "");
+
+    int64_t start = now_us();
+    int64_t end = start + (int64_t)seconds * 1000000;
+    int64_t last_report = start;
+    int64_t last_games = 0;
+    struct epoll_event events[SWARM_MAX_EVENTS];
+    while (1) {
+        int64_t now = now_us();
+        if (now >= end) {
+            break;
+        }
+        if (now - last_report >= SWARM_REPORT_INTERVAL * 1000) {
+            report("", games_finished - last_games, now - last_report, &window);
+            last_report = now;
+            last_games = games_finished;
+        }
+        int num_events = epoll_wait(epoll_fd, events, SWARM_MAX_EVENTS, SWARM_REPORT_INTERVAL / 10);
+        if (num_events == -1 && errno != EINTR) {
+            perror(NULL);
+            exit(1);
+        }
+        for (int i = 0; i < num_events; i++) {
+            Bot_t* bot = events[i].data.ptr;
+            int alive = 1;
+            if (events[i].events & EPOLLOUT) {
+                alive = bot_flush(bot);
+            }
+            if (alive && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                alive = bot_read(bot);
+            }
+            if (!alive) {
+                // Either the game is over or something broke, back in line for the next one
+                bot_close(bot);
+                bot_connect(bot);
+                reconnects++;
+            }
+        }
+    }
+
+    int64_t elapsed = now_us() - start;
+    printf("\n");
+    report("Total ", games_finished, elapsed, &total);
+    printf("%lld bytes received, %lld reconnects, %lld errors\n", (long long)bytes_received, (long long)reconnects, (long long)errors);
+    exit(0);
+}
+
+int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void bot_connect(Bot_t* bot) {
+    bot->fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (bot->fd == -1) {
+        perror(NULL);
+        exit(1);
+    }
+    if (connect(bot->fd, (const struct sockaddr*)&server_address, sizeof(server_address)) == -1 && errno != EINPROGRESS) {
+        perror(NULL);
+        exit(1);
+    }
+    // Goes out as soon as the connection is up, epoll says when with EPOLLOUT
+    bot->out_length = clue_encode_connect_flags(bot->out, sizeof(bot->out), NAME, strlen(NAME), protocol, connect_flags);
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = bot;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bot->fd, &event);
+}
+
+void bot_close(Bot_t* bot) {
+    close(bot->fd);
+    bot->fd = -1;
+    bot->out_length = 0;
+    bot->turns_played = 0;
+    bot->turn_sent = 0;
+    bot->hand_size = 0;
+    clue_stream_free(&bot->in);
+    clue_stream_init(&bot->in, 1024);
+}
+
+int bot_read(Bot_t* bot) {
+    // Edge triggered, so keep going until the socket runs dry
+    while (1) {
+        int32_t space;
+        char* buffer = clue_stream_reserve(&bot->in, 1024, &space);
+        ssize_t received = recv(bot->fd, buffer, space, 0);
+        if (received == 0) {
+            return 0;
+        } else if (received == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 1;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        if (bot->turn_sent) {
+            int64_t round_trip = now_us() - bot->turn_sent;
+            samples_add(&window, round_trip);
+            samples_add(&total, round_trip);
+            bot->turn_sent = 0;
+        }
+        clue_stream_commit(&bot->in, received);
+        bytes_received += received;
+        Frame_t header;
+        char* data;
+        int rc;
+        while ((rc = protocol == CLUE_PROTOCOL_V2 ? clue_stream_next_compact(&bot->in, &header, &data, INT32_MAX) : clue_stream_next(&bot->in, &header, &data, INT32_MAX)) == 1) {
+            if (protocol == CLUE_PROTOCOL_V2) {
+                // Back to v1 so the handlers stay the same. The first try also says how much room it needs
+                int32_t length = clue_compact_decode(&bot->compact, decoded, decoded_size, header.type, data, header.data_length);
+                if (length > decoded_size) {
+                    decoded_size = length;
+                    decoded = realloc(decoded, decoded_size);
+                    length = clue_compact_decode(&bot->compact, decoded, decoded_size, header.type, data, header.data_length);
+                }
+                if (length == -1) {
+                    errors++;
+                    return 0;
+                }
+                header.data_length = length;
+                data = decoded;
+            }
+            handle_frame(bot, &header, data);
+            if (bot->fd == -1) {
+                return 0;
+            }
+        }
+        if (rc == -1) {
+            errors++;
+            return 0;
+        }
+    }
+}
+
+int bot_flush(Bot_t* bot) {
+    while (bot->out_length > 0) {
+        ssize_t sent = send(bot->fd, bot->out, bot->out_length, MSG_NOSIGNAL);
+        if (sent > 0) {
+            memmove(bot->out, bot->out + sent, bot->out_length - sent);
+            bot->out_length -= sent;
+        } else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN)) {
+            // Still connecting or the socket is full, EPOLLOUT comes when that changes
+            return 1;
+        } else if (sent == -1 && errno != EINTR) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void bot_send(Bot_t* bot, const char* frame, int32_t length) {
+    char packed[SWARM_OUT_SIZE];
+    if (protocol == CLUE_PROTOCOL_V2) {
+        Frame_t* header = (Frame_t*)frame;
+        length = clue_compact_encode(&bot->compact, packed, sizeof(packed), header->type, frame + sizeof(Frame_t), header->data_length);
+        frame = packed;
+    }
+    if (length < 0 || bot->out_length + length > SWARM_OUT_SIZE) {
+        // The server stopped reading, it will notice on its own
+        errors++;
+        return;
+    }
+    memcpy(bot->out + bot->out_length, frame, length);
+    bot->out_length += length;
+    bot_flush(bot);
+}
+
+void handle_frame(Bot_t* bot, Frame_t* header, char* data) {
+    if (header->type == FRAME_TYPE_ERROR) {
+        ClueTextView_t error;
+        clue_text_view(data, header->data_length, &error);
+        printf("Server reported error: %.*s\n", error.length, error.text);
+        errors++;
+    } else if (header->type == FRAME_TYPE_ABORT) {
+        // The last game of the series. Normal endings are aborts too, so only the seat counts
+        if (bot->player_id == 0) {
+            games_finished++;
+        }
+        bot_close(bot);
+    } else if (header->type == FRAME_TYPE_RULES) {
+        ClueRulesView_t rules;
+        if (!clue_rules_view(data, header->data_length, &rules)) {
+            errors++;
+            return;
+        }
+        bot->player_id = rules.player_id;
+        bot->num_categories = rules.num_categories;
+        bot->num_cards_in_category = realloc(bot->num_cards_in_category, rules.num_categories * sizeof(int16_t));
+        memcpy(bot->num_cards_in_category, rules.num_cards_in_category, rules.num_categories * sizeof(int16_t));
+        clue_compact_init(&bot->compact, rules.num_categories, rules.num_cards_in_category);
+    } else if (header->type == FRAME_TYPE_START) {
+        ClueStartView_t start;
+        if (!clue_start_view(data, header->data_length, &start)) {
+            errors++;
+            return;
+        }
+        bot->hand_size = start.your_hand_size;
+        bot->hand = realloc(bot->hand, bot->hand_size * sizeof(int16_t));
+        memcpy(bot->hand, start.your_hand, bot->hand_size * sizeof(int16_t));
+        bot->turns_played = 0;
+    } else if (header->type == FRAME_TYPE_TURN) {
+        TurnFrame_t* turn = (TurnFrame_t*)data;
+        if (turn->player_id != bot->player_id) {
+            return;
+        }
+        bot->turns_played++;
+        int16_t cards[bot->num_categories];
+        int base_idx = 0;
+        for (int i = 0; i < bot->num_categories; i++) {
+            cards[i] = clue_rng_below(&bot->rng, bot->num_cards_in_category[i]) + base_idx;
+            base_idx += bot->num_cards_in_category[i];
+        }
+        int8_t type = bot->turns_played > 5 ? FRAME_TYPE_SOLVE_ATTEMPT : FRAME_TYPE_TURN_RESPONSE;
+        char frame[sizeof(Frame_t) + sizeof(cards)];
+        bot->turn_sent = now_us();
+        bot_send(bot, frame, clue_encode_cards(frame, sizeof(frame), type, cards, bot->num_categories));
+    } else if (header->type == FRAME_TYPE_QUERY) {
+        QueryFrame_t* query = (QueryFrame_t*)data;
+        if (query->player_id != bot->player_id) {
+            return;
+        }
+        int16_t cards_held[bot->num_categories];
+        int num_cards_held = 0;
+        for (int i = 0; i < bot->hand_size; i++) {
+            for (int j = 0; j < bot->num_categories; j++) {
+                if (bot->hand[i] == query->suggestion[j]) {
+                    cards_held[num_cards_held++] = bot->hand[i];
+                    break;
+                }
+            }
+        }
+        if (num_cards_held > 1 || (num_cards_held == 1 && !connect_flags)) {
+            char frame[sizeof(Frame_t) + sizeof(QueryResponseFrame_t)];
+            bot_send(bot, frame, clue_encode_query_response(frame, sizeof(frame), cards_held[clue_rng_below(&bot->rng, num_cards_held)]));
+        }
+    } else if (header->type == FRAME_TYPE_GAME_OVER) {
+        // More games with the same players to come
+        if (bot->player_id == 0) {
+            games_finished++;
+        }
+        bot->turns_played = 0;
+    }
+    // Nothing else matters to a Randy
+}
+
+void samples_add(Samples_t* samples, int64_t micros) {
+    if (samples->count == samples->size) {
+        samples->size = samples->size ? samples->size * 2 : 4096;
+        samples->samples = realloc(samples->samples, samples->size * sizeof(uint32_t));
+    }
+    samples->samples[samples->count++] = micros > UINT32_MAX ? UINT32_MAX : micros;
+}
+
+static int compare_samples(const void* left, const void* right) {
+    uint32_t l = *(const uint32_t*)left;
+    uint32_t r = *(const uint32_t*)right;
+    return (l > r) - (l < r);
+}
+
+void report(const char* label, int64_t games, int64_t elapsed_us, Samples_t* samples) {
+    uint32_t p50 = 0;
+    uint32_t p99 = 0;
+    if (samples->count > 0) {
+        qsort(samples->samples, samples->count, sizeof(uint32_t), compare_samples);
+        p50 = samples->samples[samples->count / 2];
+        p99 = samples->samples[samples->count * 99 / 100];
+    }
+    printf("%s%.1f games/sec, %lld turns, turn round trip p50 %.3f ms p99 %.3f ms\n", label, games / (elapsed_us / 1e6), (long long)samples->count, p50 / 1000.0, p99 / 1000.0);
+    samples->count = 0;
+}
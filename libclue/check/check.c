@@ -0,0 +1,203 @@
+// Checks clue_sample against clue_sample_exact on standard Clue. Every state is what player 0 of a
+// six player game knows after a few suggestions (and one wrong solve attempt, made twice), played
+// out from a real deal. The sampler has to land within CHECK_TOLERANCE of the exact counts on every
+// marginal and on how likely the most likely whole solution is, or this exits with 1. Run it with `bash build.sh check`
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clue/codec.h"
+#include "clue/deduce.h"
+#include "clue/engine.h"
+#include "clue/rng.h"
+#include "clue/sample.h"
+
+#define CHECK_PLAYERS 6
+#define CHECK_SAMPLES 400000
+#define CHECK_MAX_STATES (1 << 20)
+#define CHECK_TOLERANCE 0.01
+
+typedef struct {
+    ClueRules_t rules;
+    int16_t solution[3];
+    int8_t owner[21]; // Card -> player, -1 for the solution
+    ClueDeduce_t* deduce; // Player 0's
+} Check_t;
+
+static void check_deal(Check_t* check, ClueRng_t* rng); // Deal a game and tell player 0 their hand
+static void check_suggest(Check_t* check, ClueRng_t* rng, int8_t suggester); // One random suggestion, as player 0 sees it
+static void check_miss(Check_t* check, int8_t player); // A wrong solve attempt, as everyone sees it
+static double check_state(Check_t* check, const char* label); // Largest difference from the exact marginals
+
+int main() {
+    static int16_t num_cards[] = { 6, 6, 9 };
+    static int steps[] = { 0, 4, 8, 14 };
+    char* names[21];
+    for (int i = 0; i < 21; i++) {
+        names[i] = malloc(16);
+        snprintf(names[i], 16, "Card %d", i);
+    }
+    Check_t check = {};
+    check.rules.num_categories = 3;
+    check.rules.num_cards = num_cards;
+    check.rules.total_cards = 21;
+    check.rules.card_names = names;
+
+    double worst = 0;
+    for (uint64_t seed = 1; seed <= 2; seed++) {
+        ClueRng_t rng;
+        clue_rng_seed(&rng, seed);
+        check_deal(&check, &rng);
+        int done = 0;
+        for (int i = 0; i < (int)(sizeof(steps) / sizeof(steps[0])); i++) {
+            for (; done < steps[i]; done++) {
+                check_suggest(&check, &rng, done % CHECK_PLAYERS);
+            }
+            if (i == 2) {
+                // Same wrong guess from two players, which must only count once
+                check_miss(&check, 1);
+                check_miss(&check, 2);
+            }
+            char label[64];
+            snprintf(label, sizeof(label), "seed %llu, %d suggestions%s", (unsigned long long)seed, done, i >= 2 ? ", miss" : "");
+            double error = check_state(&check, label);
+            worst = error > worst ? error : worst;
+        }
+        clue_deduce_free(check.deduce);
+    }
+    for (int i = 0; i < 21; i++) {
+        free(names[i]);
+    }
+    if (worst > CHECK_TOLERANCE) {
+        printf("FAILED: the sampler is off by %.4f, more than %.4f\n", worst, CHECK_TOLERANCE);
+        return 1;
+    }
+    printf("OK: the sampler is within %.4f of the exact counts\n", worst);
+    return 0;
+}
+
+static void check_deal(Check_t* check, ClueRng_t* rng) {
+    int16_t base_idx = 0;
+    for (int i = 0; i < 3; i++) {
+        check->solution[i] = base_idx + clue_rng_below(rng, check->rules.num_cards[i]);
+        base_idx += check->rules.num_cards[i];
+    }
+    int16_t deck[21];
+    int deck_len = 0;
+    for (int16_t card = 0; card < 21; card++) {
+        check->owner[card] = -1;
+        if (card != check->solution[0] && card != check->solution[1] && card != check->solution[2]) {
+            deck[deck_len++] = card;
+        }
+    }
+    for (int i = deck_len - 1; i > 0; i--) {
+        int j = clue_rng_below(rng, i + 1);
+        int16_t tmp = deck[i];
+        deck[i] = deck[j];
+        deck[j] = tmp;
+    }
+    int16_t hand[21];
+    int hand_size = 0;
+    for (int i = 0; i < deck_len; i++) {
+        check->owner[deck[i]] = i % CHECK_PLAYERS;
+        if (i % CHECK_PLAYERS == 0) {
+            hand[hand_size++] = deck[i];
+        }
+    }
+
+    // Player 0 only ever learns things through frames
+    check->deduce = clue_deduce_new();
+    int rules_len;
+    char* rules = clue_rules_frame(&check->rules, &rules_len);
+    clue_deduce_frame(check->deduce, FRAME_TYPE_RULES, CLUE_PAYLOAD(rules), rules_len - sizeof(Frame_t));
+    free(rules);
+    int8_t order[CHECK_PLAYERS];
+    int16_t hand_sizes[CHECK_PLAYERS];
+    const char* player_names[CHECK_PLAYERS];
+    int8_t name_lengths[CHECK_PLAYERS];
+    for (int i = 0; i < CHECK_PLAYERS; i++) {
+        order[i] = i;
+        hand_sizes[i] = deck_len / CHECK_PLAYERS;
+        player_names[i] = "Check";
+        name_lengths[i] = 5;
+    }
+    int start_len = clue_encode_start(NULL, 0, hand, hand_size, CHECK_PLAYERS, order, hand_sizes, player_names, name_lengths);
+    char* start = malloc(start_len);
+    clue_encode_start(start, start_len, hand, hand_size, CHECK_PLAYERS, order, hand_sizes, player_names, name_lengths);
+    clue_deduce_frame(check->deduce, FRAME_TYPE_START, CLUE_PAYLOAD(start), start_len - sizeof(Frame_t));
+    free(start);
+}
+
+static void check_suggest(Check_t* check, ClueRng_t* rng, int8_t suggester) {
+    int16_t suggestion[3];
+    int16_t base_idx = 0;
+    for (int i = 0; i < 3; i++) {
+        suggestion[i] = base_idx + clue_rng_below(rng, check->rules.num_cards[i]);
+        base_idx += check->rules.num_cards[i];
+    }
+    for (int distance = 1; distance < CHECK_PLAYERS; distance++) {
+        int8_t player = (suggester + distance) % CHECK_PLAYERS;
+        int16_t shown = -1;
+        for (int i = 0; i < 3; i++) {
+            if (check->owner[suggestion[i]] == player && (shown == -1 || suggestion[i] < shown)) {
+                shown = suggestion[i];
+            }
+        }
+        if (shown == -1) {
+            for (int i = 0; i < 3; i++) {
+                clue_deduce_lacks(check->deduce, player, suggestion[i]);
+            }
+            continue;
+        }
+        if (suggester == 0) {
+            clue_deduce_has(check->deduce, player, shown);
+        } else if (player != 0) {
+            clue_deduce_one_of(check->deduce, player, suggestion, 3);
+        }
+        return;
+    }
+}
+
+static void check_miss(Check_t* check, int8_t player) {
+    // Any solution but the real one
+    int16_t cards[3];
+    memcpy(cards, check->solution, sizeof(cards));
+    cards[2] = cards[2] == 12 ? 13 : 12;
+    int16_t frame[2 + 3]; // int16_t so the cards line up
+    SolveResultFrame_t* result = (SolveResultFrame_t*)frame;
+    result->player = player;
+    result->correct = 0;
+    memcpy(result->cards, cards, sizeof(cards));
+    clue_deduce_frame(check->deduce, FRAME_TYPE_SOLVE_RESULT, result, sizeof(SolveResultFrame_t) + sizeof(cards));
+}
+
+static double check_state(Check_t* check, const char* label) {
+    ClueSampleConfig_t config = {};
+    config.num_samples = CHECK_SAMPLES;
+    config.seed = 1;
+    ClueSample_t* exact = clue_sample_exact(check->deduce, CHECK_MAX_STATES, &config);
+    ClueSample_t* sample = clue_sample(check->deduce, &config);
+    double error = 0;
+    int outside = 0;
+    for (int card = 0; card < 21; card++) {
+        double difference = fabs(sample->solution[card] - exact->solution[card]);
+        error = difference > error ? difference : error;
+        outside += exact->solution[card] < sample->solution_low[card] || exact->solution[card] > sample->solution_high[card];
+        for (int player = 0; player < CHECK_PLAYERS; player++) {
+            difference = fabs(sample->held[player * 21 + card] - exact->held[player * 21 + card]);
+            error = difference > error ? difference : error;
+        }
+    }
+    // The most likely whole solution, seen about as often as it should be
+    double difference = fabs(sample->best_probability - exact->best_probability);
+    error = difference > error ? difference : error;
+    printf("%-36s %s, %.0f deals, %d samples, max error %.4f, %d of 21 outside the bounds, best %.4f\n", label, exact->exact ? "exact" : "NOT EXACT", exact->num_deals, sample->num_samples, error, outside, exact->best_probability);
+    if (!exact->exact || sample->num_samples == 0 || exact->best_probability == 0) {
+        error = INFINITY;
+    }
+    clue_sample_free(exact);
+    clue_sample_free(sample);
+    return error;
+}
@@ -0,0 +1,326 @@
+#ifndef __clue_codec_h__
+#define __clue_codec_h__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clue/frames.h"
+
+// Reading and writing frames without allocating for every one of them. Header only, so clients can
+// use it without linking libclue.
+//
+// Reading: receive into a ClueStream_t and take whole frames out of it with clue_stream_next. The
+// data pointer it hands out points into the stream and stays valid until the next
+// clue_stream_reserve. The frames with arrays in the middle (RULES, START, ERROR, ABORT) have views
+// that find those arrays for you and check that they fit in the frame.
+//
+// Writing: the clue_encode_* functions write a whole frame, header included, into your buffer so
+// it can go out with one send. Like snprintf they return the length of the whole frame and only
+// write if it fits, so calling with size 0 tells you how big the buffer needs to be.
+
+#define CLUE_PAYLOAD(frame) ((char*)(frame) + sizeof(Frame_t)) // Where the data starts in an encoded frame
+
+// ---- Stream decoder ----
+
+// A receive buffer that wraps around. Frames are handed out in place, and when the end of the
+// buffer is reached, the partial frame left over slides to the front. That is at most one frame,
+// so unlike consuming with a memmove per frame the cost does not grow with how much is queued up
+typedef struct {
+    char* buffer;
+    int32_t size;
+    int32_t start; // First byte not handed out yet
+    int32_t end; // One past the last byte received
+} ClueStream_t;
+
+static inline void clue_stream_init(ClueStream_t* stream, int32_t size) {
+    stream->buffer = malloc(size);
+    stream->size = size;
+    stream->start = 0;
+    stream->end = 0;
+}
+
+static inline void clue_stream_free(ClueStream_t* stream) {
+    free(stream->buffer);
+    stream->buffer = NULL;
+}
+
+// Somewhere to receive at least min_space bytes to. *space is set to how much room there really is.
+// Frames handed out before this are no longer valid
+static inline char* clue_stream_reserve(ClueStream_t* stream, int32_t min_space, int32_t* space) {
+    if (stream->size - stream->end < min_space) {
+        int32_t unread = stream->end - stream->start;
+        memmove(stream->buffer, stream->buffer + stream->start, unread);
+        stream->start = 0;
+        stream->end = unread;
+        while (stream->size - stream->end < min_space) {
+            // Frame bigger than the whole buffer
+            stream->size *= 2;
+            stream->buffer = realloc(stream->buffer, stream->size);
+        }
+    }
+    *space = stream->size - stream->end;
+    return stream->buffer + stream->end;
+}
+
+// received bytes were written to what clue_stream_reserve returned
+static inline void clue_stream_commit(ClueStream_t* stream, int32_t received) {
+    stream->end += received;
+}
+
+// Take the next whole frame out of the stream. Returns 1 if there was one, 0 if more bytes are
+// needed, and -1 if the header claims a negative length or more than max_length bytes of data
+static inline int clue_stream_next(ClueStream_t* stream, Frame_t* header, char** data, int32_t max_length) {
+    int32_t available = stream->end - stream->start;
+    if (available < (int32_t)sizeof(Frame_t)) {
+        return 0;
+    }
+    memcpy(header, stream->buffer + stream->start, sizeof(Frame_t));
+    if (header->data_length < 0 || header->data_length > max_length) {
+        return -1;
+    }
+    if (available < (int32_t)sizeof(Frame_t) + header->data_length) {
+        return 0;
+    }
+    *data = stream->buffer + stream->start + sizeof(Frame_t);
+    stream->start += sizeof(Frame_t) + header->data_length;
+    if (stream->start == stream->end) {
+        // Caught up, the next receive can start from the front without moving anything
+        stream->start = 0;
+        stream->end = 0;
+    }
+    return 1;
+}
+
+// ---- Views ----
+// Each returns 0 if the frame is too short for what it says it holds
+
+typedef struct {
+    int8_t player_id;
+    int8_t num_categories;
+    int16_t num_cards;
+    const int16_t* num_cards_in_category; // Length num_categories
+    const int16_t* cards; // Every category's card IDs, one category after the other. Length num_cards
+    const char* names; // Card names, walk them with clue_name_next
+    const char* names_end;
+} ClueRulesView_t;
+
+typedef struct {
+    int16_t your_hand_size;
+    int8_t num_players;
+    const int16_t* your_hand; // Length your_hand_size
+    const int8_t* player_order; // Length num_players. Seat -> player ID
+    const int16_t* player_hand_sizes; // Length num_players, by seat
+    const char* names; // Player names by seat, walk them with clue_name_next
+    const char* names_end;
+} ClueStartView_t;
+
+typedef struct {
+    int32_t length;
+    const char* text; // Not NUL terminated
+} ClueTextView_t;
+
+static inline int clue_rules_view(const char* data, int32_t data_length, ClueRulesView_t* view) {
+    const RulesFrame_t* rules = (const RulesFrame_t*)data;
+    if (data_length < (int32_t)sizeof(RulesFrame_t)) {
+        return 0;
+    }
+    view->player_id = rules->player_id;
+    view->num_categories = rules->num_categories;
+    view->num_cards = rules->num_cards;
+    if (view->num_categories < 0 || view->num_cards < 0) {
+        return 0;
+    }
+    view->num_cards_in_category = (const int16_t*)(data + sizeof(RulesFrame_t));
+    view->cards = view->num_cards_in_category + view->num_categories;
+    view->names = (const char*)(view->cards + view->num_cards);
+    view->names_end = data + data_length;
+    return view->names <= view->names_end;
+}
+
+static inline int clue_start_view(const char* data, int32_t data_length, ClueStartView_t* view) {
+    const StartFrame_t* start = (const StartFrame_t*)data;
+    if (data_length < (int32_t)sizeof(StartFrame_t)) {
+        return 0;
+    }
+    view->your_hand_size = start->your_hand_size;
+    view->num_players = start->num_players;
+    if (view->your_hand_size < 0 || view->num_players < 0) {
+        return 0;
+    }
+    view->your_hand = (const int16_t*)(data + sizeof(StartFrame_t));
+    view->player_order = (const int8_t*)(view->your_hand + view->your_hand_size);
+    view->player_hand_sizes = (const int16_t*)(view->player_order + view->num_players);
+    view->names = (const char*)(view->player_hand_sizes + view->num_players);
+    view->names_end = data + data_length;
+    return view->names <= view->names_end;
+}
+
+// ERROR and ABORT
+static inline int clue_text_view(const char* data, int32_t data_length, ClueTextView_t* view) {
+    const ErrorFrame_t* error = (const ErrorFrame_t*)data;
+    if (data_length < (int32_t)sizeof(ErrorFrame_t)) {
+        return 0;
+    }
+    view->length = error->error_length;
+    view->text = error->error;
+    return view->length >= 0 && view->length <= data_length - (int32_t)sizeof(ErrorFrame_t);
+}
+
+// Walk a list of length prefixed names. Returns the next name and sets *length, or NULL once the
+// list runs past end
+static inline const char* clue_name_next(const char** cursor, const char* end, int8_t* length) {
+    if (*cursor >= end) {
+        return NULL;
+    }
+    *length = **cursor;
+    const char* name = *cursor + 1;
+    if (*length < 0 || name + *length > end) {
+        return NULL;
+    }
+    *cursor = name + *length;
+    return name;
+}
+
+// ---- Encoders ----
+
+static inline void clue_encode_header(char* out, int8_t type, int32_t data_length) {
+    Frame_t header = {};
+    header.type = type;
+    header.data_length = data_length;
+    memcpy(out, &header, sizeof(header));
+}
+
+static inline int32_t clue_encode_connect(char* out, int32_t size, const char* name, int8_t name_length) {
+    int32_t data_length = sizeof(ConnectFrame_t) + name_length;
+    int32_t length = sizeof(Frame_t) + data_length;
+    if (length <= size) {
+        clue_encode_header(out, FRAME_TYPE_CONNECT, data_length);
+        ConnectFrame_t* connect = (ConnectFrame_t*)CLUE_PAYLOAD(out);
+        connect->name_length = name_length;
+        memcpy(connect->name, name, name_length);
+    }
+    return length;
+}
+
+// Same, asking for a CLUE_PROTOCOL_* from the next frame on
+static inline int32_t clue_encode_connect_version(char* out, int32_t size, const char* name, int8_t name_length, int8_t version) {
+    int32_t length = clue_encode_connect(out, size, name, name_length) + 1;
+    if (length <= size) {
+        clue_encode_header(out, FRAME_TYPE_CONNECT, length - sizeof(Frame_t));
+        out[length - 1] = version;
+    }
+    return length;
+}
+
+// Same, with CLUE_CONNECT_* flags as well
+static inline int32_t clue_encode_connect_flags(char* out, int32_t size, const char* name, int8_t name_length, int8_t version, uint8_t flags) {
+    int32_t length = clue_encode_connect_version(out, size, name, name_length, version) + 1;
+    if (length <= size) {
+        clue_encode_header(out, FRAME_TYPE_CONNECT, length - sizeof(Frame_t));
+        out[length - 1] = flags;
+    }
+    return length;
+}
+
+// FRAME_TYPE_TURN_RESPONSE or FRAME_TYPE_SOLVE_ATTEMPT, one card per category
+static inline int32_t clue_encode_cards(char* out, int32_t size, int8_t type, const int16_t* cards, int8_t num_categories) {
+    int32_t data_length = num_categories * sizeof(int16_t);
+    int32_t length = sizeof(Frame_t) + data_length;
+    if (length <= size) {
+        clue_encode_header(out, type, data_length);
+        memcpy(CLUE_PAYLOAD(out), cards, data_length);
+    }
+    return length;
+}
+
+static inline int32_t clue_encode_query_response(char* out, int32_t size, int16_t card_id) {
+    int32_t length = sizeof(Frame_t) + sizeof(QueryResponseFrame_t);
+    if (length <= size) {
+        clue_encode_header(out, FRAME_TYPE_QUERY_RESPONSE, sizeof(QueryResponseFrame_t));
+        QueryResponseFrame_t response = {};
+        response.card_id = card_id;
+        memcpy(CLUE_PAYLOAD(out), &response, sizeof(response));
+    }
+    return length;
+}
+
+// FRAME_TYPE_ERROR or FRAME_TYPE_ABORT
+static inline int32_t clue_encode_text(char* out, int32_t size, int8_t type, const char* text, int32_t text_length) {
+    int32_t data_length = sizeof(ErrorFrame_t) + text_length;
+    int32_t length = sizeof(Frame_t) + data_length;
+    if (length <= size) {
+        clue_encode_header(out, type, data_length);
+        ErrorFrame_t* error = (ErrorFrame_t*)CLUE_PAYLOAD(out);
+        error->error_length = text_length;
+        memcpy(error->error, text, text_length);
+    }
+    return length;
+}
+
+// card_names can be NULL, every card then gets an empty name
+static inline int32_t clue_encode_rules(char* out, int32_t size, int8_t player_id, int8_t num_categories, const int16_t* num_cards_in_category, char* const* card_names) {
+    int16_t num_cards = 0;
+    for (int i = 0; i < num_categories; i++) {
+        num_cards += num_cards_in_category[i];
+    }
+    int32_t data_length = sizeof(RulesFrame_t) + (num_categories + num_cards) * sizeof(int16_t) + num_cards;
+    for (int i = 0; card_names && i < num_cards; i++) {
+        data_length += strlen(card_names[i]);
+    }
+    int32_t length = sizeof(Frame_t) + data_length;
+    if (length > size) {
+        return length;
+    }
+
+    clue_encode_header(out, FRAME_TYPE_RULES, data_length);
+    RulesFrame_t* rules = (RulesFrame_t*)CLUE_PAYLOAD(out);
+    rules->player_id = player_id;
+    rules->num_categories = num_categories;
+    rules->num_cards = num_cards;
+    int16_t* category_sizes = (int16_t*)(CLUE_PAYLOAD(out) + sizeof(RulesFrame_t));
+    int16_t* card_ids = category_sizes + num_categories;
+    char* names = (char*)(card_ids + num_cards);
+    memcpy(category_sizes, num_cards_in_category, num_categories * sizeof(int16_t));
+    for (int i = 0; i < num_cards; i++) {
+        card_ids[i] = i; // Redundant, the ID is the index. Good QoL though
+        int8_t name_length = card_names ? strlen(card_names[i]) : 0;
+        *names++ = name_length;
+        memcpy(names, card_names ? card_names[i] : "", name_length);
+        names += name_length;
+    }
+    return length;
+}
+
+// Everything but the hand is by seat
+static inline int32_t clue_encode_start(char* out, int32_t size, const int16_t* hand, int16_t hand_size, int8_t num_players, const int8_t* player_order, const int16_t* player_hand_sizes, const char* const* player_names, const int8_t* name_lengths) {
+    int32_t data_length = sizeof(StartFrame_t) + hand_size * sizeof(int16_t) + num_players * (sizeof(int8_t) + sizeof(int16_t) + sizeof(int8_t));
+    for (int i = 0; i < num_players; i++) {
+        data_length += name_lengths[i];
+    }
+    int32_t length = sizeof(Frame_t) + data_length;
+    if (length > size) {
+        return length;
+    }
+
+    clue_encode_header(out, FRAME_TYPE_START, data_length);
+    StartFrame_t* start = (StartFrame_t*)CLUE_PAYLOAD(out);
+    start->your_hand_size = hand_size;
+    start->num_players = num_players;
+    start->_reserved = 0;
+    int16_t* your_hand = (int16_t*)(CLUE_PAYLOAD(out) + sizeof(StartFrame_t));
+    int8_t* order = (int8_t*)(your_hand + hand_size);
+    int16_t* hand_sizes = (int16_t*)(order + num_players);
+    char* names = (char*)(hand_sizes + num_players);
+    memcpy(your_hand, hand, hand_size * sizeof(int16_t));
+    memcpy(order, player_order, num_players * sizeof(int8_t));
+    memcpy(hand_sizes, player_hand_sizes, num_players * sizeof(int16_t));
+    for (int i = 0; i < num_players; i++) {
+        *names++ = name_lengths[i];
+        memcpy(names, player_names[i], name_lengths[i]);
+        names += name_lengths[i];
+    }
+    return length;
+}
+
+#endif
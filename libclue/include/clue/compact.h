@@ -0,0 +1,439 @@
+#ifndef __clue_compact_h__
+#define __clue_compact_h__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "clue/codec.h"
+#include "clue/frames.h"
+
+// Protocol v2: the same frames as v1 with the same meaning, only smaller and the same on every
+// architecture. A client asks for it by putting CLUE_PROTOCOL_V2 after its name in
+// FRAME_TYPE_CONNECT (which is always v1), and everything after that, RULES included, is v2 both
+// ways. Header only like clue/codec.h.
+//
+// Numbers are single bytes or LEB128 varints (7 bits at a time, low bits first, high bit set on
+// every byte but the last). Signed ones are zigzagged first, so -1 is 1 and 1 is 2.
+//
+// Header: varint of data_length << 4 | type. Types only go up to 15. Frames with up to 7 bytes of
+// data have a 1 byte header, and up to 1023 bytes of data a 2 byte one.
+//
+// Data, by frame type:
+//   ERROR, ABORT   varint length, text
+//   RULES          player_id, num_categories, varint num_cards_in_category each, then every card
+//                  name as a length byte and the name. Card IDs are left out, they are the index
+//   START          varint your_hand_size, num_players, your hand as zigzag differences from the
+//                  card before (the first from 0), player_order, varint player_hand_sizes each,
+//                  then the player names like the card names
+//   TURN           player_id
+//   QUERY          player_id, cards
+//   QUERY_RETURN   player_id, zigzag card_id
+//   SOLVE_RESULT   player, correct, cards
+//   GAME_OVER      winner (0xFF for nobody), varint games_left
+//   TURN_RESPONSE, SOLVE_ATTEMPT   cards
+//   QUERY_RESPONSE                 zigzag card_id
+//   Anything else is sent as is
+//
+// cards is one card per category, in category order, packed: bit 0 is 1, then each card's place
+// within its category in just enough bits for that category, lowest bits first. Standard Clue
+// fits in 2 bytes. Anything else (a client suggesting two weapons, say) gets a 0 byte and then
+// num_categories zigzag card IDs instead, so the server can still turn it down.
+//
+// clue_compact_encode turns a v1 frame's data into a whole v2 frame, and clue_compact_decode
+// turns v2 data back into what the v1 frame's data would have been, so everything written
+// against clue/codec.h's views and encoders keeps working.
+
+#define CLUE_COMPACT_MAX_HEADER 5
+
+typedef struct {
+    int8_t num_categories;
+    int16_t first[127]; // First card ID of each category
+    int16_t count[127]; // Cards in each category
+    uint8_t bits[127]; // Bits for a card's place within its category
+} ClueCompact_t;
+
+// From the rules. A client can only decode RULES until it has done this
+static inline void clue_compact_init(ClueCompact_t* compact, int8_t num_categories, const int16_t* num_cards_in_category) {
+    compact->num_categories = num_categories;
+    int16_t first = 0;
+    for (int i = 0; i < num_categories; i++) {
+        compact->first[i] = first;
+        compact->count[i] = num_cards_in_category[i];
+        compact->bits[i] = 0;
+        while ((1 << compact->bits[i]) < num_cards_in_category[i]) {
+            compact->bits[i]++;
+        }
+        first += num_cards_in_category[i];
+    }
+}
+
+// ---- Bytes in and out ----
+
+// Keeps counting once out of room, like snprintf, so the same pass measures and writes
+typedef struct {
+    char* out;
+    int32_t size;
+    int32_t length;
+} ClueWriter_t;
+
+// Stops at the end, and remembers that it had to
+typedef struct {
+    const char* cursor;
+    const char* end;
+    int bad;
+} ClueReader_t;
+
+static inline void clue_put_bytes(ClueWriter_t* writer, const void* data, int32_t length) {
+    if (writer->length + length <= writer->size) {
+        memcpy(writer->out + writer->length, data, length);
+    }
+    writer->length += length;
+}
+
+static inline void clue_put_u8(ClueWriter_t* writer, uint8_t value) {
+    if (writer->length < writer->size) {
+        writer->out[writer->length] = value;
+    }
+    writer->length++;
+}
+
+static inline void clue_put_varint(ClueWriter_t* writer, uint32_t value) {
+    while (value >= 0x80) {
+        clue_put_u8(writer, value | 0x80);
+        value >>= 7;
+    }
+    clue_put_u8(writer, value);
+}
+
+static inline void clue_put_zigzag(ClueWriter_t* writer, int32_t value) {
+    clue_put_varint(writer, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static inline const char* clue_get_bytes(ClueReader_t* reader, int32_t length) {
+    if (length < 0 || reader->end - reader->cursor < length) {
+        reader->bad = 1;
+        reader->cursor = reader->end;
+        return NULL;
+    }
+    const char* bytes = reader->cursor;
+    reader->cursor += length;
+    return bytes;
+}
+
+static inline uint8_t clue_get_u8(ClueReader_t* reader) {
+    const char* byte = clue_get_bytes(reader, 1);
+    return byte ? (uint8_t)*byte : 0;
+}
+
+static inline uint32_t clue_get_varint(ClueReader_t* reader) {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte = clue_get_u8(reader);
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    reader->bad = 1;
+    return 0;
+}
+
+static inline int32_t clue_get_zigzag(ClueReader_t* reader) {
+    uint32_t value = clue_get_varint(reader);
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+// ---- Card tuples ----
+
+static inline void clue_put_cards(ClueWriter_t* writer, const ClueCompact_t* compact, const int16_t* cards) {
+    int packed = 1;
+    for (int i = 0; i < compact->num_categories; i++) {
+        if (cards[i] < compact->first[i] || cards[i] >= compact->first[i] + compact->count[i]) {
+            packed = 0;
+        }
+    }
+    if (!packed) {
+        clue_put_u8(writer, 0);
+        for (int i = 0; i < compact->num_categories; i++) {
+            clue_put_zigzag(writer, cards[i]);
+        }
+        return;
+    }
+    uint64_t bits = 1;
+    int num_bits = 1;
+    for (int i = 0; i < compact->num_categories; i++) {
+        bits |= (uint64_t)(cards[i] - compact->first[i]) << num_bits;
+        num_bits += compact->bits[i];
+        while (num_bits >= 8) {
+            clue_put_u8(writer, bits);
+            bits >>= 8;
+            num_bits -= 8;
+        }
+    }
+    if (num_bits > 0) {
+        clue_put_u8(writer, bits);
+    }
+}
+
+static inline void clue_get_cards(ClueReader_t* reader, const ClueCompact_t* compact, ClueWriter_t* writer) {
+    int16_t card;
+    if (reader->cursor < reader->end && !(*reader->cursor & 1)) {
+        clue_get_u8(reader);
+        for (int i = 0; i < compact->num_categories; i++) {
+            card = clue_get_zigzag(reader);
+            clue_put_bytes(writer, &card, sizeof(card));
+        }
+        return;
+    }
+    uint64_t bits = clue_get_u8(reader) >> 1;
+    int num_bits = 7;
+    for (int i = 0; i < compact->num_categories; i++) {
+        while (num_bits < compact->bits[i]) {
+            bits |= (uint64_t)clue_get_u8(reader) << num_bits;
+            num_bits += 8;
+        }
+        int16_t place = bits & ((1 << compact->bits[i]) - 1);
+        bits >>= compact->bits[i];
+        num_bits -= compact->bits[i];
+        if (place >= compact->count[i]) {
+            reader->bad = 1;
+        }
+        card = compact->first[i] + place;
+        clue_put_bytes(writer, &card, sizeof(card));
+    }
+}
+
+// ---- Frames ----
+
+static inline void clue_compact_put_data(ClueWriter_t* writer, const ClueCompact_t* compact, int8_t type, const char* data, int32_t data_length, int* ok) {
+    int32_t cards_length = compact->num_categories * sizeof(int16_t);
+    *ok = 1;
+    if (type == FRAME_TYPE_ERROR || type == FRAME_TYPE_ABORT) {
+        ClueTextView_t text;
+        *ok = clue_text_view(data, data_length, &text);
+        if (*ok) {
+            clue_put_varint(writer, text.length);
+            clue_put_bytes(writer, text.text, text.length);
+        }
+    } else if (type == FRAME_TYPE_RULES) {
+        ClueRulesView_t rules;
+        *ok = clue_rules_view(data, data_length, &rules);
+        if (*ok) {
+            clue_put_u8(writer, rules.player_id);
+            clue_put_u8(writer, rules.num_categories);
+            for (int i = 0; i < rules.num_categories; i++) {
+                clue_put_varint(writer, rules.num_cards_in_category[i]);
+            }
+            const char* cursor = rules.names;
+            int8_t name_length;
+            for (int i = 0; i < rules.num_cards; i++) {
+                const char* name = clue_name_next(&cursor, rules.names_end, &name_length);
+                *ok = *ok && name;
+                clue_put_u8(writer, name ? name_length : 0);
+                clue_put_bytes(writer, name, name ? name_length : 0);
+            }
+        }
+    } else if (type == FRAME_TYPE_START) {
+        ClueStartView_t start;
+        *ok = clue_start_view(data, data_length, &start);
+        if (*ok) {
+            clue_put_varint(writer, start.your_hand_size);
+            clue_put_u8(writer, start.num_players);
+            int16_t previous = 0;
+            for (int i = 0; i < start.your_hand_size; i++) {
+                clue_put_zigzag(writer, start.your_hand[i] - previous);
+                previous = start.your_hand[i];
+            }
+            clue_put_bytes(writer, start.player_order, start.num_players);
+            for (int i = 0; i < start.num_players; i++) {
+                clue_put_varint(writer, start.player_hand_sizes[i]);
+            }
+            const char* cursor = start.names;
+            int8_t name_length;
+            for (int i = 0; i < start.num_players; i++) {
+                const char* name = clue_name_next(&cursor, start.names_end, &name_length);
+                *ok = *ok && name;
+                clue_put_u8(writer, name ? name_length : 0);
+                clue_put_bytes(writer, name, name ? name_length : 0);
+            }
+        }
+    } else if (type == FRAME_TYPE_TURN) {
+        *ok = data_length >= (int32_t)sizeof(TurnFrame_t);
+        if (*ok) {
+            clue_put_u8(writer, ((const TurnFrame_t*)data)->player_id);
+        }
+    } else if (type == FRAME_TYPE_TURN_RESPONSE || type == FRAME_TYPE_SOLVE_ATTEMPT) {
+        *ok = data_length == cards_length;
+        if (*ok) {
+            clue_put_cards(writer, compact, (const int16_t*)data);
+        }
+    } else if (type == FRAME_TYPE_QUERY || type == FRAME_TYPE_SOLVE_RESULT) {
+        // Both are two bytes and then the cards
+        *ok = data_length == 2 + cards_length;
+        if (*ok) {
+            clue_put_u8(writer, data[0]);
+            if (type == FRAME_TYPE_SOLVE_RESULT) {
+                clue_put_u8(writer, data[1]);
+            }
+            clue_put_cards(writer, compact, (const int16_t*)(data + 2));
+        }
+    } else if (type == FRAME_TYPE_QUERY_RESPONSE) {
+        *ok = data_length >= (int32_t)sizeof(QueryResponseFrame_t);
+        if (*ok) {
+            clue_put_zigzag(writer, ((const QueryResponseFrame_t*)data)->card_id);
+        }
+    } else if (type == FRAME_TYPE_QUERY_RETURN) {
+        *ok = data_length >= (int32_t)sizeof(QueryAnouncementFrame_t);
+        if (*ok) {
+            const QueryAnouncementFrame_t* announcement = (const QueryAnouncementFrame_t*)data;
+            clue_put_u8(writer, announcement->player_id);
+            clue_put_zigzag(writer, announcement->card_id);
+        }
+    } else if (type == FRAME_TYPE_GAME_OVER) {
+        *ok = data_length >= (int32_t)sizeof(GameOverFrame_t);
+        if (*ok) {
+            const GameOverFrame_t* game_over = (const GameOverFrame_t*)data;
+            clue_put_u8(writer, game_over->winner);
+            clue_put_varint(writer, game_over->games_left);
+        }
+    } else {
+        clue_put_bytes(writer, data, data_length);
+    }
+}
+
+// A whole v2 frame from the data of a v1 one. Returns the length of the frame and only writes if it
+// fits, like the clue_encode_* functions. -1 if the v1 data doesn't hold up or type is over 15
+static inline int32_t clue_compact_encode(const ClueCompact_t* compact, char* out, int32_t size, int8_t type, const void* data, int32_t data_length) {
+    if (type < 0 || type > 15) {
+        return -1;
+    }
+    ClueWriter_t measure = { NULL, 0, 0 };
+    int ok;
+    clue_compact_put_data(&measure, compact, type, data, data_length, &ok);
+    if (!ok) {
+        return -1;
+    }
+    ClueWriter_t writer = { out, size, 0 };
+    clue_put_varint(&writer, (uint32_t)measure.length << 4 | type);
+    int32_t length = writer.length + measure.length;
+    if (length <= size) {
+        clue_compact_put_data(&writer, compact, type, data, data_length, &ok);
+    }
+    return length;
+}
+
+// The data of the v1 frame a v2 frame stands for. Returns its length and only writes if it fits,
+// -1 if the v2 data doesn't hold up
+static inline int32_t clue_compact_decode(const ClueCompact_t* compact, char* out, int32_t size, int8_t type, const char* data, int32_t data_length) {
+    ClueReader_t reader = { data, data + data_length, 0 };
+    ClueWriter_t writer = { out, size, 0 };
+    if (type == FRAME_TYPE_ERROR || type == FRAME_TYPE_ABORT) {
+        int32_t length = clue_get_varint(&reader);
+        const char* text = clue_get_bytes(&reader, length);
+        clue_put_bytes(&writer, &length, sizeof(length));
+        clue_put_bytes(&writer, text, text ? length : 0);
+    } else if (type == FRAME_TYPE_RULES) {
+        RulesFrame_t rules = {};
+        rules.player_id = clue_get_u8(&reader);
+        rules.num_categories = clue_get_u8(&reader);
+        int16_t num_cards_in_category[rules.num_categories > 0 ? rules.num_categories : 1];
+        int32_t num_cards = 0;
+        for (int i = 0; i < rules.num_categories; i++) {
+            num_cards_in_category[i] = clue_get_varint(&reader);
+            num_cards += num_cards_in_category[i];
+            reader.bad |= num_cards_in_category[i] < 0 || num_cards > 0x7FFF;
+        }
+        if (reader.bad || rules.num_categories < 0) {
+            return -1;
+        }
+        rules.num_cards = num_cards;
+        clue_put_bytes(&writer, &rules, sizeof(rules));
+        clue_put_bytes(&writer, num_cards_in_category, rules.num_categories * sizeof(int16_t));
+        for (int16_t i = 0; i < rules.num_cards; i++) {
+            clue_put_bytes(&writer, &i, sizeof(i));
+        }
+        for (int i = 0; i < rules.num_cards && !reader.bad; i++) {
+            int8_t name_length = clue_get_u8(&reader);
+            const char* name = clue_get_bytes(&reader, name_length);
+            clue_put_u8(&writer, name_length);
+            clue_put_bytes(&writer, name, name ? name_length : 0);
+        }
+    } else if (type == FRAME_TYPE_START) {
+        StartFrame_t start = {};
+        start.your_hand_size = clue_get_varint(&reader);
+        start.num_players = clue_get_u8(&reader);
+        if (reader.bad || start.your_hand_size < 0 || start.num_players < 0) {
+            return -1;
+        }
+        clue_put_bytes(&writer, &start, sizeof(start));
+        int16_t card = 0;
+        for (int i = 0; i < start.your_hand_size && !reader.bad; i++) {
+            card += clue_get_zigzag(&reader);
+            clue_put_bytes(&writer, &card, sizeof(card));
+        }
+        const char* order = clue_get_bytes(&reader, start.num_players);
+        clue_put_bytes(&writer, order, order ? start.num_players : 0);
+        for (int i = 0; i < start.num_players && !reader.bad; i++) {
+            int16_t hand_size = clue_get_varint(&reader);
+            clue_put_bytes(&writer, &hand_size, sizeof(hand_size));
+        }
+        for (int i = 0; i < start.num_players && !reader.bad; i++) {
+            int8_t name_length = clue_get_u8(&reader);
+            const char* name = clue_get_bytes(&reader, name_length);
+            clue_put_u8(&writer, name_length);
+            clue_put_bytes(&writer, name, name ? name_length : 0);
+        }
+    } else if (type == FRAME_TYPE_TURN) {
+        clue_put_u8(&writer, clue_get_u8(&reader));
+    } else if (type == FRAME_TYPE_TURN_RESPONSE || type == FRAME_TYPE_SOLVE_ATTEMPT) {
+        clue_get_cards(&reader, compact, &writer);
+    } else if (type == FRAME_TYPE_QUERY || type == FRAME_TYPE_SOLVE_RESULT) {
+        clue_put_u8(&writer, clue_get_u8(&reader));
+        clue_put_u8(&writer, type == FRAME_TYPE_SOLVE_RESULT ? clue_get_u8(&reader) : 0);
+        clue_get_cards(&reader, compact, &writer);
+    } else if (type == FRAME_TYPE_QUERY_RESPONSE) {
+        QueryResponseFrame_t response = {};
+        response.card_id = clue_get_zigzag(&reader);
+        clue_put_bytes(&writer, &response, sizeof(response));
+    } else if (type == FRAME_TYPE_QUERY_RETURN) {
+        QueryAnouncementFrame_t announcement = {};
+        announcement.player_id = clue_get_u8(&reader);
+        announcement.card_id = clue_get_zigzag(&reader);
+        clue_put_bytes(&writer, &announcement, sizeof(announcement));
+    } else if (type == FRAME_TYPE_GAME_OVER) {
+        GameOverFrame_t game_over = {};
+        game_over.winner = clue_get_u8(&reader);
+        game_over.games_left = clue_get_varint(&reader);
+        clue_put_bytes(&writer, &game_over, sizeof(game_over));
+    } else {
+        clue_put_bytes(&writer, data, data_length);
+    }
+    return reader.bad ? -1 : writer.length;
+}
+
+// clue_stream_next for v2 headers. header gets the type and data_length as v1 would have them
+static inline int clue_stream_next_compact(ClueStream_t* stream, Frame_t* header, char** data, int32_t max_length) {
+    ClueReader_t reader = { stream->buffer + stream->start, stream->buffer + stream->end, 0 };
+    uint32_t value = clue_get_varint(&reader);
+    if (reader.bad) {
+        // Either the header isn't all here yet, or it runs on for longer than any header can
+        return stream->end - stream->start >= CLUE_COMPACT_MAX_HEADER ? -1 : 0;
+    }
+    header->type = value & 0xF;
+    header->data_length = value >> 4;
+    if (header->data_length > max_length) {
+        return -1;
+    }
+    if (reader.end - reader.cursor < header->data_length) {
+        return 0;
+    }
+    *data = (char*)reader.cursor;
+    stream->start = reader.cursor + header->data_length - stream->buffer;
+    if (stream->start == stream->end) {
+        stream->start = 0;
+        stream->end = 0;
+    }
+    return 1;
+}
+
+#endif
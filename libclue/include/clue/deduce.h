@@ -0,0 +1,64 @@
+#ifndef __clue_deduce_h__
+#define __clue_deduce_h__
+
+#include <stdint.h>
+
+#include "clue/frames.h"
+
+// Who holds what, worked out from the frames a player gets. Feed it every frame with
+// clue_deduce_frame and it keeps a bitset per player (plus one for the solution) of the cards they
+// might hold and the cards they definitely hold. After every frame the constraints are pushed to a
+// fixpoint:
+// - A card somebody definitely holds can't be anywhere else
+// - A card only one row can still hold is held by that row
+// - A player holds exactly their hand size, the solution exactly one card per category
+// - A show we only saw the back of means the shower holds at least one of the suggested cards
+// - A wrong solve attempt means the solution is not exactly those cards
+// All of it is word-at-a-time over the deck, so a frame costs microseconds even with big decks.
+
+#define CLUE_DEDUCE_SOLUTION -1 // Pass as the player to ask about the solution
+
+#define CLUE_DEDUCE_NO 0
+#define CLUE_DEDUCE_YES 1
+#define CLUE_DEDUCE_MAYBE 2
+
+typedef struct {
+    int8_t player_id; // Ours, from FRAME_TYPE_RULES
+    int8_t num_categories;
+    int16_t* num_cards_in_category;
+    int16_t num_cards;
+    int words; // uint64_t per row
+    uint64_t* category_bits; // Row per category
+    int num_players; // From FRAME_TYPE_START. Rows are player IDs, then the solution
+    int16_t* row_sizes; // Cards held per row, the solution's is num_categories
+    uint64_t* possible; // Row by row, the cards each might still hold
+    uint64_t* known; // Row by row, the cards each definitely holds
+    // Shows we only saw the back of: clause_players[i] holds at least one of clause_bits row i
+    int num_clauses;
+    int size_clauses;
+    int8_t* clause_players;
+    uint64_t* clause_bits;
+    // Wrong solve attempts, num_categories cards each
+    int num_misses;
+    int size_misses;
+    int16_t* misses;
+    int8_t turn_player; // Whose suggestion the QUERY_RETURN frames are about
+    int16_t* suggestion;
+    int inconsistent; // Somebody lied or a frame got lost, the tables mean nothing anymore
+} ClueDeduce_t;
+
+ClueDeduce_t* clue_deduce_new();
+void clue_deduce_free(ClueDeduce_t* deduce);
+// FRAME_TYPE_RULES sets up the deck, FRAME_TYPE_START starts a fresh game, and TURN, QUERY,
+// QUERY_RETURN and SOLVE_RESULT are what we learn from. Anything else is ignored
+void clue_deduce_frame(ClueDeduce_t* deduce, int8_t type, const void* data, int32_t data_length);
+
+// Facts learned some other way. The game must have started
+void clue_deduce_has(ClueDeduce_t* deduce, int8_t player, int16_t card);
+void clue_deduce_lacks(ClueDeduce_t* deduce, int8_t player, int16_t card);
+void clue_deduce_one_of(ClueDeduce_t* deduce, int8_t player, const int16_t* cards, int num_cards);
+
+int clue_deduce_holds(const ClueDeduce_t* deduce, int8_t player, int16_t card); // CLUE_DEDUCE_YES/NO/MAYBE
+int clue_deduce_solution(const ClueDeduce_t* deduce, int16_t* cards); // Per category, -1 if not pinned down yet. Returns how many are
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef __clue_engine_h__
+#define __clue_engine_h__
+
+#include <stdint.h>
+
+#include "clue/frames.h"
+#include "clue/rng.h"
+
+// The rules of Clue without any networking. A game is a state machine: it tells you who it is
+// waiting on, you hand it that player's frame, and it sends out whatever frames result through
+// the callbacks in ClueIO_t. The server drives it from sockets, but it is just as happy being
+// driven by bots living in the same process (see clue_game_play).
+
+typedef struct {
+    int8_t num_categories;
+    int16_t* num_cards; // Per category
+    int16_t total_cards;
+    char** card_names; // Indexed by card ID. Can be NULL if nobody cares
+} ClueRules_t;
+
+typedef struct {
+    int8_t id;
+    int eliminated;
+    int forfeited; // Ran out of time. Also eliminated, and the engine shows cards for them
+    int auto_show; // The engine shows for them when they hold just one of the suggested cards
+    int8_t name_length;
+    const char* name; // Not owned by the game
+    int16_t hand_size;
+    int16_t* hand; // Sorted
+    uint64_t* hand_bits; // Bit per card ID, for clue_player_has_card
+} CluePlayer_t;
+
+#define CLUE_EVERYONE -1 // Send to every player
+
+#define CLUE_EVENT_SOLUTION 0 // cards
+#define CLUE_EVENT_HAND 1 // player, cards
+#define CLUE_EVENT_TURN 2 // player
+#define CLUE_EVENT_SUGGESTION 3 // player, cards
+#define CLUE_EVENT_ILLEGAL_SUGGESTION 4 // player, cards
+#define CLUE_EVENT_QUERY 5 // player is obligated to show
+#define CLUE_EVENT_PASS 6 // player
+#define CLUE_EVENT_SHOW 7 // player, cards (the one shown)
+#define CLUE_EVENT_CHEAT 8 // player, cards (the one they tried to show)
+#define CLUE_EVENT_SOLVE_ATTEMPT 9 // player, cards, correct
+#define CLUE_EVENT_ERROR 10 // player, reason. The player was sent FRAME_TYPE_ERROR
+#define CLUE_EVENT_BAD_FRAME 11 // player, frame_type
+#define CLUE_EVENT_OVER 12 // reason, aborted, player is the winner or -1
+#define CLUE_EVENT_FORFEIT 13 // player ran out of time and is out of the game
+
+// Something that happened in the game, for anyone who wants to narrate or record it
+typedef struct {
+    int type;
+    int8_t player;
+    int8_t correct;
+    int8_t frame_type;
+    int8_t aborted; // For CLUE_EVENT_OVER, 1 if it ended with FRAME_TYPE_ABORT
+    int16_t num_cards;
+    const int16_t* cards;
+    const char* reason;
+} ClueEvent_t;
+
+typedef struct {
+    void* ctx;
+    // Send a frame to player_id, or to everyone if player_id is CLUE_EVERYONE
+    void (*send)(void* ctx, int player_id, int8_t type, const void* data, int32_t data_length);
+    // Optional. Send the same frame to each of player_ids, so it can be encoded once and shared. If
+    // NULL, send is called once per player instead
+    void (*multicast)(void* ctx, const int8_t* player_ids, int num_player_ids, int8_t type, const void* data, int32_t data_length);
+    // Optional, called for every ClueEvent_t
+    void (*event)(void* ctx, const ClueEvent_t* event);
+} ClueIO_t;
+
+#define CLUE_STATE_NEW 0 // Players can still be named
+#define CLUE_STATE_TURN 1 // Waiting on FRAME_TYPE_TURN_RESPONSE or FRAME_TYPE_SOLVE_ATTEMPT
+#define CLUE_STATE_QUERY 2 // Waiting on FRAME_TYPE_QUERY_RESPONSE
+#define CLUE_STATE_OVER 3
+
+typedef struct {
+    const ClueRules_t* rules;
+    ClueIO_t io;
+    int state;
+    int num_players;
+    CluePlayer_t* players; // Indexed by player ID. The arrays below and the hands live in the same allocation
+    int8_t* order; // Seat -> player ID
+    int8_t* seats; // Player ID -> seat
+    int8_t* owner; // Card ID -> player ID holding it, -1 for the solution
+    int16_t* solution;
+    int16_t* suggestion;
+    int16_t* deck; // Scratch for clue_game_start, total_cards long
+    int turn_idx; // Seat of the player whose turn it is
+    int query_idx; // Seat of the player who has to show
+    int moves; // Goes up every time the game starts waiting on someone new
+    int8_t winner; // -1 if nobody won (yet)
+    int16_t games_left; // Games left in the series after this one. If not 0, a normal finish sends FRAME_TYPE_GAME_OVER instead of FRAME_TYPE_ABORT
+    int aborted; // 1 if the game ended with FRAME_TYPE_ABORT
+    const char* over_reason;
+    uint64_t seed; // The deal and seating follow from this and nothing else, see clue_game_seed
+    ClueRng_t rng; // Seeded from seed by clue_game_start
+} ClueGame_t;
+
+ClueGame_t* clue_game_new(const ClueRules_t* rules, int num_players, ClueIO_t io); // Player IDs are 0 to num_players - 1
+void clue_game_set_name(ClueGame_t* game, int8_t player_id, const char* name, int8_t name_length);
+void clue_game_set_auto_show(ClueGame_t* game, int8_t player_id, int auto_show); // Skip asking them when there is only one card they could show
+void clue_game_seed(ClueGame_t* game, uint64_t seed); // Replay a deal: same rules, player count and seed deal the same hands and seating
+void clue_game_start(ClueGame_t* game); // Deal, send FRAME_TYPE_START and the first turn
+int clue_game_waiting_on(ClueGame_t* game); // Player ID the game needs a frame from, -1 if over
+void clue_game_submit(ClueGame_t* game, int8_t player_id, int8_t type, const void* data, int32_t data_length); // A frame from a player
+void clue_game_timeout(ClueGame_t* game); // The player we are waiting on is not going to answer
+void clue_game_forfeit(ClueGame_t* game); // Same, but only that player is out. Their turns are skipped and the engine shows cards for them
+void clue_game_abort(ClueGame_t* game, const char* reason); // Send FRAME_TYPE_ABORT to everyone and end the game
+void clue_game_free(ClueGame_t* game);
+int clue_player_has_card(const CluePlayer_t* player, int16_t card); // Card must be a real card ID, and the game must have started
+uint64_t clue_seed(); // A fresh seed, different on every call from any thread
+
+// The whole RULES frame every player gets on connect, header included (see clue/codec.h).
+// player_id is left 0 for the caller to fill in
+char* clue_rules_frame(const ClueRules_t* rules, int* frame_len);
+
+// In-process bots. They get exactly the frames a networked client would, and answer with the
+// same payloads a networked client would send
+typedef struct {
+    void* ctx;
+    // Every frame the server would have sent this bot
+    void (*frame)(void* ctx, int8_t type, const void* data, int32_t data_length);
+    // Fill in num_categories cards and return FRAME_TYPE_TURN_RESPONSE, or FRAME_TYPE_SOLVE_ATTEMPT
+    // (SolveAttemptFrame_t has the same layout)
+    int8_t (*turn)(void* ctx, TurnResponseFrame_t* response);
+    // Only called when the bot holds at least one of the suggested cards
+    void (*query)(void* ctx, const QueryFrame_t* query, QueryResponseFrame_t* response);
+    // Optional, called before every game with a seed that follows from the game's. A bot that
+    // takes all its randomness from here plays a replayed game the same way again
+    void (*seed)(void* ctx, uint64_t seed);
+    void (*free)(void* ctx);
+} ClueBot_t;
+
+// Play the game to the end with bots[player_id] for every player. Frames go to the bots instead of
+// io.send, events still go to io.event
+void clue_game_play(ClueGame_t* game, ClueBot_t* bots);
+
+// Bots that ship with the library
+ClueBot_t clue_bot_randy(); // Plays randomly, same as clients/randy
+ClueBot_t clue_bot_sleuth(); // Keeps a clue/deduce.h notebook and only guesses once it is sure
+
+#endif
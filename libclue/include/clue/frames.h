@@ -1,5 +1,3 @@
-// Copied on 12/30/25
-
 #ifndef __frames_h__
 #define __frames_h__
 
@@ -31,12 +29,23 @@ typedef struct {
 } AbortFrame_t;
 
 #define FRAME_TYPE_CONNECT 2
-// The first frame a client sends to the server. It has the name of the client.
+// The first frame a client sends to the server. It has the name of the client, and may be followed
+// by one more byte, the protocol version the client wants to speak from then on. Without it the
+// client gets CLUE_PROTOCOL_V1. This frame itself is always v1. After the version there may be a
+// byte of CLUE_CONNECT_* flags.
 typedef struct {
     int8_t name_length;
     char name[0];
 } ConnectFrame_t;
 
+#define CLUE_PROTOCOL_V1 1 // The structs in this file, in the server's byte order
+#define CLUE_PROTOCOL_V2 2 // Varints and packed cards, see clue/compact.h
+
+// The server answers FRAME_TYPE_QUERY for this client whenever it holds exactly one of the
+// suggested cards, since it could only ever show that one. The QUERY still goes out, but the client
+// must not answer it
+#define CLUE_CONNECT_AUTO_SHOW 1
+
 #define FRAME_TYPE_RULES 3
 // The frame sent back by the server when a client is allowed to connect. It has the rules
 // of this particular game which allows to client to set up any data structures it needs.
@@ -122,4 +131,19 @@ typedef struct {
     int16_t cards[0]; // Length <num_categories> from FRAME_TYPE_RULES
 } SolveResultFrame_t;
 
+#define FRAME_TYPE_GAME_OVER 12
+// Sent by the server to all players between the games of a series instead of FRAME_TYPE_ABORT.
+// The next game starts with FRAME_TYPE_START, there is no new FRAME_TYPE_RULES and your player ID
+// stays the same. The last game of a series ends with FRAME_TYPE_ABORT as usual.
+typedef struct {
+    int8_t winner; // Player ID, -1 if everyone was eliminated
+    int8_t _reserved;
+    int16_t games_left; // How many more games will be played after this one
+} GameOverFrame_t;
+
+#define FRAME_TYPE_SHM_ATTACH 13
+// Only over the server's Unix socket, as the very first frame from a client, and with no data. The
+// server answers with the same frame, carrying a shared memory segment and an eventfd as
+// SCM_RIGHTS, and every frame after that goes through shared memory. See clue/shm.h.
+
 #endif
\ No newline at end of file
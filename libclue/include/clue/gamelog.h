@@ -0,0 +1,112 @@
+#ifndef __clue_gamelog_h__
+#define __clue_gamelog_h__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "clue/engine.h"
+
+// Binary record of every ClueEvent_t, for analyzing more games than anyone could read. The file is
+// a ClueGameLogFileHeader_t, then one block per game: a ClueGameLogHeader_t followed by its
+// num_records fixed-width records. Games are buffered in memory and written CLUE_GAMELOG_BATCH bytes
+// at a time, each batch with one pwrite at a place claimed with an atomic add, so any number of
+// threads can share one file without locking, and nothing touches the disk mid-game. Reading maps
+// the whole file and hops from game header to game header, so a torn last game (the server got
+// killed) is simply left out.
+
+#define CLUE_GAMELOG_MAGIC 0x474F4C45554C43ULL // "CLUELOG" and the version byte
+#define CLUE_GAMELOG_VERSION 2
+#define CLUE_GAMELOG_GAME_MAGIC 0x454D4147 // "GAME", checked on every hop
+#define CLUE_GAMELOG_MORE 127 // Record type for cards that didn't fit in the record before
+#define CLUE_GAMELOG_CARDS 5 // Cards per record
+#define CLUE_GAMELOG_BATCH (64 * 1024) // Finished games wait until there is this much to write
+
+typedef struct {
+    uint64_t magic; // CLUE_GAMELOG_MAGIC | CLUE_GAMELOG_VERSION << 56
+    int32_t header_length; // This header and num_cards, rounded up to 16 bytes
+    int16_t record_length; // sizeof(ClueGameLogRecord_t)
+    int8_t num_categories;
+    int8_t _reserved;
+    int16_t num_cards[0]; // Per category
+} ClueGameLogFileHeader_t;
+
+typedef struct {
+    int32_t magic; // CLUE_GAMELOG_GAME_MAGIC
+    int32_t num_records;
+    uint64_t game_id; // Server game ID, or the game's number when headless
+    int64_t end_time; // Wall clock milliseconds when it ended
+    uint64_t seed; // ClueGame_t.seed, clue_game_seed with this deals the same game again
+    int16_t series_idx; // Which game of the series this was
+    int8_t num_players;
+    int8_t winner; // -1 if nobody won
+    int8_t aborted;
+    int8_t _reserved[3];
+} ClueGameLogHeader_t;
+
+// One ClueEvent_t. Events with more than CLUE_GAMELOG_CARDS cards carry on in CLUE_GAMELOG_MORE
+// records right after, see clue_gamelog_cards
+typedef struct {
+    int8_t type; // CLUE_EVENT_* or CLUE_GAMELOG_MORE
+    int8_t player; // -1 if none
+    int8_t extra; // correct for CLUE_EVENT_SOLVE_ATTEMPT, frame_type for CLUE_EVENT_BAD_FRAME
+    int8_t _reserved;
+    int16_t num_cards; // For the whole event, or in this record for CLUE_GAMELOG_MORE
+    int16_t cards[CLUE_GAMELOG_CARDS];
+} ClueGameLogRecord_t;
+
+typedef struct {
+    int fd;
+    atomic_llong offset; // Where the next game goes
+} ClueGameLog_t;
+
+// One per thread that runs games, reused from game to game so logging doesn't allocate
+typedef struct {
+    ClueGameLog_t* log; // NULL if not logging
+    int playing; // Between clue_gamelog_begin and CLUE_EVENT_OVER
+    char* data; // Finished games, then the one being played
+    size_t length;
+    size_t size;
+    size_t game_start; // Where the header of the one being played is
+} ClueGameLogBuffer_t;
+
+// Appends to path if it is a log of the same rules, creates it otherwise. NULL on failure
+ClueGameLog_t* clue_gamelog_open(const char* path, const ClueRules_t* rules);
+void clue_gamelog_close(ClueGameLog_t* log);
+void clue_gamelog_begin(ClueGameLogBuffer_t* buffer, ClueGameLog_t* log, uint64_t game_id, int16_t series_idx, int8_t num_players, uint64_t seed);
+void clue_gamelog_event(ClueGameLogBuffer_t* buffer, const ClueEvent_t* event); // CLUE_EVENT_OVER finishes the game
+void clue_gamelog_flush(ClueGameLogBuffer_t* buffer); // Write out the finished games now
+void clue_gamelog_take(ClueGameLogBuffer_t* buffer, ClueGameLogBuffer_t* from); // Move from's finished games to the end of buffer, for another thread to write
+void clue_gamelog_buffer_free(ClueGameLogBuffer_t* buffer); // Flushes first
+
+typedef struct {
+    const char* data;
+    size_t length;
+    const ClueGameLogFileHeader_t* header;
+    int64_t num_games;
+    const ClueGameLogHeader_t** games; // Index, in the order they ended
+} ClueGameLogMap_t;
+
+// NULL if the file can't be mapped or isn't a game log
+ClueGameLogMap_t* clue_gamelog_map(const char* path);
+void clue_gamelog_unmap(ClueGameLogMap_t* map);
+
+static inline const ClueGameLogRecord_t* clue_gamelog_records(const ClueGameLogHeader_t* game) {
+    return (const ClueGameLogRecord_t*)(game + 1);
+}
+
+// Gathers the cards of the event starting at records[idx], which must have room for
+// records[idx].num_cards of them. Returns the index of the next event
+static inline int clue_gamelog_cards(const ClueGameLogRecord_t* records, int idx, int16_t* cards) {
+    int num_cards = records[idx].num_cards;
+    int next = idx;
+    for (int i = 0; i < num_cards; i++) {
+        if (i % CLUE_GAMELOG_CARDS == 0) {
+            next++;
+        }
+        cards[i] = records[next - 1].cards[i % CLUE_GAMELOG_CARDS];
+    }
+    return next > idx ? next : idx + 1;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef __clue_rng_h__
+#define __clue_rng_h__
+
+#include <stdint.h>
+
+// xoshiro256** (Blackman and Vigna). Header-only, and the state is plain data, so every thread
+// keeps its own. clue_rng_jump skips 2^128 numbers ahead, which gives each thread a stream that
+// can't run into anybody else's: seed once, then copy and jump once per thread.
+
+typedef struct {
+    uint64_t s[4];
+} ClueRng_t;
+
+static inline uint64_t clue_rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// splitmix64 spreads the seed out so that seeds 1, 2, 3... still give unrelated streams
+static inline void clue_rng_seed(ClueRng_t* rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        seed += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        rng->s[i] = z ^ (z >> 31);
+    }
+}
+
+// The seed of stream number idx of seed, for handing out related but unrelated-looking seeds (a
+// game per index, a bot per player) that can all be worked out again from the one seed
+static inline uint64_t clue_rng_mix(uint64_t seed, uint64_t idx) {
+    uint64_t z = seed + (idx + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t clue_rng_next(ClueRng_t* rng) {
+    uint64_t* s = rng->s;
+    uint64_t result = clue_rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = clue_rng_rotl(s[3], 45);
+    return result;
+}
+
+// Uniform in [0, n) without the modulo bias, n must be at least 1 (Lemire's multiply and shift)
+static inline uint32_t clue_rng_below(ClueRng_t* rng, uint32_t n) {
+    uint64_t product = (clue_rng_next(rng) >> 32) * n;
+    if ((uint32_t)product < n) {
+        uint32_t threshold = -n % n;
+        while ((uint32_t)product < threshold) {
+            product = (clue_rng_next(rng) >> 32) * n;
+        }
+    }
+    return product >> 32;
+}
+
+// Uniform in [0, 1)
+static inline double clue_rng_double(ClueRng_t* rng) {
+    return (clue_rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+static inline void clue_rng_jump(ClueRng_t* rng) {
+    static const uint64_t jump[] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL, 0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+    uint64_t s[4] = {};
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                for (int j = 0; j < 4; j++) {
+                    s[j] ^= rng->s[j];
+                }
+            }
+            clue_rng_next(rng);
+        }
+    }
+    for (int j = 0; j < 4; j++) {
+        rng->s[j] = s[j];
+    }
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef __clue_sample_h__
+#define __clue_sample_h__
+
+#include <stdint.h>
+
+#include "clue/deduce.h"
+
+// Monte Carlo estimate of who holds what, for when clue/deduce.h can't pin the solution down. Each
+// thread deals one hand consistent with everything the ClueDeduce_t knows (hand sizes, known and
+// ruled out cards, shows we only saw the back of, wrong solve attempts), then keeps swapping pairs
+// and rotating triples of cards between players. Moves that break a show or a miss are taken now
+// and then so the walk can get between deals no single move connects, but only consistent deals
+// are ever counted: a sample that lands on a broken one is skipped. Nothing is dealt from scratch
+// and thrown away, no matter how few deals are left late in the game.
+
+typedef struct {
+    int num_threads; // 0 for one per core
+    int num_samples; // In total, split between the threads
+    int burn_in; // Swaps before the first sample, 0 for a default
+    int thin; // Swaps between samples, 0 for a default
+    uint64_t seed; // 0 for a fresh one
+} ClueSampleConfig_t;
+
+typedef struct {
+    int num_samples; // Consistent deals counted, usually a little under what was asked for. 0 if none could be found. Always 1 otherwise if exact
+    double num_deals; // If exact, how many consistent deals there are
+    int num_players;
+    int16_t num_cards;
+    int8_t num_categories;
+    double* solution; // By card, P(card is in the solution)
+    double* solution_low; // By card, 95% confidence bounds of the above
+    double* solution_high;
+    double* held; // [player * num_cards + card], P(player holds card)
+    int exact; // 1 if counted by clue_sample_exact, the bounds are then the probabilities themselves
+    int16_t* best; // The whole solution seen most often, or if exact the most likely one. One card per category, -1s if none
+    double best_probability; // How often it was seen, or how likely it is
+} ClueSample_t;
+
+// deduce is only read, and must not change until this returns
+ClueSample_t* clue_sample(const ClueDeduce_t* deduce, const ClueSampleConfig_t* config);
+// Exact instead: every solution that is still possible gets the number of deals consistent with it
+// counted, memoized on the cards left to deal, how many each player still takes and which shows are
+// accounted for. Standard Clue takes a few tens of milliseconds at most, most of it finding the most
+// likely whole solution. If more than max_states partial deals have to be remembered, this gives up
+// and returns clue_sample(deduce, fallback) instead
+ClueSample_t* clue_sample_exact(const ClueDeduce_t* deduce, int max_states, const ClueSampleConfig_t* fallback);
+void clue_sample_free(ClueSample_t* sample);
+
+#endif
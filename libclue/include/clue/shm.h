@@ -0,0 +1,236 @@
+#ifndef __clue_shm_h__
+#define __clue_shm_h__
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "clue/frames.h"
+
+// Frames through shared memory instead of a socket, for bots on the same machine as the server.
+// Linux only, header only like clue/codec.h.
+//
+// The bot connects to the server's Unix socket (server -u) and sends FRAME_TYPE_SHM_ATTACH. The
+// server answers with the same frame and two file descriptors: a ClueShm_t to map and an eventfd.
+// From then on every frame, CONNECT included, goes through the rings and the socket is only there
+// so each side notices when the other one dies. The bytes in the rings are exactly what would
+// have gone over the socket, so clue/codec.h works on them unchanged.
+//
+// Each ring has one writer and one reader, and neither makes a system call while the other is
+// keeping up. Whoever finds a ring empty (or full) raises the waiting flag and checks again before
+// going to sleep. Whoever moves head (or tail) checks the flag afterwards and only then wakes them
+// up: the bot by futex, the server by its eventfd, since the server waits in epoll
+
+#define CLUE_SHM_MAGIC 0x436C7565 // "Clue"
+#define CLUE_SHM_RING_SIZE (64 * 1024) // Power of 2
+#define CLUE_SHM_MAX_SPINS 16384 // Most clue_shm_wait ever spins before it sleeps
+#define CLUE_SHM_SLEEP_MS 100 // Longest a sleep lasts, to check the server is still there
+
+typedef struct {
+    _Alignas(64) atomic_uint head; // Bytes ever written. Only the writer moves it
+    atomic_uint reader_waiting; // Reader found the ring empty and wants to be woken
+    _Alignas(64) atomic_uint tail; // Bytes ever read. Only the reader moves it
+    atomic_uint writer_waiting; // Writer found the ring full and wants to be woken
+    _Alignas(64) char data[CLUE_SHM_RING_SIZE];
+} ClueShmRing_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t ring_size;
+    atomic_uint closed; // Set by the server when it is done with the bot
+    ClueShmRing_t to_server;
+    ClueShmRing_t to_client;
+} ClueShm_t;
+
+// ---- Rings ----
+
+// Copy in as much of parts as there is room for. Returns how many bytes that was
+static inline uint32_t clue_shm_write(ClueShmRing_t* ring, const struct iovec* parts, int num_parts) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t room = CLUE_SHM_RING_SIZE - (head - atomic_load_explicit(&ring->tail, memory_order_acquire));
+    uint32_t written = 0;
+    for (int i = 0; i < num_parts && room > 0; i++) {
+        uint32_t length = parts[i].iov_len < room ? parts[i].iov_len : room;
+        uint32_t pos = (head + written) % CLUE_SHM_RING_SIZE;
+        uint32_t first = CLUE_SHM_RING_SIZE - pos < length ? CLUE_SHM_RING_SIZE - pos : length;
+        memcpy(ring->data + pos, parts[i].iov_base, first);
+        memcpy(ring->data, (char*)parts[i].iov_base + first, length - first);
+        written += length;
+        room -= length;
+    }
+    atomic_store_explicit(&ring->head, head + written, memory_order_release);
+    return written;
+}
+
+// Copy out up to length bytes. Returns how many there were
+static inline uint32_t clue_shm_read(ClueShmRing_t* ring, void* buffer, uint32_t length) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t available = atomic_load_explicit(&ring->head, memory_order_acquire) - tail;
+    if (length > available) {
+        length = available;
+    }
+    uint32_t pos = tail % CLUE_SHM_RING_SIZE;
+    uint32_t first = CLUE_SHM_RING_SIZE - pos < length ? CLUE_SHM_RING_SIZE - pos : length;
+    memcpy(buffer, ring->data + pos, first);
+    memcpy((char*)buffer + first, ring->data, length - first);
+    atomic_store_explicit(&ring->tail, tail + length, memory_order_release);
+    return length;
+}
+
+// Raise a waiting flag before the last look at the ring. If that look finds something after all,
+// take it back with clue_shm_woken
+static inline void clue_shm_want_wake(atomic_uint* waiting) {
+    atomic_store(waiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+// After moving head or tail: 1 if the other side asked to be woken. Only one caller gets the 1
+static inline int clue_shm_woken(atomic_uint* waiting) {
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(waiting, memory_order_relaxed) && atomic_exchange(waiting, 0);
+}
+
+static inline void clue_shm_futex_wake(atomic_uint* word) {
+    // Not FUTEX_PRIVATE_FLAG, the word is shared with another process
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+// Wait for *word to change from seen: spin up to *spins times, then sleep on the futex with waiting
+// raised. Spinning that pays off earns more spins next time, and spinning that doesn't gets cut
+// back, down to none at all on a single core where it only keeps the server off the CPU. Gives up
+// after CLUE_SHM_SLEEP_MS so the caller can check nobody died. Returns 1 if it changed
+static inline int clue_shm_wait(atomic_uint* word, uint32_t seen, atomic_uint* waiting, int* spins) {
+    for (int i = 0; i < *spins; i++) {
+        if (atomic_load_explicit(word, memory_order_acquire) != seen) {
+            *spins = *spins * 2 < CLUE_SHM_MAX_SPINS ? *spins * 2 : CLUE_SHM_MAX_SPINS;
+            return 1;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    if (*spins > 0) {
+        *spins /= 2;
+    }
+    clue_shm_want_wake(waiting);
+    if (atomic_load(word) == seen) {
+        struct timespec timeout = { 0, CLUE_SHM_SLEEP_MS * 1000000 };
+        syscall(SYS_futex, word, FUTEX_WAIT, seen, &timeout, NULL, 0);
+    }
+    atomic_store(waiting, 0);
+    return atomic_load_explicit(word, memory_order_acquire) != seen;
+}
+
+// ---- Bot side ----
+
+typedef struct {
+    ClueShm_t* shm;
+    int sock; // The Unix socket, only watched for the server going away
+    int doorbell; // The server's eventfd
+    int spins; // How long to spin before sleeping, see clue_shm_wait
+} ClueShmClient_t;
+
+// Swap a freshly connected Unix socket over to shared memory. Returns 0 and fills in client, or -1
+static inline int clue_shm_attach(ClueShmClient_t* client, int sock) {
+    Frame_t attach = {};
+    attach.type = FRAME_TYPE_SHM_ATTACH;
+    if (send(sock, &attach, sizeof(attach), 0) != sizeof(attach)) {
+        return -1;
+    }
+
+    // The answer carries the memory and the doorbell
+    Frame_t answer;
+    struct iovec part = { &answer, sizeof(answer) };
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(sock, &message, MSG_WAITALL) != sizeof(answer) || answer.type != FRAME_TYPE_SHM_ATTACH) {
+        return -1;
+    }
+    struct cmsghdr* fds = CMSG_FIRSTHDR(&message);
+    if (fds == NULL || fds->cmsg_type != SCM_RIGHTS || fds->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        return -1;
+    }
+    int memory_fd;
+    memcpy(&memory_fd, CMSG_DATA(fds), sizeof(int));
+    memcpy(&client->doorbell, CMSG_DATA(fds) + sizeof(int), sizeof(int));
+    client->shm = mmap(NULL, sizeof(ClueShm_t), PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    close(memory_fd);
+    if (client->shm == MAP_FAILED || client->shm->magic != CLUE_SHM_MAGIC || client->shm->ring_size != CLUE_SHM_RING_SIZE) {
+        close(client->doorbell);
+        return -1;
+    }
+    client->sock = sock;
+    client->spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? CLUE_SHM_MAX_SPINS / 16 : 0;
+    return 0;
+}
+
+static inline int clue_shm_gone(ClueShmClient_t* client) {
+    char byte;
+    return atomic_load(&client->shm->closed) || recv(client->sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+// Send bytes to the server, waiting for room if the ring is full. Returns 0 if the server is gone
+static inline int clue_shm_send(ClueShmClient_t* client, const void* data, uint32_t length) {
+    ClueShmRing_t* ring = &client->shm->to_server;
+    while (length > 0) {
+        struct iovec part = { (void*)data, length };
+        uint32_t written = clue_shm_write(ring, &part, 1);
+        data = (const char*)data + written;
+        length -= written;
+        if (written > 0 && clue_shm_woken(&ring->reader_waiting)) {
+            uint64_t one = 1;
+            if (write(client->doorbell, &one, sizeof(one)) == -1) {
+                return 0;
+            }
+        }
+        // Full, so tail is a whole ring behind head until the server reads some
+        if (length > 0 && !clue_shm_wait(&ring->tail, atomic_load(&ring->head) - CLUE_SHM_RING_SIZE, &ring->writer_waiting, &client->spins) && clue_shm_gone(client)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Receive up to length bytes from the server, waiting until there is at least one. Returns 0 if the
+// server is gone
+static inline uint32_t clue_shm_recv(ClueShmClient_t* client, void* buffer, uint32_t length) {
+    ClueShmRing_t* ring = &client->shm->to_client;
+    while (1) {
+        uint32_t received = clue_shm_read(ring, buffer, length);
+        if (received > 0) {
+            if (clue_shm_woken(&ring->writer_waiting)) {
+                // The server had more for us than fit
+                uint64_t one = 1;
+                if (write(client->doorbell, &one, sizeof(one)) == -1) {
+                    return 0;
+                }
+            }
+            return received;
+        }
+        // Empty, so head is where tail is until the server writes some
+        if (!clue_shm_wait(&ring->head, atomic_load(&ring->tail), &ring->reader_waiting, &client->spins) && clue_shm_gone(client)) {
+            return 0;
+        }
+    }
+}
+
+static inline void clue_shm_detach(ClueShmClient_t* client) {
+    munmap(client->shm, sizeof(ClueShm_t));
+    close(client->doorbell);
+    close(client->sock);
+}
+
+#endif
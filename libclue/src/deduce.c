@@ -0,0 +1,478 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "clue/codec.h"
+#include "clue/deduce.h"
+
+static int deduce_row(const ClueDeduce_t* deduce, int8_t player); // Player ID or CLUE_DEDUCE_SOLUTION -> row
+static int deduce_valid(const ClueDeduce_t* deduce, int8_t player, int16_t card); // Game started, real player and card
+static void deduce_rules(ClueDeduce_t* deduce, const void* data, int32_t data_length);
+static void deduce_start(ClueDeduce_t* deduce, const void* data, int32_t data_length);
+static void deduce_add_clause(ClueDeduce_t* deduce, int8_t player, const int16_t* cards, int num_cards);
+static void deduce_add_miss(ClueDeduce_t* deduce, const int16_t* cards);
+static void deduce_propagate(ClueDeduce_t* deduce); // Apply every rule until nothing changes
+static int deduce_exclusive(ClueDeduce_t* deduce); // Cards held by one row are impossible elsewhere, cards only one row can hold are held by it
+static int deduce_counts(ClueDeduce_t* deduce); // Rows that have all their cards, or are down to exactly enough
+static int deduce_count_group(ClueDeduce_t* deduce, uint64_t* possible, uint64_t* known, const uint64_t* mask, int size);
+static int deduce_clauses(ClueDeduce_t* deduce); // Shows we only saw the back of
+static int deduce_misses(ClueDeduce_t* deduce); // Wrong solve attempts
+static int popcount_bits(const uint64_t* bits, const uint64_t* mask, int words); // Set bits in bits & mask, mask can be NULL
+
+#define BIT_WORD(card) ((card) / 64)
+#define BIT_MASK(card) (1ULL << ((card) % 64))
+
+ClueDeduce_t* clue_deduce_new() {
+    ClueDeduce_t* deduce = calloc(1, sizeof(ClueDeduce_t));
+    deduce->turn_player = -1;
+    return deduce;
+}
+
+void clue_deduce_free(ClueDeduce_t* deduce) {
+    free(deduce->num_cards_in_category);
+    free(deduce->category_bits);
+    free(deduce->row_sizes);
+    free(deduce->possible);
+    free(deduce->known);
+    free(deduce->clause_players);
+    free(deduce->clause_bits);
+    free(deduce->misses);
+    free(deduce->suggestion);
+    free(deduce);
+}
+
+void clue_deduce_frame(ClueDeduce_t* deduce, int8_t type, const void* data, int32_t data_length) {
+    if (type == FRAME_TYPE_RULES) {
+        deduce_rules(deduce, data, data_length);
+        return;
+    } else if (type == FRAME_TYPE_START) {
+        deduce_start(deduce, data, data_length);
+        return;
+    }
+    if (deduce->num_players == 0) {
+        // Nothing to learn about before the deal
+        return;
+    }
+    int suggestion_length = deduce->num_categories * sizeof(int16_t);
+    if (type == FRAME_TYPE_TURN && data_length >= (int32_t)sizeof(TurnFrame_t)) {
+        const TurnFrame_t* turn = data;
+        deduce->turn_player = turn->player_id;
+    } else if (type == FRAME_TYPE_QUERY && data_length >= (int32_t)sizeof(QueryFrame_t) + suggestion_length) {
+        // Same suggestion for every player asked, only the first one tells us something new
+        const QueryFrame_t* query = data;
+        memcpy(deduce->suggestion, query->suggestion, suggestion_length);
+    } else if (type == FRAME_TYPE_QUERY_RETURN && data_length >= (int32_t)sizeof(QueryAnouncementFrame_t)) {
+        const QueryAnouncementFrame_t* query_return = data;
+        if (query_return->card_id == -1) {
+            for (int i = 0; i < deduce->num_categories; i++) {
+                clue_deduce_lacks(deduce, query_return->player_id, deduce->suggestion[i]);
+            }
+        } else if (deduce->turn_player == deduce->player_id) {
+            // Our suggestion, so we got to see the card
+            clue_deduce_has(deduce, query_return->player_id, query_return->card_id);
+        } else {
+            clue_deduce_one_of(deduce, query_return->player_id, deduce->suggestion, deduce->num_categories);
+        }
+    } else if (type == FRAME_TYPE_SOLVE_RESULT && data_length >= (int32_t)sizeof(SolveResultFrame_t) + suggestion_length) {
+        const SolveResultFrame_t* result = data;
+        if (result->correct) {
+            for (int i = 0; i < deduce->num_categories; i++) {
+                clue_deduce_has(deduce, CLUE_DEDUCE_SOLUTION, result->cards[i]);
+            }
+        } else {
+            deduce_add_miss(deduce, result->cards);
+            deduce_propagate(deduce);
+        }
+    }
+}
+
+void clue_deduce_has(ClueDeduce_t* deduce, int8_t player, int16_t card) {
+    if (!deduce_valid(deduce, player, card)) {
+        return;
+    }
+    int row = deduce_row(deduce, player);
+    uint64_t* known = &deduce->known[row * deduce->words + BIT_WORD(card)];
+    if (*known & BIT_MASK(card)) {
+        return;
+    }
+    *known |= BIT_MASK(card);
+    deduce_propagate(deduce);
+}
+
+void clue_deduce_lacks(ClueDeduce_t* deduce, int8_t player, int16_t card) {
+    if (!deduce_valid(deduce, player, card)) {
+        return;
+    }
+    int row = deduce_row(deduce, player);
+    uint64_t* possible = &deduce->possible[row * deduce->words + BIT_WORD(card)];
+    if (!(*possible & BIT_MASK(card))) {
+        return;
+    }
+    *possible &= ~BIT_MASK(card);
+    deduce_propagate(deduce);
+}
+
+void clue_deduce_one_of(ClueDeduce_t* deduce, int8_t player, const int16_t* cards, int num_cards) {
+    for (int i = 0; i < num_cards; i++) {
+        if (!deduce_valid(deduce, player, cards[i])) {
+            return;
+        }
+    }
+    deduce_add_clause(deduce, player, cards, num_cards);
+    deduce_propagate(deduce);
+}
+
+int clue_deduce_holds(const ClueDeduce_t* deduce, int8_t player, int16_t card) {
+    if (!deduce_valid(deduce, player, card)) {
+        return CLUE_DEDUCE_MAYBE;
+    }
+    int idx = deduce_row(deduce, player) * deduce->words + BIT_WORD(card);
+    if (deduce->known[idx] & BIT_MASK(card)) {
+        return CLUE_DEDUCE_YES;
+    } else if (!(deduce->possible[idx] & BIT_MASK(card))) {
+        return CLUE_DEDUCE_NO;
+    }
+    return CLUE_DEDUCE_MAYBE;
+}
+
+int clue_deduce_solution(const ClueDeduce_t* deduce, int16_t* cards) {
+    int found = 0;
+    int16_t base_idx = 0;
+    const uint64_t* known = &deduce->known[deduce->num_players * deduce->words];
+    for (int i = 0; i < deduce->num_categories; i++) {
+        cards[i] = -1;
+        for (int16_t card = base_idx; deduce->num_players > 0 && card < base_idx + deduce->num_cards_in_category[i]; card++) {
+            if (known[BIT_WORD(card)] & BIT_MASK(card)) {
+                cards[i] = card;
+                found++;
+                break;
+            }
+        }
+        base_idx += deduce->num_cards_in_category[i];
+    }
+    return found;
+}
+
+static int deduce_row(const ClueDeduce_t* deduce, int8_t player) {
+    return player == CLUE_DEDUCE_SOLUTION ? deduce->num_players : player;
+}
+
+static int deduce_valid(const ClueDeduce_t* deduce, int8_t player, int16_t card) {
+    return deduce->num_players > 0 && player >= CLUE_DEDUCE_SOLUTION && player < deduce->num_players && card >= 0 && card < deduce->num_cards;
+}
+
+static void deduce_rules(ClueDeduce_t* deduce, const void* data, int32_t data_length) {
+    ClueRulesView_t rules;
+    if (!clue_rules_view(data, data_length, &rules)) {
+        return;
+    }
+    deduce->player_id = rules.player_id;
+    deduce->num_categories = rules.num_categories;
+    deduce->num_cards = rules.num_cards;
+    deduce->words = (rules.num_cards + 63) / 64;
+    deduce->num_cards_in_category = realloc(deduce->num_cards_in_category, rules.num_categories * sizeof(int16_t));
+    memcpy(deduce->num_cards_in_category, rules.num_cards_in_category, rules.num_categories * sizeof(int16_t));
+    deduce->suggestion = realloc(deduce->suggestion, rules.num_categories * sizeof(int16_t));
+
+    // Card IDs go category by category
+    deduce->category_bits = realloc(deduce->category_bits, rules.num_categories * deduce->words * sizeof(uint64_t));
+    memset(deduce->category_bits, 0, rules.num_categories * deduce->words * sizeof(uint64_t));
+    int16_t base_idx = 0;
+    for (int i = 0; i < rules.num_categories; i++) {
+        uint64_t* bits = &deduce->category_bits[i * deduce->words];
+        for (int16_t card = base_idx; card < base_idx + rules.num_cards_in_category[i] && card < rules.num_cards; card++) {
+            bits[BIT_WORD(card)] |= BIT_MASK(card);
+        }
+        base_idx += rules.num_cards_in_category[i];
+    }
+    deduce->num_players = 0; // Until the deal
+}
+
+static void deduce_start(ClueDeduce_t* deduce, const void* data, int32_t data_length) {
+    ClueStartView_t start;
+    if (deduce->words == 0 || !clue_start_view(data, data_length, &start)) {
+        return;
+    }
+    int num_players = start.num_players;
+    int num_rows = num_players + 1;
+    int words = deduce->words;
+    deduce->num_players = num_players;
+    deduce->row_sizes = realloc(deduce->row_sizes, num_rows * sizeof(int16_t));
+    for (int i = 0; i < num_players; i++) {
+        int8_t player = start.player_order[i];
+        if (player >= 0 && player < num_players) {
+            deduce->row_sizes[player] = start.player_hand_sizes[i];
+        }
+    }
+    deduce->row_sizes[num_players] = deduce->num_categories;
+
+    // Anyone might hold anything, except that the solution is one card per category
+    deduce->possible = realloc(deduce->possible, num_rows * words * sizeof(uint64_t));
+    deduce->known = realloc(deduce->known, num_rows * words * sizeof(uint64_t));
+    memset(deduce->known, 0, num_rows * words * sizeof(uint64_t));
+    for (int row = 0; row < num_rows; row++) {
+        for (int w = 0; w < words; w++) {
+            deduce->possible[row * words + w] = w == words - 1 && deduce->num_cards % 64 ? BIT_MASK(deduce->num_cards) - 1 : ~0ULL;
+        }
+    }
+    deduce->num_clauses = 0;
+    deduce->num_misses = 0;
+    deduce->turn_player = -1;
+    deduce->inconsistent = 0;
+
+    // We know our own hand exactly
+    if (deduce->player_id >= 0 && deduce->player_id < num_players) {
+        uint64_t* possible = &deduce->possible[deduce->player_id * words];
+        uint64_t* known = &deduce->known[deduce->player_id * words];
+        memset(possible, 0, words * sizeof(uint64_t));
+        for (int i = 0; i < start.your_hand_size; i++) {
+            int16_t card = start.your_hand[i];
+            if (card >= 0 && card < deduce->num_cards) {
+                possible[BIT_WORD(card)] |= BIT_MASK(card);
+                known[BIT_WORD(card)] |= BIT_MASK(card);
+            }
+        }
+    }
+    deduce_propagate(deduce);
+}
+
+static void deduce_add_clause(ClueDeduce_t* deduce, int8_t player, const int16_t* cards, int num_cards) {
+    int words = deduce->words;
+    if (deduce->num_clauses == deduce->size_clauses) {
+        deduce->size_clauses = deduce->size_clauses ? deduce->size_clauses * 2 : 16;
+        deduce->clause_players = realloc(deduce->clause_players, deduce->size_clauses * sizeof(int8_t));
+        deduce->clause_bits = realloc(deduce->clause_bits, deduce->size_clauses * words * sizeof(uint64_t));
+    }
+    uint64_t* bits = &deduce->clause_bits[deduce->num_clauses * words];
+    memset(bits, 0, words * sizeof(uint64_t));
+    for (int i = 0; i < num_cards; i++) {
+        bits[BIT_WORD(cards[i])] |= BIT_MASK(cards[i]);
+    }
+    deduce->clause_players[deduce->num_clauses] = player;
+    deduce->num_clauses++;
+}
+
+static void deduce_add_miss(ClueDeduce_t* deduce, const int16_t* cards) {
+    // Only an attempt with one card per category could have been the solution, the rest say nothing
+    int words = deduce->words;
+    for (int i = 0; i < deduce->num_categories; i++) {
+        const uint64_t* category = &deduce->category_bits[i * words];
+        int in_category = 0;
+        for (int j = 0; j < deduce->num_categories; j++) {
+            if (cards[j] >= 0 && cards[j] < deduce->num_cards && (category[BIT_WORD(cards[j])] & BIT_MASK(cards[j]))) {
+                in_category++;
+            }
+        }
+        if (in_category != 1) {
+            return;
+        }
+    }
+    // Somebody else already tried the same thing. Counting it twice would throw out the same deals
+    // twice in clue_sample_exact
+    for (int i = 0; i < deduce->num_misses; i++) {
+        const int16_t* miss = &deduce->misses[i * deduce->num_categories];
+        int same = 1;
+        for (int j = 0; j < deduce->num_categories && same; j++) {
+            same = 0;
+            for (int k = 0; k < deduce->num_categories; k++) {
+                same |= miss[k] == cards[j];
+            }
+        }
+        if (same) {
+            return;
+        }
+    }
+    if (deduce->num_misses == deduce->size_misses) {
+        deduce->size_misses = deduce->size_misses ? deduce->size_misses * 2 : 8;
+        deduce->misses = realloc(deduce->misses, deduce->size_misses * deduce->num_categories * sizeof(int16_t));
+    }
+    memcpy(&deduce->misses[deduce->num_misses * deduce->num_categories], cards, deduce->num_categories * sizeof(int16_t));
+    deduce->num_misses++;
+}
+
+static void deduce_propagate(ClueDeduce_t* deduce) {
+    int changed = 1;
+    while (changed && !deduce->inconsistent) {
+        changed = deduce_exclusive(deduce);
+        changed |= deduce_counts(deduce);
+        changed |= deduce_clauses(deduce);
+        changed |= deduce_misses(deduce);
+    }
+}
+
+static int deduce_exclusive(ClueDeduce_t* deduce) {
+    int changed = 0;
+    int words = deduce->words;
+    int num_rows = deduce->num_players + 1;
+    for (int w = 0; w < words; w++) {
+        uint64_t deck = w == words - 1 && deduce->num_cards % 64 ? BIT_MASK(deduce->num_cards) - 1 : ~0ULL;
+
+        // Known cards are off limits for everyone else
+        uint64_t known_once = 0;
+        uint64_t known_twice = 0;
+        for (int row = 0; row < num_rows; row++) {
+            uint64_t known = deduce->known[row * words + w];
+            known_twice |= known_once & known;
+            known_once |= known;
+        }
+        for (int row = 0; row < num_rows; row++) {
+            uint64_t* possible = &deduce->possible[row * words + w];
+            uint64_t narrowed = *possible & ~(known_once & ~deduce->known[row * words + w]);
+            if (narrowed != *possible) {
+                *possible = narrowed;
+                changed = 1;
+            }
+            if (deduce->known[row * words + w] & ~*possible) {
+                deduce->inconsistent = 1;
+            }
+        }
+
+        // Count the rows that might hold each card, saturating at two
+        uint64_t possible_once = 0;
+        uint64_t possible_twice = 0;
+        for (int row = 0; row < num_rows; row++) {
+            uint64_t possible = deduce->possible[row * words + w];
+            possible_twice |= possible_once & possible;
+            possible_once |= possible;
+        }
+        if (known_twice || (deck & ~possible_once)) {
+            deduce->inconsistent = 1;
+        }
+        uint64_t only_one = possible_once & ~possible_twice & ~known_once;
+        if (only_one) {
+            for (int row = 0; row < num_rows; row++) {
+                uint64_t* known = &deduce->known[row * words + w];
+                uint64_t found = only_one & deduce->possible[row * words + w];
+                if (found) {
+                    *known |= found;
+                    changed = 1;
+                }
+            }
+        }
+    }
+    return changed;
+}
+
+static int deduce_counts(ClueDeduce_t* deduce) {
+    int changed = 0;
+    int words = deduce->words;
+    for (int player = 0; player < deduce->num_players; player++) {
+        changed |= deduce_count_group(deduce, &deduce->possible[player * words], &deduce->known[player * words], NULL, deduce->row_sizes[player]);
+    }
+    // The solution holds one card of each category rather than any num_categories cards
+    int solution_row = deduce->num_players * words;
+    for (int i = 0; i < deduce->num_categories; i++) {
+        changed |= deduce_count_group(deduce, &deduce->possible[solution_row], &deduce->known[solution_row], &deduce->category_bits[i * words], 1);
+    }
+    return changed;
+}
+
+static int deduce_count_group(ClueDeduce_t* deduce, uint64_t* possible, uint64_t* known, const uint64_t* mask, int size) {
+    int words = deduce->words;
+    int num_known = popcount_bits(known, mask, words);
+    int num_possible = popcount_bits(possible, mask, words);
+    if (num_known > size || num_possible < size) {
+        deduce->inconsistent = 1;
+        return 0;
+    }
+    if (num_known == size && num_possible > size) {
+        // Got them all, nothing else can be in there
+        for (int w = 0; w < words; w++) {
+            uint64_t outside = mask ? ~mask[w] : 0;
+            possible[w] &= known[w] | outside;
+        }
+        return 1;
+    } else if (num_possible == size && num_known < size) {
+        // Whatever is left has to be it
+        for (int w = 0; w < words; w++) {
+            known[w] |= possible[w] & (mask ? mask[w] : ~0ULL);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static int deduce_clauses(ClueDeduce_t* deduce) {
+    int changed = 0;
+    int words = deduce->words;
+    for (int i = 0; i < deduce->num_clauses;) {
+        int row = deduce->clause_players[i];
+        uint64_t* bits = &deduce->clause_bits[i * words];
+        uint64_t* possible = &deduce->possible[row * words];
+        uint64_t* known = &deduce->known[row * words];
+        int satisfied = 0;
+        int left = 0;
+        for (int w = 0; w < words; w++) {
+            bits[w] &= possible[w];
+            if (bits[w] & known[w]) {
+                satisfied = 1;
+            }
+            left += __builtin_popcountll(bits[w]);
+        }
+        if (!satisfied && left == 0) {
+            deduce->inconsistent = 1;
+            return 0;
+        } else if (!satisfied && left == 1) {
+            // The only card they could have shown
+            for (int w = 0; w < words; w++) {
+                known[w] |= bits[w];
+            }
+            satisfied = 1;
+            changed = 1;
+        }
+        if (satisfied) {
+            // Done with it, swap the last one in
+            deduce->num_clauses--;
+            deduce->clause_players[i] = deduce->clause_players[deduce->num_clauses];
+            memcpy(bits, &deduce->clause_bits[deduce->num_clauses * words], words * sizeof(uint64_t));
+        } else {
+            i++;
+        }
+    }
+    return changed;
+}
+
+static int deduce_misses(ClueDeduce_t* deduce) {
+    int changed = 0;
+    int num_categories = deduce->num_categories;
+    int solution = deduce->num_players;
+    for (int i = 0; i < deduce->num_misses;) {
+        const int16_t* cards = &deduce->misses[i * num_categories];
+        int ruled_out = 0;
+        int num_known = 0;
+        int16_t unknown = -1;
+        for (int j = 0; j < num_categories; j++) {
+            int idx = solution * deduce->words + BIT_WORD(cards[j]);
+            if (!(deduce->possible[idx] & BIT_MASK(cards[j]))) {
+                ruled_out = 1;
+            } else if (deduce->known[idx] & BIT_MASK(cards[j])) {
+                num_known++;
+            } else {
+                unknown = cards[j];
+            }
+        }
+        if (!ruled_out && num_known == num_categories) {
+            deduce->inconsistent = 1;
+            return 0;
+        } else if (!ruled_out && num_known == num_categories - 1) {
+            // Everything else in the attempt was right, so this one can't be
+            deduce->possible[solution * deduce->words + BIT_WORD(unknown)] &= ~BIT_MASK(unknown);
+            ruled_out = 1;
+            changed = 1;
+        }
+        if (ruled_out) {
+            deduce->num_misses--;
+            memcpy((int16_t*)cards, &deduce->misses[deduce->num_misses * num_categories], num_categories * sizeof(int16_t));
+        } else {
+            i++;
+        }
+    }
+    return changed;
+}
+
+static int popcount_bits(const uint64_t* bits, const uint64_t* mask, int words) {
+    int count = 0;
+    for (int w = 0; w < words; w++) {
+        count += __builtin_popcountll(mask ? bits[w] & mask[w] : bits[w]);
+    }
+    return count;
+}
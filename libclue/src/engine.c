@@ -0,0 +1,613 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "clue/codec.h"
+#include "clue/engine.h"
+
+static void game_event(ClueGame_t* game, int type, int8_t player, const int16_t* cards, int16_t num_cards);
+static void game_multicast(ClueGame_t* game, const int8_t* player_ids, int num_player_ids, int8_t type, const void* data, int32_t data_length);
+static void game_error(ClueGame_t* game, int8_t player_id, const char* reason); // Send FRAME_TYPE_ERROR to one player
+static void game_over(ClueGame_t* game, const char* reason); // Send FRAME_TYPE_ABORT to everyone
+static void game_finished(ClueGame_t* game, const char* reason); // Normal end, the series might go on
+static void game_next_turn(ClueGame_t* game); // Move on to the next player who is still in
+static void game_next_query(ClueGame_t* game); // Go around asking players about the suggestion
+static void game_handle_turn(ClueGame_t* game, CluePlayer_t* player, int8_t type, const void* data, int32_t data_length);
+static void game_handle_query(ClueGame_t* game, CluePlayer_t* player, int8_t type, const void* data, int32_t data_length);
+static void game_show(ClueGame_t* game, CluePlayer_t* player, int16_t card); // Tell the suggester which card, everyone else that there was one
+static int16_t game_forced_card(ClueGame_t* game, CluePlayer_t* player); // What a forfeited player shows: the lowest suggested card they hold
+static int game_cards_held(ClueGame_t* game, CluePlayer_t* player); // How many of the suggested cards they hold
+static void shuffle(void* arr, int n, size_t size, ClueRng_t* rng); // Fisher-Yates shuffle
+static int check_suggestion(const ClueRules_t* rules, int16_t* suggestion); // Sorts it, then 1 if there is one card per category
+static int qsort_int16s(const void* left, const void* right);
+
+ClueGame_t* clue_game_new(const ClueRules_t* rules, int num_players, ClueIO_t io) {
+    assert(num_players > 0 && num_players <= 127); // Player IDs are int8_t
+    ClueGame_t* game = calloc(1, sizeof(ClueGame_t));
+    game->rules = rules;
+    game->io = io;
+    game->state = CLUE_STATE_NEW;
+    game->num_players = num_players;
+
+    // Everything that grows with the deck comes out of one block, so a deck of thousands of cards
+    // costs one allocation per game and nothing on the stack. Widest types first, so everything
+    // stays aligned. players comes first and owns the block
+    int total_cards = rules->total_cards;
+    int num_words = (total_cards + 63) / 64;
+    int hand_room = total_cards / num_players + 1; // Nobody gets dealt more than this
+    size_t size = num_players * sizeof(CluePlayer_t)
+        + (size_t)num_players * num_words * sizeof(uint64_t)
+        + ((size_t)num_players * hand_room + total_cards + 2 * rules->num_categories) * sizeof(int16_t)
+        + (2 * num_players + total_cards) * sizeof(int8_t);
+    char* block = calloc(1, size);
+    game->players = (CluePlayer_t*)block;
+    block += num_players * sizeof(CluePlayer_t);
+    uint64_t* hand_bits = (uint64_t*)block;
+    block += (size_t)num_players * num_words * sizeof(uint64_t);
+    int16_t* hands = (int16_t*)block;
+    block += (size_t)num_players * hand_room * sizeof(int16_t);
+    game->deck = (int16_t*)block;
+    block += total_cards * sizeof(int16_t);
+    game->solution = (int16_t*)block;
+    block += rules->num_categories * sizeof(int16_t);
+    game->suggestion = (int16_t*)block;
+    block += rules->num_categories * sizeof(int16_t);
+    game->order = (int8_t*)block;
+    game->seats = game->order + num_players;
+    game->owner = game->seats + num_players;
+    for (int i = 0; i < num_players; i++) {
+        game->players[i].id = i;
+        game->players[i].name = "";
+        game->players[i].hand = hands + (size_t)i * hand_room;
+        game->players[i].hand_bits = hand_bits + (size_t)i * num_words;
+        game->order[i] = i;
+    }
+    game->winner = -1;
+    game->seed = clue_seed();
+    return game;
+}
+
+void clue_game_set_name(ClueGame_t* game, int8_t player_id, const char* name, int8_t name_length) {
+    game->players[player_id].name = name;
+    game->players[player_id].name_length = name_length;
+}
+
+void clue_game_set_auto_show(ClueGame_t* game, int8_t player_id, int auto_show) {
+    game->players[player_id].auto_show = auto_show;
+}
+
+void clue_game_seed(ClueGame_t* game, uint64_t seed) {
+    assert(game->state == CLUE_STATE_NEW);
+    game->seed = seed;
+}
+
+void clue_game_start(ClueGame_t* game) {
+    const ClueRules_t* rules = game->rules;
+    int total_cards = rules->total_cards;
+    int num_players = game->num_players;
+    CluePlayer_t* players = game->players;
+    assert(rules->num_categories > 0);
+    assert(total_cards - rules->num_categories > 0);
+    clue_rng_seed(&game->rng, game->seed);
+
+    // Pick out the cards that are in the solution and put the rest in the deck
+    int16_t base_idx = 0;
+    int16_t* solution = game->solution;
+    int deck_len = 0;
+    int16_t* deck = game->deck;
+    for (int i = 0; i < rules->num_categories; i++) {
+        // Choose the solution for this card
+        solution[i] = base_idx + clue_rng_below(&game->rng, rules->num_cards[i]);
+
+        // Put the rest in the deck
+        for (int j = 0; j < rules->num_cards[i]; j++) {
+            if (base_idx + j == solution[i]) {
+                continue;
+            }
+            deck[deck_len++] = base_idx + j;
+        }
+
+        base_idx += rules->num_cards[i];
+    }
+    assert(deck_len == total_cards - rules->num_categories);
+    game_event(game, CLUE_EVENT_SOLUTION, -1, solution, rules->num_categories);
+
+    // Shuffle the deck and shuffle the player order
+    int num_words = (total_cards + 63) / 64;
+    shuffle(deck, deck_len, sizeof(int16_t), &game->rng);
+    shuffle(game->order, num_players, sizeof(int8_t), &game->rng);
+    for (int i = 0; i < num_players; i++) {
+        game->seats[game->order[i]] = i;
+        players[i].hand_size = 0;
+    }
+
+    // Deal the player hands. Nobody owns the solution
+    memset(game->owner, -1, total_cards * sizeof(int8_t));
+    int deal_idx = 0;
+    for (int i = 0; i < deck_len; i++) {
+        CluePlayer_t* player = &players[game->order[deal_idx]];
+        game->owner[deck[i]] = player->id;
+        player->hand_bits[deck[i] / 64] |= (uint64_t)1 << (deck[i] % 64);
+        deal_idx++;
+        deal_idx = deal_idx % num_players;
+    }
+
+    // Send everyone the game start frame which is personalized. Only the hand differs, so
+    // everything else is gathered up once and the frames all get encoded into the same buffer
+    int8_t name_lengths[num_players];
+    const char* names[num_players];
+    int16_t hand_sizes[num_players];
+    int max_hand_size = 0;
+    for (int i = 0; i < num_players; i++) {
+        CluePlayer_t* player = &players[game->order[i]];
+
+        // Reading the hand off the bits sorts it for free
+        for (int j = 0; j < num_words; j++) {
+            for (uint64_t bits = player->hand_bits[j]; bits; bits &= bits - 1) {
+                player->hand[player->hand_size++] = j * 64 + __builtin_ctzll(bits);
+            }
+        }
+        game_event(game, CLUE_EVENT_HAND, player->id, player->hand, player->hand_size);
+        name_lengths[i] = player->name_length;
+        names[i] = player->name;
+        hand_sizes[i] = player->hand_size;
+        if (player->hand_size > max_hand_size) {
+            max_hand_size = player->hand_size;
+        }
+    }
+    int start_size = clue_encode_start(NULL, 0, NULL, max_hand_size, num_players, game->order, hand_sizes, names, name_lengths);
+    char* start_frame = malloc(start_size);
+    for (int i = 0; i < num_players; i++) {
+        CluePlayer_t* player = &players[game->order[i]];
+        int length = clue_encode_start(start_frame, start_size, player->hand, player->hand_size, num_players, game->order, hand_sizes, names, name_lengths);
+        game->io.send(game->io.ctx, player->id, FRAME_TYPE_START, CLUE_PAYLOAD(start_frame), length - sizeof(Frame_t));
+    }
+    free(start_frame);
+
+    game->turn_idx = -1; // Since we index at the start
+    game_next_turn(game);
+}
+
+int clue_game_waiting_on(ClueGame_t* game) {
+    if (game->state == CLUE_STATE_TURN) {
+        return game->order[game->turn_idx];
+    } else if (game->state == CLUE_STATE_QUERY) {
+        return game->order[game->query_idx];
+    }
+    return -1;
+}
+
+void clue_game_submit(ClueGame_t* game, int8_t player_id, int8_t type, const void* data, int32_t data_length) {
+    if (game->state == CLUE_STATE_OVER) {
+        return;
+    }
+    CluePlayer_t* player = &game->players[player_id];
+    if (game->state == CLUE_STATE_TURN && player_id == game->order[game->turn_idx]) {
+        game_handle_turn(game, player, type, data, data_length);
+    } else if (game->state == CLUE_STATE_QUERY && player_id == game->order[game->query_idx]) {
+        game_handle_query(game, player, type, data, data_length);
+    } else {
+        // Nobody asked. It's harmless so just tell them
+        game_error(game, player_id, "Frame sent out of turn");
+    }
+}
+
+void clue_game_timeout(ClueGame_t* game) {
+    if (game->state == CLUE_STATE_TURN) {
+        game_error(game, game->order[game->turn_idx], "Timed out");
+        game_over(game, "Communication error");
+    } else if (game->state == CLUE_STATE_QUERY) {
+        game_error(game, game->order[game->query_idx], "Timed out");
+        game_over(game, "Player failed to respond to suggestion");
+    }
+}
+
+void clue_game_forfeit(ClueGame_t* game) {
+    int player_id = clue_game_waiting_on(game);
+    if (player_id == -1) {
+        return;
+    }
+    CluePlayer_t* player = &game->players[player_id];
+    game_error(game, player_id, "Out of time, you forfeit");
+    game_event(game, CLUE_EVENT_FORFEIT, player_id, NULL, 0);
+    player->eliminated = 1;
+    player->forfeited = 1;
+    if (game->state == CLUE_STATE_TURN) {
+        game_next_turn(game);
+    } else {
+        // Their cards are still in the game, so somebody has to show one
+        game_show(game, player, game_forced_card(game, player));
+    }
+}
+
+void clue_game_abort(ClueGame_t* game, const char* reason) {
+    if (game->state != CLUE_STATE_OVER) {
+        game_over(game, reason);
+    }
+}
+
+void clue_game_free(ClueGame_t* game) {
+    free(game->players); // And everything else clue_game_new put in the same block
+    free(game);
+}
+
+int clue_player_has_card(const CluePlayer_t* player, int16_t card) {
+    return (player->hand_bits[card / 64] >> (card % 64)) & 1;
+}
+
+char* clue_rules_frame(const ClueRules_t* rules, int* frame_len) {
+    *frame_len = clue_encode_rules(NULL, 0, 0, rules->num_categories, rules->num_cards, rules->card_names);
+    char* frame = malloc(*frame_len);
+    clue_encode_rules(frame, *frame_len, 0, rules->num_categories, rules->num_cards, rules->card_names);
+    return frame;
+}
+
+static void game_event(ClueGame_t* game, int type, int8_t player, const int16_t* cards, int16_t num_cards) {
+    if (game->io.event == NULL) {
+        return;
+    }
+    ClueEvent_t event = {};
+    event.type = type;
+    event.player = player;
+    event.cards = cards;
+    event.num_cards = num_cards;
+    game->io.event(game->io.ctx, &event);
+}
+
+static void game_multicast(ClueGame_t* game, const int8_t* player_ids, int num_player_ids, int8_t type, const void* data, int32_t data_length) {
+    if (game->io.multicast) {
+        game->io.multicast(game->io.ctx, player_ids, num_player_ids, type, data, data_length);
+        return;
+    }
+    for (int i = 0; i < num_player_ids; i++) {
+        game->io.send(game->io.ctx, player_ids[i], type, data, data_length);
+    }
+}
+
+static void game_error(ClueGame_t* game, int8_t player_id, const char* reason) {
+    if (game->io.event) {
+        ClueEvent_t event = {};
+        event.type = CLUE_EVENT_ERROR;
+        event.player = player_id;
+        event.reason = reason;
+        game->io.event(game->io.ctx, &event);
+    }
+    int error_length = strlen(reason);
+    char frame[sizeof(ErrorFrame_t) + error_length];
+    ((ErrorFrame_t*)frame)->error_length = error_length;
+    memcpy(frame + sizeof(ErrorFrame_t), reason, error_length);
+    game->io.send(game->io.ctx, player_id, FRAME_TYPE_ERROR, frame, sizeof(frame));
+}
+
+static void game_over(ClueGame_t* game, const char* reason) {
+    game->state = CLUE_STATE_OVER;
+    game->aborted = 1;
+    game->over_reason = reason;
+    int error_length = strlen(reason);
+    char frame[sizeof(AbortFrame_t) + error_length];
+    ((AbortFrame_t*)frame)->error_length = error_length;
+    memcpy(frame + sizeof(AbortFrame_t), reason, error_length);
+    game->io.send(game->io.ctx, CLUE_EVERYONE, FRAME_TYPE_ABORT, frame, sizeof(frame));
+    if (game->io.event) {
+        ClueEvent_t event = {};
+        event.type = CLUE_EVENT_OVER;
+        event.player = game->winner;
+        event.aborted = 1;
+        event.reason = reason;
+        game->io.event(game->io.ctx, &event);
+    }
+}
+
+static void game_finished(ClueGame_t* game, const char* reason) {
+    if (game->games_left == 0) {
+        // Nothing after this one, so it is the same as any other ending
+        game_over(game, reason);
+        return;
+    }
+    game->state = CLUE_STATE_OVER;
+    game->over_reason = reason;
+    GameOverFrame_t game_over_frame = {};
+    game_over_frame.winner = game->winner;
+    game_over_frame.games_left = game->games_left;
+    game->io.send(game->io.ctx, CLUE_EVERYONE, FRAME_TYPE_GAME_OVER, &game_over_frame, sizeof(game_over_frame));
+    if (game->io.event) {
+        ClueEvent_t event = {};
+        event.type = CLUE_EVENT_OVER;
+        event.player = game->winner;
+        event.reason = reason;
+        game->io.event(game->io.ctx, &event);
+    }
+}
+
+static void game_next_turn(ClueGame_t* game) {
+    int num_players = game->num_players;
+    int turn_idx = (game->turn_idx + 1) % num_players;
+
+    // First: are all the players eliminated?
+    int not_eliminated = 0;
+    for (int i = 0; i < num_players; i++) {
+        if (!game->players[i].eliminated) {
+            not_eliminated++;
+        }
+    }
+    if (not_eliminated == 0) {
+        game_finished(game, "All players eliminated");
+        return;
+    }
+
+    // The game continues. Skip anyone who is eliminated
+    while (game->players[game->order[turn_idx]].eliminated) {
+        turn_idx++;
+        turn_idx = turn_idx % num_players;
+    }
+    game->turn_idx = turn_idx;
+
+    // It's someones turn. Tell everyone and await their response
+    TurnFrame_t turn_frame = {};
+    turn_frame.player_id = game->order[turn_idx];
+    game_event(game, CLUE_EVENT_TURN, turn_frame.player_id, NULL, 0);
+    game->state = CLUE_STATE_TURN;
+    game->moves++;
+    game->io.send(game->io.ctx, CLUE_EVERYONE, FRAME_TYPE_TURN, &turn_frame, sizeof(turn_frame));
+}
+
+static void game_handle_turn(ClueGame_t* game, CluePlayer_t* player, int8_t type, const void* data, int32_t data_length) {
+    const ClueRules_t* rules = game->rules;
+    int expected_len = rules->num_categories * sizeof(int16_t);
+
+    // They can either take a stab at the answer...
+    if (type == FRAME_TYPE_SOLVE_ATTEMPT) {
+        if (data_length != expected_len) {
+            game_error(game, player->id, "Incomplete solution attempt");
+            // Technically recoverable
+            game_next_turn(game);
+            return;
+        }
+        int16_t client_guess[rules->num_categories];
+        memcpy(client_guess, data, expected_len);
+
+        int wrong = 0;
+        for (int i = 0; i < rules->num_categories; i++) {
+            // n^2 because lazy and probably faster than sorting
+            int found = 0;
+            for (int j = 0; j < rules->num_categories; j++) {
+                if (game->solution[i] == client_guess[j]) {
+                    found++;
+                    break;
+                }
+            }
+            if (found == 0) {
+                wrong = 1;
+            }
+        }
+        if (game->io.event) {
+            ClueEvent_t event = {};
+            event.type = CLUE_EVENT_SOLVE_ATTEMPT;
+            event.player = player->id;
+            event.correct = !wrong;
+            event.cards = client_guess;
+            event.num_cards = rules->num_categories;
+            game->io.event(game->io.ctx, &event);
+        }
+
+        int solve_broadcast_len = sizeof(SolveResultFrame_t) + expected_len;
+        char solve_broadcast_buffer[solve_broadcast_len];
+        SolveResultFrame_t* solve_broadcast_frame = (SolveResultFrame_t*)solve_broadcast_buffer;
+        solve_broadcast_frame->player = player->id;
+        solve_broadcast_frame->correct = wrong ? 0 : 1;
+        memcpy(solve_broadcast_frame->cards, client_guess, expected_len);
+        game->io.send(game->io.ctx, CLUE_EVERYONE, FRAME_TYPE_SOLVE_RESULT, solve_broadcast_frame, solve_broadcast_len);
+        if (!wrong) {
+            game->winner = player->id;
+            game_finished(game, "Game ended");
+        } else {
+            player->eliminated = 1;
+            game_next_turn(game);
+        }
+    }
+    // or do a suggestion
+    else if (type == FRAME_TYPE_TURN_RESPONSE) {
+        if (data_length != expected_len) {
+            game_error(game, player->id, "Incomplete suggestion");
+            // Technically recoverable
+            game_next_turn(game);
+            return;
+        }
+        int16_t* client_suggestion = game->suggestion;
+        memcpy(client_suggestion, data, expected_len);
+
+        if (!check_suggestion(rules, client_suggestion)) {
+            game_event(game, CLUE_EVENT_ILLEGAL_SUGGESTION, player->id, client_suggestion, rules->num_categories);
+            game_error(game, player->id, "Not one card per category suggested");
+            game_next_turn(game);
+            return;
+        }
+        game_event(game, CLUE_EVENT_SUGGESTION, player->id, client_suggestion, rules->num_categories);
+
+        // The suggestion is valid... go around
+        game->query_idx = game->turn_idx;
+        game_next_query(game);
+    }
+    // or they messed up
+    else {
+        if (game->io.event) {
+            ClueEvent_t event = {};
+            event.type = CLUE_EVENT_BAD_FRAME;
+            event.player = player->id;
+            event.frame_type = type;
+            game->io.event(game->io.ctx, &event);
+        }
+        game_error(game, player->id, "Expected either FRAME_TYPE_TURN_RESPONSE or FRAME_TYPE_SOLVE_ATTEMPT");
+
+        // Technically recoverable
+        game_next_turn(game);
+    }
+}
+
+static void game_next_query(ClueGame_t* game) {
+    const ClueRules_t* rules = game->rules;
+    int num_players = game->num_players;
+
+    // The closest player after the suggester holding any of the cards has to show. Everyone in
+    // between passes, and the suggester's own cards don't count
+    int shower_distance = num_players;
+    for (int i = 0; i < rules->num_categories; i++) {
+        int8_t owner = game->owner[game->suggestion[i]];
+        if (owner == -1) {
+            continue;
+        }
+        int distance = (game->seats[owner] - game->turn_idx + num_players) % num_players;
+        if (distance > 0 && distance < shower_distance) {
+            shower_distance = distance;
+        }
+    }
+
+    int query_frame_len = sizeof(QueryFrame_t) + sizeof(int16_t) * rules->num_categories;
+    char query_frame_buffer[query_frame_len];
+    QueryFrame_t* query_frame = (QueryFrame_t*)query_frame_buffer;
+    query_frame->_reserved = 0;
+    memcpy(query_frame->suggestion, game->suggestion, rules->num_categories * sizeof(int16_t));
+    for (int distance = 1; distance < num_players; distance++) {
+        int suggestion_turn_idx = (game->turn_idx + distance) % num_players;
+        CluePlayer_t* player = &game->players[game->order[suggestion_turn_idx]];
+        query_frame->player_id = player->id;
+        game->io.send(game->io.ctx, CLUE_EVERYONE, FRAME_TYPE_QUERY, query_frame, query_frame_len);
+
+        if (distance == shower_distance) {
+            // This player has a card and we need to ask them which one they want to show
+            game_event(game, CLUE_EVENT_QUERY, player->id, NULL, 0);
+            game->query_idx = suggestion_turn_idx;
+            if (player->forfeited || (player->auto_show && game_cards_held(game, player) == 1)) {
+                // Not asking someone who already ran out of time, or who asked not to be asked
+                // when there is no choice to make
+                game_show(game, player, game_forced_card(game, player));
+                return;
+            }
+            game->state = CLUE_STATE_QUERY;
+            game->moves++;
+            return;
+        }
+
+        // This player doesn't have a card so we will broadcast that
+        game_event(game, CLUE_EVENT_PASS, player->id, NULL, 0);
+        QueryAnouncementFrame_t noshow_frame = {};
+        noshow_frame.player_id = player->id;
+        noshow_frame.card_id = -1;
+        game->io.send(game->io.ctx, CLUE_EVERYONE, FRAME_TYPE_QUERY_RETURN, &noshow_frame, sizeof(noshow_frame));
+    }
+
+    // Made it all the way around without anyone showing
+    game_next_turn(game);
+}
+
+static void game_handle_query(ClueGame_t* game, CluePlayer_t* player, int8_t type, const void* data, int32_t data_length) {
+    if (type != FRAME_TYPE_QUERY_RESPONSE || data_length != sizeof(QueryResponseFrame_t)) {
+        game_error(game, player->id, "Incomplete query response");
+        // Bricked
+        game_over(game, "Player failed to respond to suggestion");
+        return;
+    }
+    QueryResponseFrame_t query_response_frame;
+    memcpy(&query_response_frame, data, sizeof(query_response_frame));
+
+    // Do they actually have that card, and was it suggested?
+    int16_t card = query_response_frame.card_id;
+    int shown_card_suggested = 0;
+    for (int i = 0; i < game->rules->num_categories; i++) {
+        if (game->suggestion[i] == card) {
+            shown_card_suggested = 1;
+        }
+    }
+    if (!shown_card_suggested || game->owner[card] != player->id) {
+        game_event(game, CLUE_EVENT_CHEAT, player->id, &query_response_frame.card_id, 1);
+        game_over(game, "Player responded to a suggestion illegally");
+        return;
+    }
+    game_show(game, player, card);
+}
+
+static void game_show(ClueGame_t* game, CluePlayer_t* player, int16_t card) {
+    game_event(game, CLUE_EVENT_SHOW, player->id, &card, 1);
+
+    // This player has a card so we will broadcast that. Only the suggester gets to see which one
+    QueryAnouncementFrame_t show_frame = {};
+    show_frame.player_id = player->id;
+    int8_t watchers[game->num_players];
+    int num_watchers = 0;
+    for (int i = 0; i < game->num_players; i++) {
+        // No need to poke the shower
+        if (i != game->query_idx && i != game->turn_idx) {
+            watchers[num_watchers++] = game->order[i];
+        }
+    }
+    show_frame.card_id = 0;
+    game_multicast(game, watchers, num_watchers, FRAME_TYPE_QUERY_RETURN, &show_frame, sizeof(show_frame));
+    show_frame.card_id = card;
+    game->io.send(game->io.ctx, game->order[game->turn_idx], FRAME_TYPE_QUERY_RETURN, &show_frame, sizeof(show_frame));
+    game_next_turn(game);
+}
+
+static int16_t game_forced_card(ClueGame_t* game, CluePlayer_t* player) {
+    int16_t card = -1;
+    for (int i = 0; i < game->rules->num_categories; i++) {
+        int16_t suggested = game->suggestion[i];
+        if (game->owner[suggested] == player->id && (card == -1 || suggested < card)) {
+            card = suggested;
+        }
+    }
+    return card;
+}
+
+static int game_cards_held(ClueGame_t* game, CluePlayer_t* player) {
+    int num_held = 0;
+    for (int i = 0; i < game->rules->num_categories; i++) {
+        num_held += game->owner[game->suggestion[i]] == player->id;
+    }
+    return num_held;
+}
+
+static void shuffle(void* arr, int n, size_t size, ClueRng_t* rng) {
+    // Shuffle array in place via Fisher-Yates
+    char tmp[size];
+    for (int i = 0; i < n; i++) {
+        int idx = clue_rng_below(rng, i + 1);
+        memcpy(tmp, (char*)arr + size * idx, size);
+        memcpy((char*)arr + size * idx, (char*)arr + size * i, size);
+        memcpy((char*)arr + size * i, tmp, size);
+    }
+}
+
+uint64_t clue_seed() {
+    // Games and bots on different threads must not end up with the same sequence
+    static atomic_ullong counter;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return clue_rng_mix((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec, atomic_fetch_add(&counter, 1));
+}
+
+static int check_suggestion(const ClueRules_t* rules, int16_t* suggestion) {
+    // This time we are going to sort the client input for validation purposes
+    qsort(suggestion, rules->num_categories, sizeof(int16_t), qsort_int16s);
+
+    // Did the client supply a valid suggestion?
+    int base_idx = 0;
+    int legal = 1;
+    for (int i = 0; i < rules->num_categories; i++) {
+        int offset_in_category = suggestion[i] - base_idx;
+        if (offset_in_category < 0 || offset_in_category >= rules->num_cards[i]) {
+            // No lol
+            legal = 0;
+        }
+        base_idx += rules->num_cards[i];
+    }
+    return legal;
+}
+
+static int qsort_int16s(const void* left, const void* right) {
+    // Lame
+    int16_t* left_int = (int16_t*)left;
+    int16_t* right_int = (int16_t*)right;
+    return *left_int - *right_int;
+}
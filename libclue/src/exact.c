@@ -0,0 +1,522 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "clue/sample.h"
+
+#define EXACT_MAX_CLAUSES 64 // Satisfied clauses are a bit mask
+
+// Deals the free cards out one at a time. Where the rest can go only depends on what is left of
+// every hand, which solution slots are still open and which clauses are satisfied, so that is the
+// state. Counting backwards from each state gives the ways to finish the deal from there, counting
+// forwards gives the ways to get there, and their product over each card's moves gives every
+// probability at once (forward-backward).
+typedef struct {
+    const ClueDeduce_t* deduce;
+    int num_players;
+    int num_categories;
+    int16_t* free_cards; // Cards nobody is known to hold, by card ID
+    int num_free;
+    int16_t* free_idx; // Card -> position in free_cards, -1 if known
+    int16_t* category; // Card -> category
+    int16_t* caps; // By player, how many free cards they still take
+    int16_t* open; // By category, 1 if the solution card is not known yet
+    uint64_t* clause_cards; // [position * num_players + player], clauses that deal satisfies
+    uint64_t* due; // By position, clauses that have no cards left from there on
+    int16_t* forced; // By category, the card the solution must have, -1 for any
+    // Memo, open addressing. Keys are position, 4 for the mask, forced and open per category, then
+    // caps per player, all int16_t
+    int key_length; // Rounded up to whole uint64_t for hashing
+    int16_t* keys;
+    double* counts; // Ways to finish from the state
+    double* forward; // Ways to get to the state
+    int8_t* used;
+    uint32_t size; // Power of two, doubled whenever it gets half full
+    uint32_t* states; // Slots in the order they were filled
+    uint32_t* sorted; // The same by position, for the forward pass
+    int num_states;
+    int max_states;
+    int too_big;
+} Exact_t;
+
+static double exact_run(Exact_t* exact, double sign, double* solution, double* held); // Count the deals that fit forced, and add sign * every move's count to solution and held if not NULL
+static void exact_best(Exact_t* exact, ClueSample_t* sample, double total, int category, double bound, int16_t* candidate); // Search the solutions for the most likely one, categories from category on
+static double exact_count(Exact_t* exact, int position, uint64_t satisfied, double** memo); // Ways to deal free_cards[position...]. memo is its slot until the memo next grows, NULL for end states
+static int exact_moves(Exact_t* exact, int position, int16_t* moves); // Where the card can go from here. num_players is the solution
+static void exact_apply(Exact_t* exact, int position, int16_t move, int16_t undo); // Take up or give back the slot the card went to
+static void exact_key(Exact_t* exact, int position, uint64_t satisfied, int16_t* key);
+static double* exact_lookup(Exact_t* exact, const int16_t* key, int* found); // Slot for key, NULL if the memo is full
+static uint64_t exact_hash(Exact_t* exact, const int16_t* key);
+static void exact_grow(Exact_t* exact);
+static void exact_free(Exact_t* exact);
+
+ClueSample_t* clue_sample_exact(const ClueDeduce_t* deduce, int max_states, const ClueSampleConfig_t* fallback) {
+    int num_players = deduce->num_players;
+    int num_cards = deduce->num_cards;
+    int num_categories = deduce->num_categories;
+    int words = deduce->words;
+    if (num_players == 0 || deduce->inconsistent || deduce->num_clauses > EXACT_MAX_CLAUSES) {
+        return clue_sample(deduce, fallback);
+    }
+
+    Exact_t exact = {};
+    exact.deduce = deduce;
+    exact.num_players = num_players;
+    exact.num_categories = num_categories;
+    exact.free_cards = malloc(num_cards * sizeof(int16_t));
+    exact.free_idx = malloc(num_cards * sizeof(int16_t));
+    exact.category = malloc(num_cards * sizeof(int16_t));
+    exact.caps = malloc(num_players * sizeof(int16_t));
+    exact.open = malloc(num_categories * sizeof(int16_t));
+    exact.forced = malloc(num_categories * sizeof(int16_t));
+    int16_t base_idx = 0;
+    for (int i = 0; i < num_categories; i++) {
+        for (int16_t card = base_idx; card < base_idx + deduce->num_cards_in_category[i] && card < num_cards; card++) {
+            exact.category[card] = i;
+        }
+        base_idx += deduce->num_cards_in_category[i];
+        exact.open[i] = 1;
+        exact.forced[i] = -1;
+    }
+
+    // Known cards are already dealt, they only shrink the hands
+    ClueSample_t* sample = calloc(1, sizeof(ClueSample_t));
+    sample->num_players = num_players;
+    sample->num_cards = num_cards;
+    sample->num_categories = num_categories;
+    sample->exact = 1;
+    sample->solution = calloc(num_cards, sizeof(double));
+    sample->solution_low = calloc(num_cards, sizeof(double));
+    sample->solution_high = calloc(num_cards, sizeof(double));
+    sample->held = calloc(num_players * num_cards, sizeof(double));
+    sample->best = malloc(num_categories * sizeof(int16_t));
+    for (int i = 0; i < num_categories; i++) {
+        sample->best[i] = -1;
+    }
+    for (int i = 0; i < num_players; i++) {
+        exact.caps[i] = deduce->row_sizes[i];
+    }
+    for (int16_t card = 0; card < num_cards; card++) {
+        exact.free_idx[card] = -1;
+        int known = 0;
+        for (int row = 0; row <= num_players; row++) {
+            if (deduce->known[row * words + card / 64] & (1ULL << (card % 64))) {
+                known = 1;
+                if (row < num_players) {
+                    exact.caps[row]--;
+                    sample->held[row * num_cards + card] = 1;
+                } else {
+                    exact.open[exact.category[card]] = 0;
+                    sample->solution[card] = 1;
+                }
+            }
+        }
+        if (!known) {
+            exact.free_idx[card] = exact.num_free;
+            exact.free_cards[exact.num_free++] = card;
+        }
+    }
+
+    // Which clauses each (position, player) satisfies, and from where on each clause is hopeless
+    exact.clause_cards = calloc(exact.num_free * num_players, sizeof(uint64_t));
+    exact.due = calloc(exact.num_free + 1, sizeof(uint64_t));
+    for (int i = 0; i < deduce->num_clauses; i++) {
+        const uint64_t* bits = &deduce->clause_bits[i * words];
+        int last = -1;
+        for (int w = 0; w < words; w++) {
+            for (uint64_t left = bits[w]; left; left &= left - 1) {
+                int position = exact.free_idx[w * 64 + __builtin_ctzll(left)];
+                if (position != -1) {
+                    exact.clause_cards[position * num_players + deduce->clause_players[i]] |= 1ULL << i;
+                    last = position > last ? position : last;
+                }
+            }
+        }
+        for (int position = last + 1; position <= exact.num_free; position++) {
+            exact.due[position] |= 1ULL << i;
+        }
+    }
+
+    exact.key_length = (1 + 4 + 2 * num_categories + num_players + 3) / 4 * 4;
+    exact.max_states = max_states;
+    // Small to start with, most positions late in a game only need a few hundred states and a big
+    // table is mostly cache misses
+    exact.size = 1024;
+    exact.keys = malloc((size_t)exact.size * exact.key_length * sizeof(int16_t));
+    exact.counts = malloc(exact.size * sizeof(double));
+    exact.forward = malloc(exact.size * sizeof(double));
+    exact.used = calloc(exact.size, 1);
+    exact.states = malloc(exact.size / 2 * sizeof(uint32_t));
+    exact.sorted = malloc(exact.size / 2 * sizeof(uint32_t));
+
+    // Every deal, less the ones where a wrong solve attempt would have been right. Two different
+    // attempts can't both have been right, so that is the whole inclusion-exclusion. The deduction
+    // never keeps the same attempt twice
+    double* solution = calloc(num_cards, sizeof(double));
+    double* held = calloc(num_players * num_cards, sizeof(double));
+    double total = exact_run(&exact, 1, solution, held);
+    int solution_row = num_players * words;
+    for (int i = 0; i < deduce->num_misses && !exact.too_big; i++) {
+        const int16_t* miss = &deduce->misses[i * num_categories];
+        int fits = 1;
+        for (int j = 0; j < num_categories && fits; j++) {
+            int16_t card = miss[j];
+            if (exact.free_idx[card] == -1) {
+                fits = (deduce->known[solution_row + card / 64] >> (card % 64)) & 1;
+            } else {
+                exact.forced[exact.category[card]] = card;
+            }
+        }
+        if (fits) {
+            total -= exact_run(&exact, -1, solution, held);
+        }
+        for (int j = 0; j < num_categories; j++) {
+            exact.forced[j] = -1;
+        }
+    }
+
+    if (total > 0 && !exact.too_big) {
+        for (int card = 0; card < num_cards; card++) {
+            if (exact.free_idx[card] != -1) {
+                sample->solution[card] = solution[card] / total;
+                for (int player = 0; player < num_players; player++) {
+                    sample->held[player * num_cards + card] = held[player * num_cards + card] / total;
+                }
+            }
+            sample->solution_low[card] = sample->solution[card];
+            sample->solution_high[card] = sample->solution[card];
+        }
+
+        // Most likely whole solution. The likeliest card of each category together can be
+        // impossible, so whole solutions get counted one forced run at a time
+        int16_t candidate[num_categories];
+        exact_best(&exact, sample, total, 0, 1, candidate);
+        sample->num_samples = 1;
+        sample->num_deals = total;
+    }
+    free(solution);
+    free(held);
+    int too_big = exact.too_big;
+    exact_free(&exact);
+    if (too_big) {
+        clue_sample_free(sample);
+        return clue_sample(deduce, fallback);
+    }
+    return sample;
+}
+
+static double exact_run(Exact_t* exact, double sign, double* solution, double* held) {
+    // Backwards: the recursion fills the memo with every state a deal can pass through. Every state
+    // the forward pass reaches is in there after that, so the memo doesn't grow under it
+    double* root;
+    double total = exact_count(exact, 0, 0, &root);
+    if (solution == NULL || total == 0 || exact->too_big) {
+        return total;
+    }
+    if (root == NULL) {
+        // Nothing left to deal, or it ended right away. The known cards are already filled in
+        return total;
+    }
+
+    // Forwards: states in position order, each handing its count on to where its card can go.
+    // Earlier runs may have left states this one goes through, so it is all of them
+    int num_states = exact->num_states;
+    uint32_t* states = exact->sorted;
+    int starts[exact->num_free + 1];
+    memset(starts, 0, sizeof(starts));
+    for (int i = 0; i < num_states; i++) {
+        starts[exact->keys[(size_t)exact->states[i] * exact->key_length]]++;
+        exact->forward[exact->states[i]] = 0;
+    }
+    for (int position = 0, start = 0; position <= exact->num_free; position++) {
+        int count = starts[position];
+        starts[position] = start;
+        start += count;
+    }
+    for (int i = 0; i < num_states; i++) {
+        states[starts[exact->keys[(size_t)exact->states[i] * exact->key_length]]++] = exact->states[i];
+    }
+    exact->forward[root - exact->counts] = 1;
+
+    int num_players = exact->num_players;
+    int num_cards = exact->deduce->num_cards;
+    int16_t caps[num_players];
+    int16_t open[exact->num_categories];
+    memcpy(caps, exact->caps, sizeof(caps));
+    memcpy(open, exact->open, sizeof(open));
+    for (int i = 0; i < num_states; i++) {
+        uint32_t slot = states[i];
+        double forward = exact->forward[slot];
+        if (forward == 0) {
+            continue;
+        }
+        const int16_t* key = &exact->keys[(size_t)slot * exact->key_length];
+        int position = key[0];
+        uint64_t satisfied;
+        memcpy(&satisfied, &key[1], sizeof(satisfied));
+        for (int j = 0; j < exact->num_categories; j++) {
+            exact->open[j] = key[5 + exact->num_categories + j];
+        }
+        memcpy(exact->caps, &key[5 + 2 * exact->num_categories], num_players * sizeof(int16_t));
+
+        int16_t card = exact->free_cards[position];
+        int16_t moves[num_players + 1];
+        int num_moves = exact_moves(exact, position, moves);
+        for (int j = 0; j < num_moves; j++) {
+            uint64_t next_satisfied = satisfied;
+            if (moves[j] < num_players) {
+                next_satisfied |= exact->clause_cards[position * num_players + moves[j]];
+            }
+            exact_apply(exact, position, moves[j], 0);
+            double* next;
+            double count = forward * exact_count(exact, position + 1, next_satisfied, &next);
+            exact_apply(exact, position, moves[j], 1);
+            if (count == 0) {
+                continue;
+            }
+            if (next) {
+                exact->forward[next - exact->counts] += forward;
+            }
+            if (moves[j] < num_players) {
+                held[moves[j] * num_cards + card] += sign * count;
+            } else {
+                solution[card] += sign * count;
+            }
+        }
+    }
+    memcpy(exact->caps, caps, sizeof(caps));
+    memcpy(exact->open, open, sizeof(open));
+    return total;
+}
+
+static void exact_best(Exact_t* exact, ClueSample_t* sample, double total, int category, double bound, int16_t* candidate) {
+    const ClueDeduce_t* deduce = exact->deduce;
+    int num_categories = exact->num_categories;
+    if (category == num_categories) {
+        // A miss would have had to be right to count
+        for (int i = 0; i < deduce->num_misses; i++) {
+            const int16_t* miss = &deduce->misses[i * num_categories];
+            int same = 1;
+            for (int j = 0; j < num_categories; j++) {
+                same &= candidate[exact->category[miss[j]]] == miss[j];
+            }
+            if (same) {
+                return;
+            }
+        }
+        for (int i = 0; i < num_categories; i++) {
+            exact->forced[i] = exact->free_idx[candidate[i]] != -1 ? candidate[i] : -1;
+        }
+        double probability = exact_run(exact, 1, NULL, NULL) / total;
+        for (int i = 0; i < num_categories; i++) {
+            exact->forced[i] = -1;
+        }
+        if (probability > sample->best_probability && !exact->too_big) {
+            memcpy(sample->best, candidate, num_categories * sizeof(int16_t));
+            sample->best_probability = probability;
+        }
+        return;
+    }
+
+    // Likeliest cards first. No solution is likelier than its least likely card, so once that is
+    // no better than what we have, neither is anything after it
+    int16_t base_idx = 0;
+    for (int i = 0; i < category; i++) {
+        base_idx += deduce->num_cards_in_category[i];
+    }
+    int16_t cards[deduce->num_cards_in_category[category]];
+    int num_cards = 0;
+    for (int16_t card = base_idx; card < base_idx + deduce->num_cards_in_category[category]; card++) {
+        if (sample->solution[card] > 0) {
+            int i = num_cards++;
+            for (; i > 0 && sample->solution[cards[i - 1]] < sample->solution[card]; i--) {
+                cards[i] = cards[i - 1];
+            }
+            cards[i] = card;
+        }
+    }
+    for (int i = 0; i < num_cards && !exact->too_big; i++) {
+        double card_bound = sample->solution[cards[i]] < bound ? sample->solution[cards[i]] : bound;
+        if (card_bound <= sample->best_probability) {
+            break;
+        }
+        candidate[category] = cards[i];
+        exact_best(exact, sample, total, category + 1, card_bound, candidate);
+    }
+}
+
+static double exact_count(Exact_t* exact, int position, uint64_t satisfied, double** memo) {
+    *memo = NULL;
+    if (exact->due[position] & ~satisfied) {
+        // A show nobody can account for anymore
+        return 0;
+    } else if (position == exact->num_free) {
+        // Only happens with every hand and solution slot full, unless the hand sizes were off
+        for (int i = 0; i < exact->num_players; i++) {
+            if (exact->caps[i] != 0) {
+                return 0;
+            }
+        }
+        for (int i = 0; i < exact->num_categories; i++) {
+            if (exact->open[i]) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    int16_t key[exact->key_length];
+    memset(key, 0, sizeof(key));
+    exact_key(exact, position, satisfied, key);
+    int found;
+    *memo = exact_lookup(exact, key, &found);
+    if (*memo == NULL) {
+        return 0;
+    } else if (found) {
+        return **memo;
+    }
+
+    int num_players = exact->num_players;
+    int16_t moves[num_players + 1];
+    int num_moves = exact_moves(exact, position, moves);
+    double count = 0;
+    for (int i = 0; i < num_moves && !exact->too_big; i++) {
+        uint64_t next_satisfied = satisfied;
+        if (moves[i] < num_players) {
+            next_satisfied |= exact->clause_cards[position * num_players + moves[i]];
+        }
+        exact_apply(exact, position, moves[i], 0);
+        double* next;
+        count += exact_count(exact, position + 1, next_satisfied, &next);
+        exact_apply(exact, position, moves[i], 1);
+    }
+    // The memo may have grown and moved the entry meanwhile, but anything deeper has a later position
+    // so nothing else wrote to it
+    *memo = exact_lookup(exact, key, &found);
+    **memo = count;
+    return count;
+}
+
+static int exact_moves(Exact_t* exact, int position, int16_t* moves) {
+    const ClueDeduce_t* deduce = exact->deduce;
+    int words = deduce->words;
+    int16_t card = exact->free_cards[position];
+    int category = exact->category[card];
+    int16_t forced = exact->forced[category];
+    int num_moves = 0;
+    if (forced != card) {
+        for (int player = 0; player < exact->num_players; player++) {
+            if (exact->caps[player] > 0 && ((deduce->possible[player * words + card / 64] >> (card % 64)) & 1)) {
+                moves[num_moves++] = player;
+            }
+        }
+    }
+    int solution_row = exact->num_players * words;
+    if (exact->open[category] && (forced == card || (forced == -1 && ((deduce->possible[solution_row + card / 64] >> (card % 64)) & 1)))) {
+        moves[num_moves++] = exact->num_players;
+    }
+    return num_moves;
+}
+
+static void exact_apply(Exact_t* exact, int position, int16_t move, int16_t undo) {
+    if (move < exact->num_players) {
+        exact->caps[move] += undo ? 1 : -1;
+    } else {
+        exact->open[exact->category[exact->free_cards[position]]] = undo;
+    }
+}
+
+static void exact_key(Exact_t* exact, int position, uint64_t satisfied, int16_t* key) {
+    int num_categories = exact->num_categories;
+    key[0] = position;
+    memcpy(&key[1], &satisfied, sizeof(satisfied));
+    for (int i = 0; i < num_categories; i++) {
+        // Forced cards already behind us don't change what is left
+        int16_t card = exact->forced[i];
+        key[5 + i] = card != -1 && exact->free_idx[card] >= position ? card : -1;
+        key[5 + num_categories + i] = exact->open[i];
+    }
+    memcpy(&key[5 + 2 * num_categories], exact->caps, exact->num_players * sizeof(int16_t));
+}
+
+static double* exact_lookup(Exact_t* exact, const int16_t* key, int* found) {
+    uint32_t mask = exact->size - 1;
+    for (uint32_t slot = exact_hash(exact, key) & mask;; slot = (slot + 1) & mask) {
+        int16_t* slot_key = &exact->keys[(size_t)slot * exact->key_length];
+        if (!exact->used[slot]) {
+            if (exact->num_states >= exact->max_states) {
+                exact->too_big = 1;
+                return NULL;
+            } else if ((uint32_t)exact->num_states >= exact->size / 2) {
+                exact_grow(exact);
+                return exact_lookup(exact, key, found);
+            }
+            exact->used[slot] = 1;
+            exact->states[exact->num_states++] = slot;
+            memcpy(slot_key, key, exact->key_length * sizeof(int16_t));
+            *found = 0;
+            return &exact->counts[slot];
+        } else if (memcmp(slot_key, key, exact->key_length * sizeof(int16_t)) == 0) {
+            *found = 1;
+            return &exact->counts[slot];
+        }
+    }
+}
+
+static uint64_t exact_hash(Exact_t* exact, const int16_t* key) {
+    uint64_t hash = 0;
+    for (int i = 0; i < exact->key_length; i += 4) {
+        uint64_t word;
+        memcpy(&word, &key[i], sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+static void exact_grow(Exact_t* exact) {
+    uint32_t size = exact->size * 2;
+    uint32_t mask = size - 1;
+    size_t key_size = exact->key_length * sizeof(int16_t);
+    int16_t* keys = malloc(size * key_size);
+    double* counts = malloc(size * sizeof(double));
+    int8_t* used = calloc(size, 1);
+    for (int i = 0; i < exact->num_states; i++) {
+        uint32_t old = exact->states[i];
+        const int16_t* key = &exact->keys[(size_t)old * exact->key_length];
+        uint32_t slot = exact_hash(exact, key) & mask;
+        while (used[slot]) {
+            slot = (slot + 1) & mask;
+        }
+        used[slot] = 1;
+        memcpy(&keys[(size_t)slot * exact->key_length], key, key_size);
+        counts[slot] = exact->counts[old];
+        exact->states[i] = slot;
+    }
+    free(exact->keys);
+    free(exact->counts);
+    free(exact->used);
+    exact->keys = keys;
+    exact->counts = counts;
+    exact->used = used;
+    exact->size = size;
+    exact->forward = realloc(exact->forward, size * sizeof(double));
+    exact->states = realloc(exact->states, size / 2 * sizeof(uint32_t));
+    exact->sorted = realloc(exact->sorted, size / 2 * sizeof(uint32_t));
+}
+
+static void exact_free(Exact_t* exact) {
+    free(exact->free_cards);
+    free(exact->free_idx);
+    free(exact->category);
+    free(exact->caps);
+    free(exact->open);
+    free(exact->clause_cards);
+    free(exact->due);
+    free(exact->forced);
+    free(exact->keys);
+    free(exact->counts);
+    free(exact->forward);
+    free(exact->used);
+    free(exact->states);
+    free(exact->sorted);
+}
@@ -0,0 +1,253 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "clue/gamelog.h"
+
+static void* gamelog_reserve(ClueGameLogBuffer_t* buffer, size_t length); // Zeroed room at the end of the buffer
+static int gamelog_file_header(const ClueRules_t* rules, char* out); // Returns its length, out can be NULL
+
+ClueGameLog_t* clue_gamelog_open(const char* path, const ClueRules_t* rules) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        printf("Failed to open game log %s\n", path);
+        perror(NULL);
+        return NULL;
+    }
+    int header_length = gamelog_file_header(rules, NULL);
+    char header[header_length];
+    gamelog_file_header(rules, header);
+
+    // A log of other rules would be useless to whoever reads it, so refuse to mix them
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size == 0) {
+        if (write(fd, header, header_length) != header_length) {
+            printf("Failed to write game log header\n");
+            perror(NULL);
+            close(fd);
+            return NULL;
+        }
+        st.st_size = header_length;
+    } else {
+        char existing[header_length];
+        if (pread(fd, existing, header_length, 0) != header_length || memcmp(existing, header, header_length) != 0) {
+            printf("%s is not a game log for these rules\n", path);
+            close(fd);
+            return NULL;
+        }
+        // Whatever a killed server left half written at the end goes, or it would hide the new games
+        ClueGameLogMap_t* map = clue_gamelog_map(path);
+        if (map == NULL) {
+            close(fd);
+            return NULL;
+        }
+        st.st_size = header_length;
+        if (map->num_games > 0) {
+            const ClueGameLogHeader_t* last = map->games[map->num_games - 1];
+            st.st_size = (const char*)(clue_gamelog_records(last) + last->num_records) - map->data;
+        }
+        clue_gamelog_unmap(map);
+        ftruncate(fd, st.st_size);
+    }
+
+    ClueGameLog_t* log = calloc(1, sizeof(ClueGameLog_t));
+    log->fd = fd;
+    atomic_init(&log->offset, st.st_size);
+    return log;
+}
+
+void clue_gamelog_close(ClueGameLog_t* log) {
+    close(log->fd);
+    free(log);
+}
+
+void clue_gamelog_begin(ClueGameLogBuffer_t* buffer, ClueGameLog_t* log, uint64_t game_id, int16_t series_idx, int8_t num_players, uint64_t seed) {
+    if (buffer->log != log) {
+        clue_gamelog_flush(buffer);
+    }
+    buffer->log = log;
+    if (log == NULL) {
+        return;
+    }
+    // A game that never got to CLUE_EVENT_OVER is dropped
+    buffer->length = buffer->game_start;
+    buffer->playing = 1;
+    ClueGameLogHeader_t* header = gamelog_reserve(buffer, sizeof(ClueGameLogHeader_t));
+    header->magic = CLUE_GAMELOG_GAME_MAGIC;
+    header->game_id = game_id;
+    header->series_idx = series_idx;
+    header->num_players = num_players;
+    header->seed = seed;
+    header->winner = -1;
+}
+
+void clue_gamelog_event(ClueGameLogBuffer_t* buffer, const ClueEvent_t* event) {
+    if (!buffer->playing) {
+        return;
+    }
+    int num_records = (event->num_cards + CLUE_GAMELOG_CARDS - 1) / CLUE_GAMELOG_CARDS;
+    num_records = num_records > 0 ? num_records : 1;
+    ClueGameLogRecord_t* record = gamelog_reserve(buffer, num_records * sizeof(ClueGameLogRecord_t));
+    record->type = event->type;
+    record->player = event->player;
+    record->extra = event->type == CLUE_EVENT_BAD_FRAME ? event->frame_type : event->correct;
+    record->num_cards = event->num_cards;
+    for (int i = 0; i < event->num_cards; i++) {
+        if (i > 0 && i % CLUE_GAMELOG_CARDS == 0) {
+            record++;
+            record->type = CLUE_GAMELOG_MORE;
+            record->player = event->player;
+            record->num_cards = event->num_cards - i < CLUE_GAMELOG_CARDS ? event->num_cards - i : CLUE_GAMELOG_CARDS;
+        }
+        record->cards[i % CLUE_GAMELOG_CARDS] = event->cards[i];
+    }
+
+    if (event->type == CLUE_EVENT_OVER) {
+        ClueGameLogHeader_t* header = (ClueGameLogHeader_t*)(buffer->data + buffer->game_start);
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        header->num_records = (buffer->length - buffer->game_start - sizeof(ClueGameLogHeader_t)) / sizeof(ClueGameLogRecord_t);
+        header->end_time = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+        header->winner = event->player;
+        header->aborted = event->aborted;
+        buffer->playing = 0;
+        buffer->game_start = buffer->length;
+        if (buffer->length >= CLUE_GAMELOG_BATCH) {
+            clue_gamelog_flush(buffer);
+        }
+    }
+}
+
+void clue_gamelog_flush(ClueGameLogBuffer_t* buffer) {
+    // Only whole games, the one being played stays behind
+    size_t length = buffer->game_start;
+    if (length == 0) {
+        return;
+    }
+    // Claim the space first, then fill it in whenever. Nobody else will write there
+    off_t offset = atomic_fetch_add(&buffer->log->offset, length);
+    if (pwrite(buffer->log->fd, buffer->data, length, offset) != (ssize_t)length) {
+        printf("Failed to write to the game log\n");
+        perror(NULL);
+    }
+    memmove(buffer->data, buffer->data + length, buffer->length - length);
+    buffer->length -= length;
+    buffer->game_start = 0;
+}
+
+void clue_gamelog_take(ClueGameLogBuffer_t* buffer, ClueGameLogBuffer_t* from) {
+    size_t length = from->game_start;
+    if (length == 0) {
+        return;
+    }
+    // Nobody plays in buffer, so whatever is in it is finished too
+    buffer->log = from->log;
+    memcpy(gamelog_reserve(buffer, length), from->data, length);
+    buffer->game_start = buffer->length;
+    memmove(from->data, from->data + length, from->length - length);
+    from->length -= length;
+    from->game_start = 0;
+}
+
+void clue_gamelog_buffer_free(ClueGameLogBuffer_t* buffer) {
+    if (buffer->log) {
+        clue_gamelog_flush(buffer);
+    }
+    free(buffer->data);
+    memset(buffer, 0, sizeof(ClueGameLogBuffer_t));
+}
+
+ClueGameLogMap_t* clue_gamelog_map(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("Failed to open game log %s\n", path);
+        perror(NULL);
+        return NULL;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    if ((size_t)st.st_size < sizeof(ClueGameLogFileHeader_t)) {
+        printf("%s is not a game log\n", path);
+        close(fd);
+        return NULL;
+    }
+    const char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Failed to map game log %s\n", path);
+        perror(NULL);
+        return NULL;
+    }
+    // Nearly every read is a hop forward
+    madvise((void*)data, st.st_size, MADV_SEQUENTIAL);
+
+    const ClueGameLogFileHeader_t* header = (const ClueGameLogFileHeader_t*)data;
+    if (header->magic != (CLUE_GAMELOG_MAGIC | (uint64_t)CLUE_GAMELOG_VERSION << 56) || header->record_length != sizeof(ClueGameLogRecord_t) || header->header_length > st.st_size) {
+        printf("%s is not a game log this version can read\n", path);
+        munmap((void*)data, st.st_size);
+        return NULL;
+    }
+
+    ClueGameLogMap_t* map = calloc(1, sizeof(ClueGameLogMap_t));
+    map->data = data;
+    map->length = st.st_size;
+    map->header = header;
+    int64_t size_games = 1024;
+    map->games = malloc(size_games * sizeof(ClueGameLogHeader_t*));
+    size_t offset = header->header_length;
+    while (offset + sizeof(ClueGameLogHeader_t) <= map->length) {
+        const ClueGameLogHeader_t* game = (const ClueGameLogHeader_t*)(data + offset);
+        size_t game_length = sizeof(ClueGameLogHeader_t) + (size_t)game->num_records * sizeof(ClueGameLogRecord_t);
+        if (game->magic != CLUE_GAMELOG_GAME_MAGIC || game->num_records < 0 || offset + game_length > map->length) {
+            break;
+        }
+        if (map->num_games == size_games) {
+            size_games *= 2;
+            map->games = realloc(map->games, size_games * sizeof(ClueGameLogHeader_t*));
+        }
+        map->games[map->num_games++] = game;
+        offset += game_length;
+    }
+    return map;
+}
+
+void clue_gamelog_unmap(ClueGameLogMap_t* map) {
+    munmap((void*)map->data, map->length);
+    free(map->games);
+    free(map);
+}
+
+static void* gamelog_reserve(ClueGameLogBuffer_t* buffer, size_t length) {
+    if (buffer->length + length > buffer->size) {
+        buffer->size = buffer->size ? buffer->size : CLUE_GAMELOG_BATCH * 2;
+        while (buffer->length + length > buffer->size) {
+            buffer->size *= 2;
+        }
+        buffer->data = realloc(buffer->data, buffer->size);
+    }
+    void* reserved = buffer->data + buffer->length;
+    memset(reserved, 0, length);
+    buffer->length += length;
+    return reserved;
+}
+
+static int gamelog_file_header(const ClueRules_t* rules, char* out) {
+    int length = (sizeof(ClueGameLogFileHeader_t) + rules->num_categories * sizeof(int16_t) + 15) / 16 * 16;
+    if (out == NULL) {
+        return length;
+    }
+    memset(out, 0, length);
+    ClueGameLogFileHeader_t* header = (ClueGameLogFileHeader_t*)out;
+    header->magic = CLUE_GAMELOG_MAGIC | (uint64_t)CLUE_GAMELOG_VERSION << 56;
+    header->header_length = length;
+    header->record_length = sizeof(ClueGameLogRecord_t);
+    header->num_categories = rules->num_categories;
+    memcpy(header->num_cards, rules->num_cards, rules->num_categories * sizeof(int16_t));
+    return length;
+}
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "clue/codec.h"
+#include "clue/engine.h"
+
+typedef struct {
+    ClueBot_t* bots;
+    int num_bots;
+    ClueIO_t io; // Whatever the game had before, events still go there
+} BotsIO_t;
+
+static void bots_send(void* ctx, int player_id, int8_t type, const void* data, int32_t data_length) {
+    BotsIO_t* bots_io = ctx;
+    if (player_id != CLUE_EVERYONE) {
+        ClueBot_t* bot = &bots_io->bots[player_id];
+        bot->frame(bot->ctx, type, data, data_length);
+        return;
+    }
+    for (int i = 0; i < bots_io->num_bots; i++) {
+        ClueBot_t* bot = &bots_io->bots[i];
+        bot->frame(bot->ctx, type, data, data_length);
+    }
+}
+
+static void bots_event(void* ctx, const ClueEvent_t* event) {
+    BotsIO_t* bots_io = ctx;
+    bots_io->io.event(bots_io->io.ctx, event);
+}
+
+void clue_game_play(ClueGame_t* game, ClueBot_t* bots) {
+    int num_categories = game->rules->num_categories;
+
+    // Frames go straight to the bots for the duration of the game
+    BotsIO_t bots_io = {};
+    bots_io.bots = bots;
+    bots_io.num_bots = game->num_players;
+    bots_io.io = game->io;
+    game->io.ctx = &bots_io;
+    game->io.send = bots_send;
+    game->io.multicast = NULL; // bots_send is all we need
+    game->io.event = bots_io.io.event ? bots_event : NULL;
+
+    // Same handshake a networked bot would get
+    int frame_len;
+    char* frame = clue_rules_frame(game->rules, &frame_len);
+    RulesFrame_t* rules = (RulesFrame_t*)CLUE_PAYLOAD(frame);
+    for (int i = 0; i < game->num_players; i++) {
+        rules->player_id = i;
+        bots[i].frame(bots[i].ctx, FRAME_TYPE_RULES, rules, frame_len - sizeof(Frame_t));
+    }
+    free(frame);
+
+    // Bot seeds follow from the game's, so a replayed game plays out the same way
+    for (int i = 0; i < game->num_players; i++) {
+        if (bots[i].seed) {
+            bots[i].seed(bots[i].ctx, clue_rng_mix(game->seed, i));
+        }
+    }
+
+    clue_game_start(game);
+    int response_len = num_categories * sizeof(int16_t);
+    char response_buffer[response_len];
+    char query_buffer[sizeof(QueryFrame_t) + response_len];
+    while (game->state != CLUE_STATE_OVER) {
+        int player_id = clue_game_waiting_on(game);
+        ClueBot_t* bot = &bots[player_id];
+        if (game->state == CLUE_STATE_TURN) {
+            int8_t type = bot->turn(bot->ctx, (TurnResponseFrame_t*)response_buffer);
+            clue_game_submit(game, player_id, type, response_buffer, response_len);
+        } else {
+            QueryFrame_t* query = (QueryFrame_t*)query_buffer;
+            query->player_id = player_id;
+            query->_reserved = 0;
+            memcpy(query->suggestion, game->suggestion, response_len);
+            QueryResponseFrame_t response = {};
+            bot->query(bot->ctx, query, &response);
+            clue_game_submit(game, player_id, FRAME_TYPE_QUERY_RESPONSE, &response, sizeof(response));
+        }
+    }
+    game->io = bots_io.io;
+}
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "clue/codec.h"
+#include "clue/engine.h"
+
+// Randy from clients/randy, minus the sockets and the printing
+
+typedef struct {
+    int player_id;
+    int num_categories;
+    int16_t* num_cards_in_category;
+    int hand_size;
+    int16_t* hand;
+    int turns_played;
+    ClueRng_t rng;
+} Randy_t;
+
+static void randy_frame(void* ctx, int8_t type, const void* data, int32_t data_length) {
+    Randy_t* randy = ctx;
+    if (type == FRAME_TYPE_RULES) {
+        ClueRulesView_t rules;
+        clue_rules_view(data, data_length, &rules);
+        randy->player_id = rules.player_id;
+        randy->num_categories = rules.num_categories;
+        randy->num_cards_in_category = realloc(randy->num_cards_in_category, rules.num_categories * sizeof(int16_t));
+        memcpy(randy->num_cards_in_category, rules.num_cards_in_category, rules.num_categories * sizeof(int16_t));
+    } else if (type == FRAME_TYPE_START) {
+        // Since we are playing randomly, we don't care about the meta information, just our hand
+        ClueStartView_t start;
+        clue_start_view(data, data_length, &start);
+        randy->hand_size = start.your_hand_size;
+        randy->hand = realloc(randy->hand, randy->hand_size * sizeof(int16_t));
+        memcpy(randy->hand, start.your_hand, randy->hand_size * sizeof(int16_t));
+        randy->turns_played = 0;
+    }
+    // Randy does not care about anything else
+}
+
+static int8_t randy_turn(void* ctx, TurnResponseFrame_t* response) {
+    Randy_t* randy = ctx;
+    randy->turns_played++;
+
+    // Same layout whether we suggest or guess, the only difference is the frame type
+    int base_idx = 0;
+    for (int i = 0; i < randy->num_categories; i++) {
+        response->suggestion[i] = clue_rng_below(&randy->rng, randy->num_cards_in_category[i]) + base_idx;
+        base_idx += randy->num_cards_in_category[i];
+    }
+    if (randy->turns_played > 5) {
+        // Yolo guess since the game probably isn't ending
+        return FRAME_TYPE_SOLVE_ATTEMPT;
+    }
+    return FRAME_TYPE_TURN_RESPONSE;
+}
+
+static void randy_query(void* ctx, const QueryFrame_t* query, QueryResponseFrame_t* response) {
+    Randy_t* randy = ctx;
+
+    // Ok, it's possible the entire suggestion is in our hand, so build a list
+    int16_t cards_held[randy->num_categories];
+    int num_cards_held = 0;
+    for (int i = 0; i < randy->hand_size; i++) {
+        for (int j = 0; j < randy->num_categories; j++) {
+            if (randy->hand[i] == query->suggestion[j]) {
+                cards_held[num_cards_held++] = randy->hand[i];
+                break;
+            }
+        }
+    }
+    // Now we can be random. The game only asks when we have something
+    response->card_id = num_cards_held > 0 ? cards_held[clue_rng_below(&randy->rng, num_cards_held)] : -1;
+}
+
+static void randy_seed(void* ctx, uint64_t seed) {
+    Randy_t* randy = ctx;
+    clue_rng_seed(&randy->rng, seed);
+}
+
+static void randy_free(void* ctx) {
+    Randy_t* randy = ctx;
+    free(randy->num_cards_in_category);
+    free(randy->hand);
+    free(randy);
+}
+
+ClueBot_t clue_bot_randy() {
+    ClueBot_t bot = {};
+    Randy_t* randy = calloc(1, sizeof(Randy_t));
+    clue_rng_seed(&randy->rng, clue_seed());
+    bot.ctx = randy;
+    bot.frame = randy_frame;
+    bot.turn = randy_turn;
+    bot.query = randy_query;
+    bot.seed = randy_seed;
+    bot.free = randy_free;
+    return bot;
+}
@@ -0,0 +1,408 @@
+#define _GNU_SOURCE // qsort_r
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "clue/engine.h"
+#include "clue/rng.h"
+#include "clue/sample.h"
+
+#define SAMPLE_REPAIR_MOVES 200000 // Moves we are willing to spend getting rid of broken clauses
+#define SAMPLE_PENALTY 0.25 // Each broken clause makes a deal this much less likely to be walked through
+#define SAMPLE_Z 1.96 // 95% confidence
+
+// One chain. Slots are the players, then one per category for the solution
+typedef struct {
+    const ClueDeduce_t* deduce;
+    ClueRng_t rng;
+    int num_samples; // Asked for
+    int recorded; // Landed on a consistent deal, the only ones that count
+    int burn_in;
+    int thin;
+    int num_slots;
+    int16_t* category; // Card -> category
+    int8_t* owner; // Card -> slot
+    int16_t* free_cards; // Cards nobody is known to hold, the only ones that move
+    int num_free;
+    int16_t* capacity; // By slot, how many free cards it still takes
+    int16_t* load;
+    int8_t* visited;
+    int violations; // Clauses and misses the current deal breaks
+    uint32_t* held; // [player * num_cards + card]
+    uint32_t* solution; // By card
+    int16_t* solutions; // num_categories per sample
+    int ok;
+    pthread_t thread;
+} Sampler_t;
+
+static void* sampler_main(void* arg); // Deal, repair, walk, count
+static int sampler_init(Sampler_t* sampler); // Slots and capacities from the deduce tables. 0 if they don't add up
+static int sampler_allowed(Sampler_t* sampler, int16_t card, int slot);
+static int sampler_place(Sampler_t* sampler, int16_t card); // Augmenting path, may move other cards to make room
+static int sampler_violations(Sampler_t* sampler);
+static void sampler_step(Sampler_t* sampler); // Propose one swap or rotation
+static void sampler_record(Sampler_t* sampler, int sample);
+static void sampler_free(Sampler_t* sampler);
+static int compare_solutions(const void* left, const void* right, void* arg); // qsort_r over num_categories int16_t
+
+ClueSample_t* clue_sample(const ClueDeduce_t* deduce, const ClueSampleConfig_t* config) {
+    int num_players = deduce->num_players;
+    int num_cards = deduce->num_cards;
+    int num_categories = deduce->num_categories;
+    ClueSample_t* sample = calloc(1, sizeof(ClueSample_t));
+    sample->num_players = num_players;
+    sample->num_cards = num_cards;
+    sample->num_categories = num_categories;
+    sample->solution = calloc(num_cards, sizeof(double));
+    sample->solution_low = calloc(num_cards, sizeof(double));
+    sample->solution_high = calloc(num_cards, sizeof(double));
+    sample->held = calloc(num_players * num_cards, sizeof(double));
+    sample->best = malloc(num_categories * sizeof(int16_t));
+    for (int i = 0; i < num_categories; i++) {
+        sample->best[i] = -1;
+    }
+    if (num_players == 0 || deduce->inconsistent || config->num_samples <= 0) {
+        return sample;
+    }
+
+    int num_threads = config->num_threads > 0 ? config->num_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_threads > config->num_samples) {
+        num_threads = config->num_samples;
+    }
+    ClueRng_t rng;
+    clue_rng_seed(&rng, config->seed ? config->seed : clue_seed());
+    Sampler_t* samplers = calloc(num_threads, sizeof(Sampler_t));
+    for (int i = 0; i < num_threads; i++) {
+        Sampler_t* sampler = &samplers[i];
+        sampler->deduce = deduce;
+        sampler->rng = rng;
+        clue_rng_jump(&rng); // Next thread gets the next stream
+        sampler->num_samples = config->num_samples / num_threads + (i < config->num_samples % num_threads);
+        sampler->burn_in = config->burn_in;
+        sampler->thin = config->thin;
+        pthread_create(&sampler->thread, NULL, sampler_main, sampler);
+    }
+
+    // Add up whatever every chain saw
+    int total = 0;
+    uint32_t* held = calloc(num_players * num_cards, sizeof(uint32_t));
+    uint32_t* solution = calloc(num_cards, sizeof(uint32_t));
+    int16_t* solutions = malloc(config->num_samples * num_categories * sizeof(int16_t));
+    for (int i = 0; i < num_threads; i++) {
+        Sampler_t* sampler = &samplers[i];
+        pthread_join(sampler->thread, NULL);
+        if (sampler->ok) {
+            for (int j = 0; j < num_players * num_cards; j++) {
+                held[j] += sampler->held[j];
+            }
+            for (int j = 0; j < num_cards; j++) {
+                solution[j] += sampler->solution[j];
+            }
+            memcpy(&solutions[total * num_categories], sampler->solutions, sampler->recorded * num_categories * sizeof(int16_t));
+            total += sampler->recorded;
+        }
+        sampler_free(sampler);
+    }
+    free(samplers);
+
+    sample->num_samples = total;
+    if (total > 0) {
+        double n = total;
+        double z2 = SAMPLE_Z * SAMPLE_Z;
+        for (int i = 0; i < num_players * num_cards; i++) {
+            sample->held[i] = held[i] / n;
+        }
+        for (int i = 0; i < num_cards; i++) {
+            // Wilson score interval, which behaves near 0 and 1 where most cards end up. Samples
+            // from one chain are correlated, so thin more if the bounds have to be honest
+            double p = solution[i] / n;
+            double center = (p + z2 / (2 * n)) / (1 + z2 / n);
+            double half = SAMPLE_Z * sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+            sample->solution[i] = p;
+            sample->solution_low[i] = center - half < 0 ? 0 : center - half;
+            sample->solution_high[i] = center + half > 1 ? 1 : center + half;
+        }
+
+        // Most common whole solution: sort them and find the longest run
+        size_t width = num_categories;
+        qsort_r(solutions, total, width * sizeof(int16_t), compare_solutions, &width);
+        int best_run = 0;
+        for (int i = 0; i < total;) {
+            int run = 1;
+            while (i + run < total && compare_solutions(&solutions[i * width], &solutions[(i + run) * width], &width) == 0) {
+                run++;
+            }
+            if (run > best_run) {
+                best_run = run;
+                memcpy(sample->best, &solutions[i * width], width * sizeof(int16_t));
+            }
+            i += run;
+        }
+        sample->best_probability = best_run / n;
+    }
+    free(held);
+    free(solution);
+    free(solutions);
+    return sample;
+}
+
+void clue_sample_free(ClueSample_t* sample) {
+    free(sample->solution);
+    free(sample->solution_low);
+    free(sample->solution_high);
+    free(sample->held);
+    free(sample->best);
+    free(sample);
+}
+
+static void* sampler_main(void* arg) {
+    Sampler_t* sampler = arg;
+    if (!sampler_init(sampler)) {
+        return NULL;
+    }
+
+    // Any deal that fits the hand sizes and the known cards, in a random order so every chain
+    // starts somewhere different
+    for (int i = sampler->num_free - 1; i > 0; i--) {
+        int j = clue_rng_below(&sampler->rng, i + 1);
+        int16_t tmp = sampler->free_cards[i];
+        sampler->free_cards[i] = sampler->free_cards[j];
+        sampler->free_cards[j] = tmp;
+    }
+    for (int i = 0; i < sampler->num_free; i++) {
+        memset(sampler->visited, 0, sampler->num_slots);
+        if (!sampler_place(sampler, sampler->free_cards[i])) {
+            return NULL;
+        }
+    }
+
+    // Then swap until the clauses hold too
+    sampler->violations = sampler_violations(sampler);
+    for (int i = 0; i < SAMPLE_REPAIR_MOVES && sampler->violations > 0; i++) {
+        sampler_step(sampler);
+    }
+    if (sampler->violations > 0) {
+        return NULL;
+    }
+
+    int num_free = sampler->num_free;
+    int burn_in = sampler->burn_in > 0 ? sampler->burn_in : 20 * num_free;
+    int thin = sampler->thin > 0 ? sampler->thin : 2 * num_free;
+    for (int i = 0; i < burn_in; i++) {
+        sampler_step(sampler);
+    }
+    for (int sample = 0; sample < sampler->num_samples; sample++) {
+        // Only consistent deals count. The walk goes through broken ones to get between them, and a
+        // sample that lands on one is dropped. Waiting for the next consistent deal instead would
+        // favor the ones right next to broken deals
+        for (int i = 0; i < thin; i++) {
+            sampler_step(sampler);
+        }
+        if (sampler->violations == 0) {
+            sampler_record(sampler, sampler->recorded++);
+        }
+    }
+    sampler->ok = 1;
+    return NULL;
+}
+
+static int sampler_init(Sampler_t* sampler) {
+    const ClueDeduce_t* deduce = sampler->deduce;
+    int num_players = deduce->num_players;
+    int num_cards = deduce->num_cards;
+    int words = deduce->words;
+    sampler->num_slots = num_players + deduce->num_categories;
+    sampler->category = malloc(num_cards * sizeof(int16_t));
+    sampler->owner = malloc(num_cards * sizeof(int8_t));
+    sampler->free_cards = malloc(num_cards * sizeof(int16_t));
+    sampler->capacity = calloc(sampler->num_slots, sizeof(int16_t));
+    sampler->load = calloc(sampler->num_slots, sizeof(int16_t));
+    sampler->visited = malloc(sampler->num_slots);
+    sampler->held = calloc(num_players * num_cards, sizeof(uint32_t));
+    sampler->solution = calloc(num_cards, sizeof(uint32_t));
+    sampler->solutions = malloc(sampler->num_samples * deduce->num_categories * sizeof(int16_t));
+
+    for (int i = 0; i < num_players; i++) {
+        sampler->capacity[i] = deduce->row_sizes[i];
+    }
+    for (int i = 0; i < deduce->num_categories; i++) {
+        sampler->capacity[num_players + i] = 1;
+    }
+    int16_t base_idx = 0;
+    for (int i = 0; i < deduce->num_categories; i++) {
+        for (int16_t card = base_idx; card < base_idx + deduce->num_cards_in_category[i] && card < num_cards; card++) {
+            sampler->category[card] = i;
+        }
+        base_idx += deduce->num_cards_in_category[i];
+    }
+
+    // Known cards stay put for the whole walk
+    for (int16_t card = 0; card < num_cards; card++) {
+        sampler->owner[card] = -1;
+        for (int row = 0; row <= num_players; row++) {
+            if (deduce->known[row * words + card / 64] & (1ULL << (card % 64))) {
+                sampler->owner[card] = row < num_players ? row : num_players + sampler->category[card];
+            }
+        }
+        if (sampler->owner[card] == -1) {
+            sampler->free_cards[sampler->num_free++] = card;
+        } else if (--sampler->capacity[sampler->owner[card]] < 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int sampler_allowed(Sampler_t* sampler, int16_t card, int slot) {
+    const ClueDeduce_t* deduce = sampler->deduce;
+    int row = slot;
+    if (slot >= deduce->num_players) {
+        if (slot - deduce->num_players != sampler->category[card]) {
+            return 0;
+        }
+        row = deduce->num_players;
+    }
+    return (deduce->possible[row * deduce->words + card / 64] >> (card % 64)) & 1;
+}
+
+static int sampler_place(Sampler_t* sampler, int16_t card) {
+    int num_slots = sampler->num_slots;
+    int first = clue_rng_below(&sampler->rng, num_slots);
+    for (int i = 0; i < num_slots; i++) {
+        int slot = (first + i) % num_slots;
+        if (sampler->visited[slot] || !sampler_allowed(sampler, card, slot)) {
+            continue;
+        }
+        sampler->visited[slot] = 1;
+        if (sampler->load[slot] < sampler->capacity[slot]) {
+            sampler->owner[card] = slot;
+            sampler->load[slot]++;
+            return 1;
+        }
+        // Full, but maybe one of its cards can go somewhere else
+        for (int j = 0; j < sampler->num_free; j++) {
+            int16_t other = sampler->free_cards[j];
+            if (other != card && sampler->owner[other] == slot) {
+                sampler->load[slot]--;
+                if (sampler_place(sampler, other)) {
+                    sampler->owner[card] = slot;
+                    sampler->load[slot]++;
+                    return 1;
+                }
+                sampler->owner[other] = slot;
+                sampler->load[slot]++;
+            }
+        }
+    }
+    return 0;
+}
+
+static int sampler_violations(Sampler_t* sampler) {
+    const ClueDeduce_t* deduce = sampler->deduce;
+    int violations = 0;
+    for (int i = 0; i < deduce->num_clauses; i++) {
+        const uint64_t* bits = &deduce->clause_bits[i * deduce->words];
+        int satisfied = 0;
+        for (int w = 0; w < deduce->words && !satisfied; w++) {
+            for (uint64_t left = bits[w]; left; left &= left - 1) {
+                if (sampler->owner[w * 64 + __builtin_ctzll(left)] == deduce->clause_players[i]) {
+                    satisfied = 1;
+                    break;
+                }
+            }
+        }
+        violations += !satisfied;
+    }
+    for (int i = 0; i < deduce->num_misses; i++) {
+        const int16_t* cards = &deduce->misses[i * deduce->num_categories];
+        int in_solution = 0;
+        for (int j = 0; j < deduce->num_categories; j++) {
+            in_solution += sampler->owner[cards[j]] >= deduce->num_players;
+        }
+        violations += in_solution == deduce->num_categories;
+    }
+    return violations;
+}
+
+static void sampler_step(Sampler_t* sampler) {
+    if (sampler->num_free < 2) {
+        return;
+    }
+    // Swap two cards, or rotate three. Swaps alone can't get everywhere: a solution card can only
+    // trade places with a card of its own category, which the player holding that might not be
+    // allowed to give up for it. Picking the cards in a random order makes every move exactly as
+    // likely as the one undoing it
+    int num_moved = sampler->num_free >= 3 && clue_rng_below(&sampler->rng, 2) ? 3 : 2;
+    int16_t cards[3];
+    int8_t slots[3];
+    for (int i = 0; i < num_moved; i++) {
+        cards[i] = sampler->free_cards[clue_rng_below(&sampler->rng, sampler->num_free)];
+        slots[i] = sampler->owner[cards[i]];
+        for (int j = 0; j < i; j++) {
+            if (slots[i] == slots[j]) {
+                return;
+            }
+        }
+    }
+    for (int i = 0; i < num_moved; i++) {
+        if (!sampler_allowed(sampler, cards[i], slots[(i + 1) % num_moved])) {
+            return;
+        }
+    }
+    for (int i = 0; i < num_moved; i++) {
+        sampler->owner[cards[i]] = slots[(i + 1) % num_moved];
+    }
+    int violations = sampler_violations(sampler);
+
+    // Metropolis: deals are weighted by SAMPLE_PENALTY per broken clause, so among the consistent
+    // ones, which are the only ones recorded, every deal is equally likely. Consistent deals can be
+    // islands that no single move connects, walking through broken ones is how we get across
+    int accept = violations <= sampler->violations;
+    if (!accept) {
+        double weight = 1;
+        for (int i = sampler->violations; i < violations; i++) {
+            weight *= SAMPLE_PENALTY;
+        }
+        accept = clue_rng_double(&sampler->rng) < weight;
+    }
+    if (accept) {
+        sampler->violations = violations;
+    } else {
+        for (int i = 0; i < num_moved; i++) {
+            sampler->owner[cards[i]] = slots[i];
+        }
+    }
+}
+
+static void sampler_record(Sampler_t* sampler, int sample) {
+    const ClueDeduce_t* deduce = sampler->deduce;
+    int num_players = deduce->num_players;
+    int16_t* solution = &sampler->solutions[sample * deduce->num_categories];
+    for (int16_t card = 0; card < deduce->num_cards; card++) {
+        int slot = sampler->owner[card];
+        if (slot < num_players) {
+            sampler->held[slot * deduce->num_cards + card]++;
+        } else {
+            sampler->solution[card]++;
+            solution[slot - num_players] = card;
+        }
+    }
+}
+
+static void sampler_free(Sampler_t* sampler) {
+    free(sampler->category);
+    free(sampler->owner);
+    free(sampler->free_cards);
+    free(sampler->capacity);
+    free(sampler->load);
+    free(sampler->visited);
+    free(sampler->held);
+    free(sampler->solution);
+    free(sampler->solutions);
+}
+
+static int compare_solutions(const void* left, const void* right, void* arg) {
+    return memcmp(left, right, *(size_t*)arg * sizeof(int16_t));
+}
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+
+#include "clue/deduce.h"
+#include "clue/engine.h"
+
+// Randy with a notebook: suggests only cards that might still be in the solution, and only tries
+// to solve once the deduction engine has pinned every category down
+
+typedef struct {
+    ClueDeduce_t* deduce;
+    ClueRng_t rng;
+} Sleuth_t;
+
+static void sleuth_frame(void* ctx, int8_t type, const void* data, int32_t data_length) {
+    Sleuth_t* sleuth = ctx;
+    clue_deduce_frame(sleuth->deduce, type, data, data_length);
+}
+
+static int8_t sleuth_turn(void* ctx, TurnResponseFrame_t* response) {
+    Sleuth_t* sleuth = ctx;
+    ClueDeduce_t* deduce = sleuth->deduce;
+    int16_t solution[deduce->num_categories];
+    int found = clue_deduce_solution(deduce, solution);
+    if (found == deduce->num_categories && !deduce->inconsistent) {
+        for (int i = 0; i < deduce->num_categories; i++) {
+            response->suggestion[i] = solution[i];
+        }
+        return FRAME_TYPE_SOLVE_ATTEMPT;
+    }
+
+    // Categories we already have go in as is, so any show has to be about the others
+    int base_idx = 0;
+    for (int i = 0; i < deduce->num_categories; i++) {
+        int16_t num_cards = deduce->num_cards_in_category[i];
+        int16_t pick = base_idx + clue_rng_below(&sleuth->rng, num_cards);
+        if (solution[i] != -1) {
+            pick = solution[i];
+        } else if (!deduce->inconsistent) {
+            // Random card that might still be it
+            int num_candidates = 0;
+            for (int16_t card = base_idx; card < base_idx + num_cards; card++) {
+                if (clue_deduce_holds(deduce, CLUE_DEDUCE_SOLUTION, card) == CLUE_DEDUCE_MAYBE && clue_rng_below(&sleuth->rng, ++num_candidates) == 0) {
+                    pick = card;
+                }
+            }
+        }
+        response->suggestion[i] = pick;
+        base_idx += num_cards;
+    }
+    if (deduce->inconsistent) {
+        // Somebody broke the rules and the notebook is useless, go down guessing like Randy would
+        return FRAME_TYPE_SOLVE_ATTEMPT;
+    }
+    return FRAME_TYPE_TURN_RESPONSE;
+}
+
+static void sleuth_query(void* ctx, const QueryFrame_t* query, QueryResponseFrame_t* response) {
+    Sleuth_t* sleuth = ctx;
+    ClueDeduce_t* deduce = sleuth->deduce;
+    int num_held = 0;
+    response->card_id = -1;
+    for (int i = 0; i < deduce->num_categories; i++) {
+        if (clue_deduce_holds(deduce, deduce->player_id, query->suggestion[i]) == CLUE_DEDUCE_YES && clue_rng_below(&sleuth->rng, ++num_held) == 0) {
+            response->card_id = query->suggestion[i];
+        }
+    }
+}
+
+static void sleuth_seed(void* ctx, uint64_t seed) {
+    Sleuth_t* sleuth = ctx;
+    clue_rng_seed(&sleuth->rng, seed);
+}
+
+static void sleuth_free(void* ctx) {
+    Sleuth_t* sleuth = ctx;
+    clue_deduce_free(sleuth->deduce);
+    free(sleuth);
+}
+
+ClueBot_t clue_bot_sleuth() {
+    ClueBot_t bot = {};
+    Sleuth_t* sleuth = calloc(1, sizeof(Sleuth_t));
+    sleuth->deduce = clue_deduce_new();
+    clue_rng_seed(&sleuth->rng, clue_seed());
+    bot.ctx = sleuth;
+    bot.frame = sleuth_frame;
+    bot.turn = sleuth_turn;
+    bot.query = sleuth_query;
+    bot.seed = sleuth_seed;
+    bot.free = sleuth_free;
+    return bot;
+}
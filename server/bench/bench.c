@@ -0,0 +1,373 @@
+// Microbenchmarks for the code every game goes through. engine.c and settings.c are compiled right
+// into this file, so their static functions can be timed on their own instead of through a game.
+// Every benchmark is timed in batches long enough for the clock not to matter, and the median of
+// BENCH_REPEATS batches is what counts, so one unlucky context switch doesn't move the result.
+// Run it with `bash build.sh bench`, which also writes bench/results.json
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../libclue/src/engine.c"
+#include "../src/settings.c"
+
+#define BENCH_REPEATS 21
+#define BENCH_MIN_BATCH 10000000 // Nanoseconds a batch has to take before we trust the clock
+#define BENCH_STANDARD 0 // Classic Clue: 6 suspects, 6 weapons, 9 rooms, 6 players
+#define BENCH_LARGE 1 // 8 categories of 256 cards, 32 players
+
+typedef struct {
+    const char* name;
+    int deck; // BENCH_STANDARD or BENCH_LARGE
+    void* (*setup)(ClueRules_t* rules, int num_players);
+    void (*run)(void* ctx, int64_t iterations);
+    void (*teardown)(void* ctx);
+} Bench_t;
+
+typedef struct {
+    ClueRules_t* rules;
+    int num_players;
+    ClueRng_t rng;
+    int16_t* deck;
+    int deck_len;
+    CluePlayer_t player; // Dealt a fair share of deck
+    int16_t cards[1024]; // Random card IDs to look up
+    int16_t suggestion[64]; // One card per category
+    int16_t* scratch;
+    char* start_frame;
+    int start_size;
+    int8_t* order;
+    int16_t* hand_sizes;
+    const char** names;
+    int8_t* name_lengths;
+    char* settings_path;
+} BenchCtx_t;
+
+static volatile uint64_t sink; // Results go here so the compiler can't throw the work away
+
+static int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static ClueRules_t* make_rules(int deck) {
+    ClueRules_t* rules = calloc(1, sizeof(ClueRules_t));
+    static int16_t standard[] = { 6, 6, 9 };
+    rules->num_categories = deck == BENCH_STANDARD ? 3 : 8;
+    rules->num_cards = malloc(rules->num_categories * sizeof(int16_t));
+    for (int i = 0; i < rules->num_categories; i++) {
+        rules->num_cards[i] = deck == BENCH_STANDARD ? standard[i] : 256;
+        rules->total_cards += rules->num_cards[i];
+    }
+    rules->card_names = malloc(rules->total_cards * sizeof(char*));
+    for (int i = 0; i < rules->total_cards; i++) {
+        rules->card_names[i] = malloc(32);
+        snprintf(rules->card_names[i], 32, "Card number %d", i);
+    }
+    return rules;
+}
+
+static void free_rules(ClueRules_t* rules) {
+    for (int i = 0; i < rules->total_cards; i++) {
+        free(rules->card_names[i]);
+    }
+    free(rules->card_names);
+    free(rules->num_cards);
+    free(rules);
+}
+
+static void* setup_common(ClueRules_t* rules, int num_players) {
+    BenchCtx_t* ctx = calloc(1, sizeof(BenchCtx_t));
+    ctx->rules = rules;
+    ctx->num_players = num_players;
+    clue_rng_seed(&ctx->rng, 1);
+    ctx->deck_len = rules->total_cards;
+    ctx->deck = malloc(ctx->deck_len * sizeof(int16_t));
+    ctx->scratch = malloc(ctx->deck_len * sizeof(int16_t));
+    for (int i = 0; i < ctx->deck_len; i++) {
+        ctx->deck[i] = i;
+    }
+    shuffle(ctx->deck, ctx->deck_len, sizeof(int16_t), &ctx->rng);
+
+    // One player's share, as bits and as a list
+    int num_words = (rules->total_cards + 63) / 64;
+    ctx->player.hand_bits = calloc(num_words, sizeof(uint64_t));
+    ctx->player.hand = malloc(ctx->deck_len * sizeof(int16_t));
+    ctx->player.hand_size = ctx->deck_len / num_players;
+    for (int i = 0; i < ctx->player.hand_size; i++) {
+        ctx->player.hand[i] = ctx->deck[i];
+        ctx->player.hand_bits[ctx->deck[i] / 64] |= (uint64_t)1 << (ctx->deck[i] % 64);
+    }
+    for (int i = 0; i < 1024; i++) {
+        ctx->cards[i] = clue_rng_below(&ctx->rng, rules->total_cards);
+    }
+    int base_idx = 0;
+    for (int i = 0; i < rules->num_categories; i++) {
+        ctx->suggestion[rules->num_categories - 1 - i] = base_idx + clue_rng_below(&ctx->rng, rules->num_cards[i]);
+        base_idx += rules->num_cards[i];
+    }
+
+    // Everything clue_encode_start needs
+    ctx->order = malloc(num_players * sizeof(int8_t));
+    ctx->hand_sizes = malloc(num_players * sizeof(int16_t));
+    ctx->names = malloc(num_players * sizeof(char*));
+    ctx->name_lengths = malloc(num_players * sizeof(int8_t));
+    for (int i = 0; i < num_players; i++) {
+        ctx->order[i] = i;
+        ctx->hand_sizes[i] = ctx->player.hand_size;
+        ctx->names[i] = "Benchmark bot";
+        ctx->name_lengths[i] = strlen(ctx->names[i]);
+    }
+    ctx->start_size = clue_encode_start(NULL, 0, NULL, ctx->player.hand_size, num_players, ctx->order, ctx->hand_sizes, ctx->names, ctx->name_lengths);
+    ctx->start_frame = malloc(ctx->start_size);
+    return ctx;
+}
+
+static void teardown_common(void* arg) {
+    BenchCtx_t* ctx = arg;
+    if (ctx->settings_path) {
+        unlink(ctx->settings_path);
+        free(ctx->settings_path);
+    }
+    free(ctx->deck);
+    free(ctx->scratch);
+    free(ctx->player.hand);
+    free(ctx->player.hand_bits);
+    free(ctx->order);
+    free(ctx->hand_sizes);
+    free(ctx->names);
+    free(ctx->name_lengths);
+    free(ctx->start_frame);
+    free(ctx);
+}
+
+static void run_shuffle(void* arg, int64_t iterations) {
+    BenchCtx_t* ctx = arg;
+    for (int64_t i = 0; i < iterations; i++) {
+        shuffle(ctx->deck, ctx->deck_len, sizeof(int16_t), &ctx->rng);
+    }
+    sink += ctx->deck[0];
+}
+
+static void run_player_has_card(void* arg, int64_t iterations) {
+    BenchCtx_t* ctx = arg;
+    uint64_t found = 0;
+    for (int64_t i = 0; i < iterations; i++) {
+        found += clue_player_has_card(&ctx->player, ctx->cards[i & 1023]);
+    }
+    sink += found;
+}
+
+static void run_hand_sort_qsort(void* arg, int64_t iterations) {
+    // How hands used to be sorted
+    BenchCtx_t* ctx = arg;
+    for (int64_t i = 0; i < iterations; i++) {
+        memcpy(ctx->scratch, ctx->player.hand, ctx->player.hand_size * sizeof(int16_t));
+        qsort(ctx->scratch, ctx->player.hand_size, sizeof(int16_t), qsort_int16s);
+    }
+    sink += ctx->scratch[0];
+}
+
+static void run_hand_sort_bits(void* arg, int64_t iterations) {
+    // How clue_game_start reads a sorted hand off the bits
+    BenchCtx_t* ctx = arg;
+    int num_words = (ctx->rules->total_cards + 63) / 64;
+    for (int64_t i = 0; i < iterations; i++) {
+        int hand_size = 0;
+        for (int j = 0; j < num_words; j++) {
+            for (uint64_t bits = ctx->player.hand_bits[j]; bits; bits &= bits - 1) {
+                ctx->scratch[hand_size++] = j * 64 + __builtin_ctzll(bits);
+            }
+        }
+    }
+    sink += ctx->scratch[0];
+}
+
+static void run_rules_frame(void* arg, int64_t iterations) {
+    BenchCtx_t* ctx = arg;
+    for (int64_t i = 0; i < iterations; i++) {
+        int frame_len;
+        char* frame = clue_rules_frame(ctx->rules, &frame_len);
+        sink += frame_len;
+        free(frame);
+    }
+}
+
+static void run_start_frames(void* arg, int64_t iterations) {
+    // One personalized frame per player, the way clue_game_start sends them
+    BenchCtx_t* ctx = arg;
+    for (int64_t i = 0; i < iterations; i++) {
+        for (int j = 0; j < ctx->num_players; j++) {
+            sink += clue_encode_start(ctx->start_frame, ctx->start_size, ctx->player.hand, ctx->player.hand_size, ctx->num_players, ctx->order, ctx->hand_sizes, ctx->names, ctx->name_lengths);
+        }
+    }
+}
+
+static void run_check_suggestion(void* arg, int64_t iterations) {
+    BenchCtx_t* ctx = arg;
+    int num_categories = ctx->rules->num_categories;
+    int16_t suggestion[num_categories];
+    uint64_t legal = 0;
+    for (int64_t i = 0; i < iterations; i++) {
+        // Fresh and out of order every time, as it comes from a client
+        memcpy(suggestion, ctx->suggestion, sizeof(suggestion));
+        legal += check_suggestion(ctx->rules, suggestion);
+    }
+    sink += legal;
+}
+
+static void ignore_send(void* ctx, int player_id, int8_t type, const void* data, int32_t data_length) {
+}
+
+static void run_deal(void* arg, int64_t iterations) {
+    // The whole of clue_game_start: solution, shuffles, hands and start frames
+    BenchCtx_t* ctx = arg;
+    ClueIO_t io = {};
+    io.send = ignore_send;
+    for (int64_t i = 0; i < iterations; i++) {
+        ClueGame_t* game = clue_game_new(ctx->rules, ctx->num_players, io);
+        clue_game_seed(game, i + 1);
+        clue_game_start(game);
+        sink += game->solution[0];
+        clue_game_free(game);
+    }
+}
+
+static void* setup_settings(ClueRules_t* rules, int num_players) {
+    // The same deck, written out as a settings file
+    BenchCtx_t* ctx = setup_common(rules, num_players);
+    ctx->settings_path = strdup("/tmp/clue_bench_settings_XXXXXX");
+    int fd = mkstemp(ctx->settings_path);
+    FILE* out = fdopen(fd, "w");
+    fprintf(out, "49422\n\n");
+    int card = 0;
+    for (int i = 0; i < rules->num_categories; i++) {
+        for (int j = 0; j < rules->num_cards[i]; j++) {
+            fprintf(out, "%s\n", rules->card_names[card++]);
+        }
+        fprintf(out, "\n");
+    }
+    fclose(out);
+    return ctx;
+}
+
+static void run_read_settings(void* arg, int64_t iterations) {
+    BenchCtx_t* ctx = arg;
+    for (int64_t i = 0; i < iterations; i++) {
+        Settings_t* settings = read_settings_file(ctx->settings_path);
+        sink += settings->num_categories;
+        free_settings(settings);
+    }
+}
+
+static const Bench_t benches[] = {
+    { "shuffle", BENCH_STANDARD, setup_common, run_shuffle, teardown_common },
+    { "shuffle", BENCH_LARGE, setup_common, run_shuffle, teardown_common },
+    { "player_has_card", BENCH_STANDARD, setup_common, run_player_has_card, teardown_common },
+    { "player_has_card", BENCH_LARGE, setup_common, run_player_has_card, teardown_common },
+    { "hand_sort_qsort", BENCH_STANDARD, setup_common, run_hand_sort_qsort, teardown_common },
+    { "hand_sort_qsort", BENCH_LARGE, setup_common, run_hand_sort_qsort, teardown_common },
+    { "hand_sort_bits", BENCH_STANDARD, setup_common, run_hand_sort_bits, teardown_common },
+    { "hand_sort_bits", BENCH_LARGE, setup_common, run_hand_sort_bits, teardown_common },
+    { "rules_frame", BENCH_STANDARD, setup_common, run_rules_frame, teardown_common },
+    { "rules_frame", BENCH_LARGE, setup_common, run_rules_frame, teardown_common },
+    { "start_frames", BENCH_STANDARD, setup_common, run_start_frames, teardown_common },
+    { "start_frames", BENCH_LARGE, setup_common, run_start_frames, teardown_common },
+    { "check_suggestion", BENCH_STANDARD, setup_common, run_check_suggestion, teardown_common },
+    { "check_suggestion", BENCH_LARGE, setup_common, run_check_suggestion, teardown_common },
+    { "deal", BENCH_STANDARD, setup_common, run_deal, teardown_common },
+    { "deal", BENCH_LARGE, setup_common, run_deal, teardown_common },
+    { "read_settings_file", BENCH_STANDARD, setup_settings, run_read_settings, teardown_common },
+    { "read_settings_file", BENCH_LARGE, setup_settings, run_read_settings, teardown_common },
+};
+
+static int compare_doubles(const void* left, const void* right) {
+    double l = *(const double*)left;
+    double r = *(const double*)right;
+    return (l > r) - (l < r);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "-h") == 0) {
+        printf("Usage: %s [results.json] [name filter]\n", argv[0]);
+        exit(1);
+    }
+    const char* filter = argc > 2 ? argv[2] : NULL;
+    FILE* json = NULL;
+    if (argc > 1) {
+        json = fopen(argv[1], "w");
+        if (json == NULL) {
+            perror(NULL);
+            exit(1);
+        }
+        fprintf(json, "{\n  \"repeats\": %d,\n  \"benchmarks\": [", BENCH_REPEATS);
+    }
+
+    ClueRules_t* rules[2] = { make_rules(BENCH_STANDARD), make_rules(BENCH_LARGE) };
+    static const int num_players[2] = { 6, 32 };
+    static const char* deck_names[2] = { "standard", "large" };
+    printf("%-32s %12s %12s %12s %8s\n", "benchmark", "median ns", "min ns", "mad ns", "mad %");
+    int first = 1;
+    for (int b = 0; b < (int)(sizeof(benches) / sizeof(benches[0])); b++) {
+        const Bench_t* bench = &benches[b];
+        char name[64];
+        snprintf(name, sizeof(name), "%s/%s", bench->name, deck_names[bench->deck]);
+        if (filter && strstr(name, filter) == NULL) {
+            continue;
+        }
+        void* ctx = bench->setup(rules[bench->deck], num_players[bench->deck]);
+
+        // Double the batch until it takes long enough to time, which also warms everything up
+        int64_t iterations = 1;
+        while (1) {
+            int64_t begin = now_ns();
+            bench->run(ctx, iterations);
+            if (now_ns() - begin >= BENCH_MIN_BATCH) {
+                break;
+            }
+            iterations *= 2;
+        }
+
+        double per_op[BENCH_REPEATS];
+        double mean = 0;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            int64_t begin = now_ns();
+            bench->run(ctx, iterations);
+            per_op[r] = (double)(now_ns() - begin) / iterations;
+            mean += per_op[r] / BENCH_REPEATS;
+        }
+        bench->teardown(ctx);
+
+        double variance = 0;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            variance += (per_op[r] - mean) * (per_op[r] - mean) / BENCH_REPEATS;
+        }
+        qsort(per_op, BENCH_REPEATS, sizeof(double), compare_doubles);
+        double median = per_op[BENCH_REPEATS / 2];
+        double deviations[BENCH_REPEATS];
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+            deviations[r] = fabs(per_op[r] - median);
+        }
+        qsort(deviations, BENCH_REPEATS, sizeof(double), compare_doubles);
+        double mad = deviations[BENCH_REPEATS / 2];
+
+        printf("%-32s %12.1f %12.1f %12.1f %7.1f%%\n", name, median, per_op[0], mad, 100 * mad / median);
+        if (json) {
+            fprintf(json, "%s\n    { \"name\": \"%s\", \"iterations\": %lld, \"median_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, \"mad_ns\": %.3f }",
+                first ? "" : ",", name, (long long)iterations, median, per_op[0], per_op[BENCH_REPEATS - 1], mean, sqrt(variance), mad);
+        }
+        first = 0;
+    }
+    free_rules(rules[0]);
+    free_rules(rules[1]);
+
+    if (json) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    return 0;
+}
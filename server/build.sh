@@ -2,10 +2,22 @@
 
 # ItsHighNoon's C build script
 #
-# Last modified 11/27/2025
+# Last modified 10/16/2026
 
 readarray -t flags < compile_flags.txt
 echo "Using flags: $(IFS=$' '; echo "${flags[*]}")"
+link_flags=()
+if [ -f link_flags.txt ]; then
+    readarray -t link_flags < link_flags.txt
+fi
+
+if [ "$1" == "bench" ]; then
+    # The benchmarks pull in the sources they time, and want the optimizer on
+    echo "Building bench"
+    clang -O2 -o bench/bench bench/bench.c $(IFS=$'\n'; echo "${flags[*]}") -pthread -lm || exit 1
+    ./bench/bench bench/results.json
+    exit
+fi
 
 source_files=()
 while IFS= read -r line; do
@@ -26,7 +38,7 @@ done
 wait
 
 echo "Linking"
-clang $(IFS=$'\n'; echo "${flags[*]}") -o "server" $(IFS=$'\n'; echo "${object_files[*]}")
+clang $(IFS=$'\n'; echo "${flags[*]}") -o "server" $(IFS=$'\n'; echo "${object_files[*]}") $(IFS=$'\n'; echo "${link_flags[*]}")
 
 echo "Build done, doing static analysis"
 mkdir -p analysis
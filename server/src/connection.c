@@ -0,0 +1,463 @@
+#define _GNU_SOURCE // memfd_create
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "server.h"
+
+static ssize_t player_recv(Player_t* player, void* buffer, size_t length); // recv, or out of shared memory
+static ssize_t player_writev(Player_t* player, const struct iovec* parts, int num_parts); // writev, or into shared memory
+static int player_next_compact(Player_t* player, Frame_t* header, char** data); // player_next_frame for CLUE_PROTOCOL_V2
+
+int player_out_max = SERVER_OUT_MAX;
+
+int player_read(Player_t* player) {
+    // Edge triggered, so keep going until the socket runs dry
+    while (1) {
+        int32_t space;
+        char* buffer = clue_stream_reserve(&player->in, 1024, &space);
+        ssize_t received = player_recv(player, buffer, space);
+        if (received > 0) {
+            clue_stream_commit(&player->in, received);
+        } else if (received == 0) {
+            return 0;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 1;
+        } else if (errno != EINTR) {
+            return 0;
+        }
+    }
+}
+
+int player_next_frame(Player_t* player, Frame_t* header, char** data) {
+    if (player->compact) {
+        return player_next_compact(player, header, data);
+    }
+    // Either garbage or somebody trying to make us allocate the world if it is too long
+    int rc = clue_stream_next(&player->in, header, data, SERVER_MAX_FRAME_LENGTH);
+    if (rc == 1) {
+        metrics_frame_in(header->type, sizeof(Frame_t) + header->data_length);
+    }
+    return rc;
+}
+
+static int player_next_compact(Player_t* player, Frame_t* header, char** data) {
+    char* start = player->in.buffer + player->in.start;
+    int rc = clue_stream_next_compact(&player->in, header, data, SERVER_MAX_FRAME_LENGTH);
+    if (rc != 1) {
+        return rc;
+    }
+    metrics_frame_in(header->type, *data - start + header->data_length);
+
+    // The game only knows v1. Data that doesn't decode goes on empty, and the game says what it was missing
+    if (player->decoded == NULL) {
+        player->decoded = malloc(SERVER_MAX_FRAME_LENGTH);
+    }
+    int32_t length = clue_compact_decode(player->compact, player->decoded, SERVER_MAX_FRAME_LENGTH, header->type, *data, header->data_length);
+    header->data_length = length >= 0 && length <= SERVER_MAX_FRAME_LENGTH ? length : 0;
+    *data = player->decoded;
+    return 1;
+}
+
+OutFrame_t* out_frame_new(int8_t type, const void* data, int32_t data_length, const void* tail, int32_t tail_length) {
+    OutFrame_t* frame = malloc(sizeof(OutFrame_t) + sizeof(Frame_t) + data_length + tail_length);
+    frame->refs = 1;
+    frame->length = sizeof(Frame_t) + data_length + tail_length;
+    frame->type = type;
+    Frame_t header = {};
+    header.type = type;
+    header.data_length = data_length + tail_length;
+    memcpy(frame->data, &header, sizeof(header));
+    memcpy(frame->data + sizeof(header), data, data_length);
+    if (tail_length > 0) {
+        memcpy(frame->data + sizeof(header) + data_length, tail, tail_length);
+    }
+    return frame;
+}
+
+OutFrame_t* out_frame_compact(const ClueCompact_t* compact, int8_t type, const void* data, int32_t data_length, const void* tail, int32_t tail_length) {
+    // The v1 data in one piece first, only ERROR comes in two
+    char* joined = NULL;
+    if (tail_length > 0) {
+        joined = malloc(data_length + tail_length);
+        memcpy(joined, data, data_length);
+        memcpy(joined + data_length, tail, tail_length);
+        data = joined;
+        data_length += tail_length;
+    }
+    int32_t length = clue_compact_encode(compact, NULL, 0, type, data, data_length);
+    assert(length > 0); // Only ever given what the game and the server put together
+    OutFrame_t* frame = malloc(sizeof(OutFrame_t) + length);
+    frame->refs = 1;
+    frame->length = length;
+    frame->type = type;
+    clue_compact_encode(compact, frame->data, length, type, data, data_length);
+    free(joined);
+    return frame;
+}
+
+void out_frame_release(OutFrame_t* frame) {
+    if (--frame->refs == 0) {
+        free(frame);
+    }
+}
+
+static void player_queue(Player_t* player, OutFrame_t* frame, int sent) {
+    if (player->out_count == player->out_size) {
+        // Grow the ring, unwrapping it on the way
+        int out_size = player->out_size ? player->out_size * 2 : 16;
+        OutFrame_t** out = malloc(out_size * sizeof(OutFrame_t*));
+        for (int i = 0; i < player->out_count; i++) {
+            out[i] = player->out[(player->out_first + i) % player->out_size];
+        }
+        free(player->out);
+        player->out = out;
+        player->out_first = 0;
+        player->out_size = out_size;
+    }
+    player->out[(player->out_first + player->out_count) % player->out_size] = frame;
+    player->out_count++;
+    frame->refs++;
+    if (sent > 0) {
+        // Only happens when the queue was empty, so this is the head
+        player->out_offset = sent;
+    }
+    player->out_queued += frame->length - sent;
+
+    if (player->out_queued > player_out_max) {
+        // They stopped reading, and holding on to everything we would send them is not an option
+        log_printf(LOG_LEVEL_INFO, "Dropping connection with %d bytes it is not reading\n", player->out_queued);
+        player->disconnected = 1;
+    }
+    // Anything already queued means the socket is full. epoll tells us when it drains
+}
+
+static void player_advance(Player_t* player, int sent) {
+    // Let go of every frame the socket took completely
+    player->out_queued -= sent;
+    while (sent > 0) {
+        OutFrame_t* frame = player->out[player->out_first];
+        int left = frame->length - player->out_offset;
+        if (sent < left) {
+            player->out_offset += sent;
+            return;
+        }
+        sent -= left;
+        player->out_first = (player->out_first + 1) % player->out_size;
+        player->out_count--;
+        player->out_offset = 0;
+        out_frame_release(frame);
+    }
+}
+
+static int player_write_now(Player_t* player, struct iovec* parts, int num_parts) {
+    // Bytes the socket took right away, or -1 if the connection broke
+    if (player->out_count > 0 || player->corked) {
+        // Has to wait its turn
+        return 0;
+    }
+    while (1) {
+        ssize_t sent = player_writev(player, parts, num_parts);
+        if (sent >= 0) {
+            return sent;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if (errno != EINTR) {
+            player->disconnected = 1;
+            return -1;
+        }
+    }
+}
+
+void player_send_frame(Player_t* player, int8_t type, const void* data, int32_t data_length) {
+    player_send_frame2(player, type, data, data_length, NULL, 0);
+}
+
+void player_send_frame2(Player_t* player, int8_t type, const void* data, int32_t data_length, const void* tail, int32_t tail_length) {
+    if (player->disconnected) {
+        return;
+    }
+    if (player->compact) {
+        OutFrame_t* frame = out_frame_compact(player->compact, type, data, data_length, tail, tail_length);
+        player_send_shared(player, frame);
+        out_frame_release(frame);
+        return;
+    }
+    metrics_frame_out(type, sizeof(Frame_t) + data_length + tail_length);
+    // Nothing ahead of us means the whole frame can go straight out without being copied
+    Frame_t header = {};
+    header.type = type;
+    header.data_length = data_length + tail_length;
+    struct iovec parts[3];
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(header);
+    parts[1].iov_base = (void*)data;
+    parts[1].iov_len = data_length;
+    parts[2].iov_base = (void*)tail;
+    parts[2].iov_len = tail_length;
+    int sent = player_write_now(player, parts, tail_length > 0 ? 3 : 2);
+    if (sent == -1 || sent == (int)sizeof(header) + data_length + tail_length) {
+        return;
+    }
+    OutFrame_t* frame = out_frame_new(type, data, data_length, tail, tail_length);
+    player_queue(player, frame, sent);
+    out_frame_release(frame);
+}
+
+void player_send_shared(Player_t* player, OutFrame_t* frame) {
+    if (player->disconnected) {
+        return;
+    }
+    metrics_frame_out(frame->type, frame->length);
+    struct iovec part;
+    part.iov_base = frame->data;
+    part.iov_len = frame->length;
+    int sent = player_write_now(player, &part, 1);
+    if (sent == -1 || sent == frame->length) {
+        return;
+    }
+    player_queue(player, frame, sent);
+}
+
+int player_flush(Player_t* player) {
+    while (player->out_count > 0) {
+        struct iovec parts[SERVER_MAX_IOVECS];
+        int num_parts = 0;
+        int offset = player->out_offset;
+        for (int i = 0; i < player->out_count && num_parts < SERVER_MAX_IOVECS; i++) {
+            OutFrame_t* frame = player->out[(player->out_first + i) % player->out_size];
+            parts[num_parts].iov_base = frame->data + offset;
+            parts[num_parts].iov_len = frame->length - offset;
+            num_parts++;
+            offset = 0;
+        }
+        ssize_t sent = player_writev(player, parts, num_parts);
+        if (sent >= 0) {
+            player_advance(player, sent);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Socket is full, epoll will tell us when to try again
+            return 1;
+        } else if (errno != EINTR) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void player_cork(Player_t* player) {
+    player->corked = 1;
+}
+
+void player_uncork(Player_t* player) {
+    player->corked = 0;
+    if (!player->disconnected && !player_flush(player)) {
+        player->disconnected = 1;
+    }
+}
+
+int player_service(Player_t* player, uint32_t events) {
+    if (player->shm) {
+        // The socket hanging up is the only thing it is still good for. The doorbell rings for
+        // frames and for room alike, and is never read, edge triggered epoll fires on every poke
+        if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            player->disconnected = 1;
+            return 1;
+        }
+        events |= EPOLLIN | EPOLLOUT;
+    }
+    if (events & EPOLLOUT) {
+        if (!player_flush(player)) {
+            player->disconnected = 1;
+            return 1;
+        }
+    }
+    if (player->out_queued > SERVER_OUT_HIGH_WATER) {
+        // They are not keeping up with what we send, so stop listening to them until they do. Their
+        // frames back up in the kernel and TCP slows them down
+        player->read_paused = 1;
+        return 0;
+    }
+    // Edge triggered, so anything that arrived while we were paused has to be picked up by hand
+    if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR) || player->read_paused) && !player_read(player)) {
+        player->disconnected = 1;
+    }
+    player->read_paused = 0;
+    return 1;
+}
+
+void player_close(Player_t* player) {
+    if (player->shm) {
+        // Whatever is left in the ring is still theirs to read, after that they see closed
+        atomic_store(&player->shm->closed, 1);
+        clue_shm_futex_wake(&player->shm->to_client.head);
+        clue_shm_futex_wake(&player->shm->to_server.tail);
+        munmap(player->shm, sizeof(ClueShm_t));
+        player->shm = NULL;
+        close(player->doorbell);
+        player->doorbell = -1;
+    }
+    close(player->fd); // Also takes it out of epoll
+    player->fd = -1;
+}
+
+void player_watch(Player_t* player, int epoll_fd) {
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = player;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, player->fd, &event);
+    if (player->shm) {
+        event.events = EPOLLIN | EPOLLET;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, player->doorbell, &event);
+    }
+}
+
+void player_unwatch(Player_t* player, int epoll_fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, player->fd, NULL);
+    if (player->shm) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, player->doorbell, NULL);
+    }
+}
+
+int player_attach_shm(Player_t* player, int epoll_fd) {
+    // The memory and the doorbell are ours, the bot gets its own copies of the fds
+    int memory_fd = memfd_create("clue", MFD_CLOEXEC);
+    if (memory_fd == -1 || ftruncate(memory_fd, sizeof(ClueShm_t)) == -1) {
+        perror(NULL);
+        if (memory_fd != -1) {
+            close(memory_fd);
+        }
+        return 0;
+    }
+    ClueShm_t* shm = mmap(NULL, sizeof(ClueShm_t), PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    int doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shm == MAP_FAILED || doorbell == -1) {
+        perror(NULL);
+        if (shm != MAP_FAILED) {
+            munmap(shm, sizeof(ClueShm_t));
+        }
+        if (doorbell != -1) {
+            close(doorbell);
+        }
+        close(memory_fd);
+        return 0;
+    }
+    // Fresh from ftruncate, so everything else is already 0. We are waiting on them to begin with
+    shm->magic = CLUE_SHM_MAGIC;
+    shm->ring_size = CLUE_SHM_RING_SIZE;
+    atomic_store(&shm->to_server.reader_waiting, 1);
+
+    // Nothing else was ever sent on this socket, so the answer goes straight out
+    Frame_t answer = {};
+    answer.type = FRAME_TYPE_SHM_ATTACH;
+    struct iovec part = { &answer, sizeof(answer) };
+    char control[CMSG_SPACE(2 * sizeof(int))] = {};
+    struct msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr* fds = CMSG_FIRSTHDR(&message);
+    fds->cmsg_level = SOL_SOCKET;
+    fds->cmsg_type = SCM_RIGHTS;
+    fds->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    memcpy(CMSG_DATA(fds), &memory_fd, sizeof(int));
+    memcpy(CMSG_DATA(fds) + sizeof(int), &doorbell, sizeof(int));
+    ssize_t sent = sendmsg(player->fd, &message, MSG_NOSIGNAL);
+    close(memory_fd);
+    if (sent != sizeof(answer)) {
+        munmap(shm, sizeof(ClueShm_t));
+        close(doorbell);
+        return 0;
+    }
+    player->shm = shm;
+    player->doorbell = doorbell;
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = player;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, doorbell, &event);
+    return 1;
+}
+
+static ssize_t player_recv(Player_t* player, void* buffer, size_t length) {
+    if (player->shm == NULL) {
+        return recv(player->fd, buffer, length, 0);
+    }
+    ClueShmRing_t* ring = &player->shm->to_server;
+    uint32_t received = clue_shm_read(ring, buffer, length);
+    if (received == 0) {
+        // Ask for the doorbell, then make sure nothing got in before it was up
+        clue_shm_want_wake(&ring->reader_waiting);
+        received = clue_shm_read(ring, buffer, length);
+        if (received == 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+        atomic_store(&ring->reader_waiting, 0);
+    }
+    if (clue_shm_woken(&ring->writer_waiting)) {
+        clue_shm_futex_wake(&ring->tail);
+    }
+    return received;
+}
+
+static ssize_t player_writev(Player_t* player, const struct iovec* parts, int num_parts) {
+    if (player->shm == NULL) {
+        return writev(player->fd, parts, num_parts);
+    }
+    ClueShmRing_t* ring = &player->shm->to_client;
+    uint32_t length = 0;
+    for (int i = 0; i < num_parts; i++) {
+        length += parts[i].iov_len;
+    }
+    uint32_t written = clue_shm_write(ring, parts, num_parts);
+    if (written > 0 && clue_shm_woken(&ring->reader_waiting)) {
+        clue_shm_futex_wake(&ring->head);
+    }
+    if (written < length) {
+        // The rest gets queued until they ring for more. If they made room before they could see
+        // the flag, nobody would ring, so we ring ourselves to be sure
+        clue_shm_want_wake(&ring->writer_waiting);
+        if (atomic_load(&ring->head) - atomic_load(&ring->tail) < CLUE_SHM_RING_SIZE) {
+            uint64_t one = 1;
+            if (write(player->doorbell, &one, sizeof(one)) == -1) {
+                // Already rung more times than anyone could count
+            }
+        }
+    }
+    if (written == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return written;
+}
+
+void send_error_frame(Player_t* player, const char* reason) {
+    log_printf(LOG_LEVEL_INFO, "Sending error frame: %s\n", reason);
+    ErrorFrame_t error = {};
+    error.error_length = strlen(reason);
+    player_send_frame2(player, FRAME_TYPE_ERROR, &error, sizeof(error), reason, error.error_length);
+}
+
+void player_free(Player_t* player) {
+    if (player->fd != -1) {
+        player_close(player);
+    }
+    for (int i = 0; i < player->out_count; i++) {
+        out_frame_release(player->out[(player->out_first + i) % player->out_size]);
+    }
+    free(player->out);
+    free(player->name);
+    free(player->decoded);
+    clue_stream_free(&player->in);
+    free(player);
+}
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "server.h"
+
+static void game_send(void* ctx, int player_id, int8_t type, const void* data, int32_t data_length); // ClueIO_t.send over the sockets, broadcasts are encoded once
+static void game_multicast(void* ctx, const int8_t* player_ids, int num_player_ids, int8_t type, const void* data, int32_t data_length); // ClueIO_t.multicast, encoded once
+static void game_send_shared(Player_t* player, OutFrame_t** frames, int8_t type, const void* data, int32_t data_length); // frames holds the v1 and v2 encodings, made as needed
+static void release_frames(OutFrame_t** frames);
+static void game_event(void* ctx, const ClueEvent_t* event); // ClueIO_t.event, logs and narrates
+static void game_deal(Server_t* server, Game_t* game); // Start the next game of the series
+static void game_after_step(Server_t* server, Game_t* game); // Deal with whatever state the engine left the game in
+static void release_players(Game_t* game); // Players get flushed and closed
+static void game_cork(Game_t* game); // Hold frames back until the engine is done with this step
+static void game_uncork(Game_t* game); // Each player gets everything from this step in one writev
+static void game_set_deadline(Game_t* game, int64_t deadline); // And tell the worker
+static int64_t move_deadline(Server_t* server, Player_t* player); // Whichever runs out first, the move limit or their clock
+static int charge_clock(Server_t* server, Player_t* player, int64_t took); // Take an answer's time off their clock. 0 if they were already out of time
+
+Game_t* game_new(Server_t* server) {
+    Game_t* game = calloc(1, sizeof(Game_t));
+    game->id = server->next_game_id++;
+    game->state = GAME_STATE_LOBBY;
+    game->series_length = server->series_length;
+    game->size_players = 10;
+    game->players = malloc(game->size_players * sizeof(Player_t*));
+    game->deadline = now_ms() + server->lobby_wait;
+    pthread_mutex_init(&game->lock, NULL);
+    atomic_init(&game->queued, 0);
+    atomic_init(&game->refs, 1);
+    game->timer = -1;
+    return game;
+}
+
+void game_start(Server_t* server, Game_t* game) {
+    game->state = GAME_STATE_PLAYING;
+    for (int i = 0; i < game->num_players; i++) {
+        game->players[i]->state = PLAYER_STATE_PLAYING;
+    }
+    game_cork(game);
+    game_deal(server, game);
+    game_after_step(server, game);
+}
+
+static void game_deal(Server_t* server, Game_t* game) {
+    ClueIO_t io = {};
+    io.ctx = game;
+    io.send = game_send;
+    io.multicast = game_multicast;
+    io.event = game_event;
+    game->clue = clue_game_new(&server->clue_rules, game->num_players, io);
+    game->moves = 0; // The new engine counts from scratch, and its first move has to set a deadline
+    if (server->seed) {
+        clue_game_seed(game->clue, clue_rng_mix(clue_rng_mix(server->seed, game->id), game->games_played));
+    }
+    // The seed is all it takes to deal this game again (server -r)
+    if (game->series_length > 1) {
+        log_printf(LOG_LEVEL_INFO, "[%d] Starting game %d of %d, seed %llu\n", game->id, game->games_played + 1, game->series_length, (unsigned long long)game->clue->seed);
+    } else {
+        log_printf(LOG_LEVEL_INFO, "[%d] Starting game, seed %llu\n", game->id, (unsigned long long)game->clue->seed);
+    }
+    clue_gamelog_begin(&game->log, server->game_log, game->id, game->games_played, game->num_players, game->clue->seed);
+    game->clue->games_left = game->series_length - game->games_played - 1;
+    for (int i = 0; i < game->num_players; i++) {
+        Player_t* player = game->players[i];
+        player->clock = (int64_t)server->time_control.clock_ms * 1000;
+        clue_game_set_name(game->clue, player->id, player->name, player->name_length);
+        clue_game_set_auto_show(game->clue, player->id, player->auto_show);
+        if (player->disconnected) {
+            clue_game_abort(game->clue, "Player disconnected");
+        }
+    }
+    if (game->clue->state != CLUE_STATE_OVER) {
+        clue_game_start(game->clue);
+    }
+}
+
+void game_handle_frame(Server_t* server, Game_t* game, Player_t* player, Frame_t* header, char* data) {
+    if (player->id == clue_game_waiting_on(game->clue)) {
+        int64_t took = now_us() - game->waiting_since;
+        metrics_decision(player->metrics, game->clue->state, took);
+        if (!charge_clock(server, player, took)) {
+            // Their time ran out before the timer got around to it
+            game_timeout(server, game);
+            return;
+        }
+    }
+    game_cork(game);
+    clue_game_submit(game->clue, player->id, header->type, data, header->data_length);
+    game_after_step(server, game);
+}
+
+void game_timeout(Server_t* server, Game_t* game) {
+    int player_id = clue_game_waiting_on(game->clue);
+    if (player_id >= 0) {
+        metrics_timeout(game->players[player_id]->metrics);
+        game->players[player_id]->clock = 0;
+    }
+    game_cork(game);
+    if (server->time_control.forfeit) {
+        clue_game_forfeit(game->clue);
+    } else {
+        clue_game_timeout(game->clue);
+    }
+    game_after_step(server, game);
+}
+
+void abort_game(Server_t* server, Game_t* game, const char* reason) {
+    game_cork(game);
+    if (game->clue) {
+        clue_game_abort(game->clue, reason);
+    }
+    game_after_step(server, game);
+}
+
+void game_release(Game_t* game) {
+    if (atomic_fetch_sub(&game->refs, 1) != 1) {
+        return;
+    }
+    if (game->clue) {
+        clue_game_free(game->clue);
+    }
+    for (int i = 0; i < game->num_players; i++) {
+        player_free(game->players[i]);
+    }
+    free(game->players);
+    clue_gamelog_buffer_free(&game->log);
+    pthread_mutex_destroy(&game->lock);
+    free(game);
+}
+
+static void game_send(void* ctx, int player_id, int8_t type, const void* data, int32_t data_length) {
+    Game_t* game = ctx;
+    if (player_id != CLUE_EVERYONE) {
+        player_send_frame(game->players[player_id], type, data, data_length);
+        return;
+    }
+    OutFrame_t* frames[2] = {};
+    for (int i = 0; i < game->num_players; i++) {
+        game_send_shared(game->players[i], frames, type, data, data_length);
+    }
+    release_frames(frames);
+}
+
+static void game_multicast(void* ctx, const int8_t* player_ids, int num_player_ids, int8_t type, const void* data, int32_t data_length) {
+    Game_t* game = ctx;
+    OutFrame_t* frames[2] = {};
+    for (int i = 0; i < num_player_ids; i++) {
+        game_send_shared(game->players[player_ids[i]], frames, type, data, data_length);
+    }
+    release_frames(frames);
+}
+
+static void game_send_shared(Player_t* player, OutFrame_t** frames, int8_t type, const void* data, int32_t data_length) {
+    // Encoded at most once per protocol, the first time somebody speaking it needs it
+    int v2 = player->compact != NULL;
+    if (frames[v2] == NULL) {
+        frames[v2] = v2 ? out_frame_compact(player->compact, type, data, data_length, NULL, 0) : out_frame_new(type, data, data_length, NULL, 0);
+    }
+    player_send_shared(player, frames[v2]);
+}
+
+static void release_frames(OutFrame_t** frames) {
+    for (int i = 0; i < 2; i++) {
+        if (frames[i]) {
+            out_frame_release(frames[i]);
+        }
+    }
+}
+
+static void game_event(void* ctx, const ClueEvent_t* event) {
+    Game_t* game = ctx;
+    clue_gamelog_event(&game->log, event);
+    if (event->type == CLUE_EVENT_OVER && game->log.log) {
+        // The log thread writes it, the game lock is no place to wait on the disk
+        log_gamelog(&game->log);
+    }
+    if (event->type == CLUE_EVENT_OVER) {
+        metrics_game_over(event);
+    }
+    log_event(game, event);
+}
+
+static void game_after_step(Server_t* server, Game_t* game) {
+    if (game->state == GAME_STATE_OVER) {
+        return;
+    }
+
+    while (1) {
+        // Somebody dropped while we were sending
+        game_uncork(game);
+        for (int i = 0; i < game->num_players; i++) {
+            if (game->players[i]->disconnected) {
+                clue_game_abort(game->clue, "Player disconnected");
+                break;
+            }
+        }
+        if (game->clue->state != CLUE_STATE_OVER || game->clue->aborted) {
+            break;
+        }
+        // On to the next game with the same players, they already know the rules
+        game->games_played++;
+        clue_game_free(game->clue);
+        game_cork(game);
+        game_deal(server, game);
+    }
+
+    if (game->clue->state == CLUE_STATE_OVER) {
+        release_players(game);
+        game->state = GAME_STATE_OVER;
+    } else if (game->clue->moves != game->moves) {
+        // Waiting on someone new, their clock starts now
+        game->moves = game->clue->moves;
+        game->waiting_since = now_us();
+        game_set_deadline(game, move_deadline(server, game->players[clue_game_waiting_on(game->clue)]));
+    }
+}
+
+static void game_cork(Game_t* game) {
+    for (int i = 0; i < game->num_players; i++) {
+        player_cork(game->players[i]);
+    }
+}
+
+static void game_uncork(Game_t* game) {
+    for (int i = 0; i < game->num_players; i++) {
+        player_uncork(game->players[i]);
+    }
+}
+
+static void release_players(Game_t* game) {
+    // Whatever they still have queued goes out first, then the worker closes them
+    for (int i = 0; i < game->num_players; i++) {
+        game->players[i]->state = PLAYER_STATE_CLOSING;
+    }
+    game_set_deadline(game, now_ms() + SERVER_CLOSE_GRACE_TIME * 1000);
+}
+
+static void game_set_deadline(Game_t* game, int64_t deadline) {
+    game->deadline = deadline;
+    if (game->worker) {
+        // Before a worker adopts the game it has no timers, worker_adopt takes care of it
+        worker_schedule(game->worker, game);
+    }
+}
+
+static int64_t move_deadline(Server_t* server, Player_t* player) {
+    const TimeControl_t* time_control = &server->time_control;
+    int64_t allowed = INT64_MAX;
+    if (time_control->move_ms) {
+        allowed = time_control->move_ms;
+    }
+    if (time_control->clock_ms && (player->clock + 999) / 1000 < allowed) {
+        allowed = (player->clock + 999) / 1000;
+    }
+    return allowed == INT64_MAX ? INT64_MAX : now_ms() + allowed;
+}
+
+static int charge_clock(Server_t* server, Player_t* player, int64_t took) {
+    const TimeControl_t* time_control = &server->time_control;
+    if (time_control->move_ms && took > (int64_t)time_control->move_ms * 1000) {
+        return 0;
+    }
+    if (time_control->clock_ms) {
+        player->clock -= took;
+        if (player->clock < 0) {
+            return 0;
+        }
+        player->clock += (int64_t)time_control->increment_ms * 1000;
+    }
+    return 1;
+}
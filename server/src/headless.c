@@ -0,0 +1,202 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "server.h"
+
+// Bots that can play without a socket. Add yours here
+typedef struct {
+    const char* name;
+    ClueBot_t (*create)();
+} BotType_t;
+
+static const BotType_t bot_types[] = {
+    { "randy", clue_bot_randy },
+    { "sleuth", clue_bot_sleuth },
+};
+
+static int parse_roster(const char* roster, const BotType_t** roster_types); // Returns the number of players, 0 on failure
+
+// Every thread plays with its own bots and keeps its own tally
+typedef struct {
+    ClueRules_t* rules;
+    const BotType_t** roster_types;
+    int num_players;
+    int num_games;
+    uint64_t seed; // Game N is dealt with clue_rng_mix(seed, N), whichever thread plays it
+    atomic_int* next_game; // Shared, games are handed out one at a time so nobody sits idle
+    int* wins;
+    int no_winner;
+    ClueGameLog_t* game_log; // Shared, NULL if not logging
+    ClueGameLogBuffer_t log;
+    pthread_t thread;
+} HeadlessThread_t;
+
+static void ignore_send(void* ctx, int player_id, int8_t type, const void* data, int32_t data_length) {
+    // clue_game_play routes frames to the bots itself
+}
+
+static void record_event(void* ctx, const ClueEvent_t* event) {
+    HeadlessThread_t* thread = ctx;
+    clue_gamelog_event(&thread->log, event);
+}
+
+static void narrate_event(void* ctx, const ClueEvent_t* event) {
+    log_event(ctx, event);
+}
+
+static void* play_games(void* arg) {
+    HeadlessThread_t* thread = arg;
+    int num_players = thread->num_players;
+
+    // Bots live for the whole run, they reset themselves on FRAME_TYPE_START
+    ClueBot_t bots[num_players];
+    for (int i = 0; i < num_players; i++) {
+        bots[i] = thread->roster_types[i]->create();
+    }
+    ClueIO_t io = {};
+    io.ctx = thread;
+    io.send = ignore_send;
+    if (thread->game_log) {
+        io.event = record_event;
+    }
+    int game_idx;
+    while ((game_idx = atomic_fetch_add(thread->next_game, 1)) < thread->num_games) {
+        ClueGame_t* game = clue_game_new(thread->rules, num_players, io);
+        clue_game_seed(game, clue_rng_mix(thread->seed, game_idx));
+        clue_gamelog_begin(&thread->log, thread->game_log, game_idx, 0, num_players, game->seed);
+        for (int j = 0; j < num_players; j++) {
+            clue_game_set_name(game, j, thread->roster_types[j]->name, strlen(thread->roster_types[j]->name));
+        }
+        clue_game_play(game, bots);
+        if (game->winner >= 0) {
+            thread->wins[game->winner]++;
+        } else {
+            thread->no_winner++;
+        }
+        clue_game_free(game);
+    }
+    for (int i = 0; i < num_players; i++) {
+        bots[i].free(bots[i].ctx);
+    }
+    clue_gamelog_buffer_free(&thread->log);
+    return NULL;
+}
+
+int run_headless(ClueRules_t* rules, int num_games, char* roster, int num_threads, uint64_t seed, ClueGameLog_t* game_log) {
+    const BotType_t* roster_types[SERVER_MAX_PLAYERS];
+    int num_players = parse_roster(roster, roster_types);
+    if (num_players == 0) {
+        return 1;
+    }
+    if (seed == 0) {
+        seed = clue_seed();
+    }
+
+    // Printing the seed means any run can be played again with -s, game for game
+    printf("Playing %d games with %d bots on %d threads, seed %llu\n", num_games, num_players, num_threads, (unsigned long long)seed);
+    atomic_int next_game;
+    atomic_init(&next_game, 0);
+    HeadlessThread_t threads[num_threads];
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (int i = 0; i < num_threads; i++) {
+        threads[i].rules = rules;
+        threads[i].roster_types = roster_types;
+        threads[i].num_players = num_players;
+        threads[i].num_games = num_games;
+        threads[i].seed = seed;
+        threads[i].next_game = &next_game;
+        threads[i].wins = calloc(num_players, sizeof(int));
+        threads[i].no_winner = 0;
+        threads[i].game_log = game_log;
+        memset(&threads[i].log, 0, sizeof(threads[i].log));
+        pthread_create(&threads[i].thread, NULL, play_games, &threads[i]);
+    }
+    int wins[num_players];
+    memset(wins, 0, sizeof(wins));
+    int no_winner = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        for (int j = 0; j < num_players; j++) {
+            wins[j] += threads[i].wins[j];
+        }
+        no_winner += threads[i].no_winner;
+        free(threads[i].wins);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+
+    for (int i = 0; i < num_players; i++) {
+        printf("(%d) %s won %d\n", i, roster_types[i]->name, wins[i]);
+    }
+    printf("Nobody won %d\n", no_winner);
+    printf("%d games in %.3f seconds (%.0f games/sec)\n", num_games, seconds, num_games / seconds);
+    return 0;
+}
+
+int replay_game(ClueRules_t* rules, char* roster, uint64_t seed) {
+    const BotType_t* roster_types[SERVER_MAX_PLAYERS];
+    int num_players = parse_roster(roster, roster_types);
+    if (num_players == 0) {
+        return 1;
+    }
+    ClueBot_t bots[num_players];
+    for (int i = 0; i < num_players; i++) {
+        bots[i] = roster_types[i]->create();
+    }
+
+    // log_event wants a server game to print from, a stand-in will do
+    Game_t narrator = {};
+    narrator.series_length = 1;
+    ClueIO_t io = {};
+    io.ctx = &narrator;
+    io.send = ignore_send;
+    io.event = narrate_event;
+    ClueGame_t* game = clue_game_new(rules, num_players, io);
+    narrator.clue = game;
+    clue_game_seed(game, seed);
+    for (int i = 0; i < num_players; i++) {
+        clue_game_set_name(game, i, roster_types[i]->name, strlen(roster_types[i]->name));
+    }
+    log_printf(LOG_LEVEL_INFO, "Replaying seed %llu with %d bots\n", (unsigned long long)seed, num_players);
+    clue_game_play(game, bots);
+    clue_game_free(game);
+    for (int i = 0; i < num_players; i++) {
+        bots[i].free(bots[i].ctx);
+    }
+    return 0;
+}
+
+static int parse_roster(const char* roster, const BotType_t** roster_types) {
+    // Roster is a comma separated list of bot names, one per player
+    int num_players = 0;
+    char* roster_copy = strdup(roster);
+    for (char* name = strtok(roster_copy, ","); name; name = strtok(NULL, ",")) {
+        const BotType_t* type = NULL;
+        for (int i = 0; i < (int)(sizeof(bot_types) / sizeof(bot_types[0])); i++) {
+            if (strcmp(bot_types[i].name, name) == 0) {
+                type = &bot_types[i];
+            }
+        }
+        if (type == NULL) {
+            printf("Unknown bot %s\n", name);
+            free(roster_copy);
+            return 0;
+        }
+        if (num_players >= SERVER_MAX_PLAYERS) {
+            printf("Too many bots (maximum %d)\n", SERVER_MAX_PLAYERS);
+            free(roster_copy);
+            return 0;
+        }
+        roster_types[num_players++] = type;
+    }
+    free(roster_copy);
+    if (num_players == 0) {
+        printf("No bots to play with!\n");
+    }
+    return num_players;
+}
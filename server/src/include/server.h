@@ -0,0 +1,260 @@
+#ifndef __server_h__
+#define __server_h__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "clue/codec.h"
+#include "clue/compact.h"
+#include "clue/engine.h"
+#include "clue/gamelog.h"
+#include "clue/shm.h"
+
+typedef struct {
+    uint16_t port;
+    int8_t num_categories;
+    int16_t* num_cards;
+    char*** card_names;
+} Settings_t;
+
+// How long players get to answer. Every answer has to come within move_ms, and with a clock each
+// player also has clock_ms for the whole game, getting increment_ms back after every answer
+typedef struct {
+    int move_ms; // 0 for no limit per move
+    int clock_ms; // 0 for no game clock
+    int increment_ms;
+    int forfeit; // Whoever runs out of time forfeits and the game goes on without them, instead of aborting
+} TimeControl_t;
+
+typedef struct Game_t Game_t;
+typedef struct Worker_t Worker_t;
+typedef struct MetricsBot_t MetricsBot_t;
+
+// A whole frame, header and all, waiting to be sent. Broadcasts are encoded once and the same
+// OutFrame_t sits in the queue of everyone it goes to. Only ever shared within one game, so the
+// game's lock covers refs
+typedef struct {
+    int refs;
+    int length;
+    int8_t type;
+    char data[0];
+} OutFrame_t;
+
+#define PLAYER_STATE_CONNECTING 0 // Accepted, waiting for FRAME_TYPE_CONNECT
+#define PLAYER_STATE_LOBBY 1 // Got the rules, waiting for the game to start
+#define PLAYER_STATE_PLAYING 2 // In a running game, owned by a worker from here on
+#define PLAYER_STATE_CLOSING 3 // Game is over, flushing whatever is left to send, then closing
+
+typedef struct Player_t {
+    int fd;
+    int state;
+    int disconnected;
+    struct sockaddr_storage address; // sockaddr_in6, or sockaddr_un from the Unix socket
+    int8_t id;
+    int8_t name_length;
+    char* name;
+    Game_t* game; // Never changes once the game starts, workers rely on that
+    int64_t deadline; // Only used while connecting, the game keeps its own
+    int64_t clock; // Microseconds left on their game clock, only used with a clock
+    ClueShm_t* shm; // Once they attach, frames go through here and fd only tells us if they hang up
+    int doorbell; // eventfd they poke when they want us to look at shm, -1 without shm
+    MetricsBot_t* metrics; // Decision times of everyone with this name, NULL without -m
+    const ClueCompact_t* compact; // Set if they asked for CLUE_PROTOCOL_V2, NULL for v1
+    int auto_show; // They asked for CLUE_CONNECT_AUTO_SHOW
+    char* decoded; // With compact, the v1 data of their last frame. SERVER_MAX_FRAME_LENGTH long
+    atomic_uint pending; // epoll events the owning worker saw that nobody has handled yet
+
+    // Non-blocking read state. Bytes accumulate here until there is a whole frame
+    ClueStream_t in;
+
+    // Non-blocking write state. Frames wait here until the socket takes them
+    OutFrame_t** out; // Ring of frames, each holding a reference
+    int out_first;
+    int out_count;
+    int out_size;
+    int out_offset; // Bytes of the first frame already sent
+    int out_queued; // Bytes waiting to be sent, across all frames
+    int corked; // Queue frames without sending until player_uncork
+    int read_paused; // Stopped reading because too much output is waiting
+
+    struct Player_t* next; // Connecting players are kept in a list
+} Player_t;
+
+#define GAME_STATE_LOBBY 0 // Collecting players
+#define GAME_STATE_PLAYING 1 // The rules engine is running the show
+#define GAME_STATE_OVER 2 // Done, players are flushing and closing
+
+struct Game_t {
+    int id;
+    int state;
+    Player_t** players; // Indexed by player ID
+    int num_players;
+    int size_players;
+    ClueGame_t* clue; // The game being played right now
+    int series_length; // Games the players will play in a row
+    int games_played; // Games of the series finished so far
+    int moves; // clue->moves when the deadline was last set
+    int64_t deadline; // When the lobby closes, when the awaited player times out, or when the players get closed. INT64_MAX for never
+    int64_t waiting_since; // now_us() when the engine started waiting on whoever it is waiting on
+    ClueGameLogBuffer_t log; // This game's events until it ends, only used with -l
+    int closed; // Every player is closed and the owner has let go
+    Game_t* next; // Lobby thread lists, then the owner's closed list
+
+    // Once it starts, a game belongs to a worker. Any worker may run it, but only with the lock held
+    Worker_t* worker; // Owns the sockets, the deadline and the memory
+    pthread_mutex_t lock;
+    atomic_int queued; // Sitting in a worker's deque waiting to be run
+    atomic_int refs; // One for the owner, one for every deque entry and one for its timer. Only the owner drops its own, see worker_retire
+    int timer; // Index of its timer in the owner's heap, -1 if it has none. Guarded by the owner's lock
+};
+
+// A game's deadline as its worker's timer heap knows it. A game has at most one, moving the deadline
+// moves it within the heap
+typedef struct {
+    int64_t when; // now_ms() to go off at
+    Game_t* game; // Holds a reference
+} WorkerTimer_t;
+
+// One per core. A worker waits on the sockets of the games it owns and runs the ones that are
+// ready. When it runs out, it steals ready games from the other workers' deques. The deadlines of
+// its games sit in a heap, and a timerfd goes off when the earliest one is due
+struct Worker_t {
+    struct Server_t* server;
+    int id;
+    pthread_t thread;
+    int epoll_fd;
+    int wake_fd; // eventfd, poked when there is work to steal
+    int timer_fd; // timerfd, set for the earliest timer
+    atomic_int idle; // Blocked in epoll_wait with nothing to do
+
+    pthread_mutex_t lock; // Guards everything below
+    Game_t** deque; // Ring of ready games. The owner takes from the back, thieves from the front
+    int deque_first;
+    int deque_count;
+    int deque_size;
+    WorkerTimer_t* timers; // Binary min-heap on when
+    int num_timers;
+    int size_timers;
+    int64_t armed; // When timer_fd is set to go off, -1 if it isn't
+    Game_t* closed; // Our games that got closed, we let go of them between event batches
+};
+
+typedef struct Server_t {
+    Settings_t* settings;
+    ClueRules_t clue_rules;
+    char* rules; // Whole RULES frame, header included
+    ClueCompact_t compact; // For players speaking CLUE_PROTOCOL_V2
+    int rules_len;
+    int listen_fd;
+    int unix_fd; // With -u, -1 if not
+    int epoll_fd;
+    Game_t* lobby; // The game new players are put into
+    Game_t* starting; // Lobbies that filled up, handed to a worker once the event batch is done
+    Player_t* loose_players; // Players not in a game yet (connecting)
+    int next_game_id;
+    int series_length; // How many games the same players play in a row
+    int lobby_quorum; // Start the lobby as soon as this many players are in, 0 to always wait
+    int lobby_wait; // Milliseconds a lobby waits for players before starting with whoever is there
+    Worker_t* workers;
+    int num_workers;
+    int next_worker; // Games are handed out round robin
+    ClueGameLog_t* game_log; // NULL unless started with -l
+    uint64_t seed; // With -s, every game's seed follows from this, its ID and its place in the series. 0 if not
+    TimeControl_t time_control;
+    int match_fd; // With -x, eventfd poked when the match is over. -1 if not
+    pid_t* bots; // With -x, the bot processes we started
+    int num_bots;
+} Server_t;
+
+#define SERVER_LOBBY_WAIT_TIME 10 // Default, see -w
+#define SERVER_SOCKET_TIMEOUT 3 // Seconds a new connection gets to send FRAME_TYPE_CONNECT
+#define SERVER_MOVE_TIME 3 // Default seconds per move, see -T
+#define SERVER_MAX_PLAYERS 127 // Player IDs are int8_t
+#define SERVER_MAX_FRAME_LENGTH 4096 // Nothing a client sends is anywhere near this big
+#define SERVER_CLOSE_GRACE_TIME 1 // How long we wait for a closing player to take the rest of its data
+#define SERVER_OUT_HIGH_WATER (64 * 1024) // Stop reading from a player with this much output waiting
+#define SERVER_OUT_MAX (1024 * 1024) // Drop a player with this much output waiting, they are not reading it
+#define SERVER_MAX_IOVECS 64 // Frames handed to a single writev
+#define SERVER_WORKER_BATCH 16 // Games a worker runs before checking its sockets again
+#define SERVER_MAX_LISTED_CARDS 64 // Categories with more cards than this only get their size printed at startup
+#define SERVER_METRICS_INTERVAL 10 // Default seconds between metrics dumps, see -M
+
+// server.c
+int64_t now_ms(); // Monotonic clock in milliseconds
+int64_t now_us(); // Same clock in microseconds
+void add_loose_player(Server_t* server, int fd, const struct sockaddr_storage* address); // A new connection, it gets SERVER_SOCKET_TIMEOUT seconds to send FRAME_TYPE_CONNECT
+
+// settings.c
+Settings_t* read_settings_file(char* file_path); // Read settings.txt into the Settings_t structure
+void free_settings(Settings_t* settings);
+
+// connection.c
+extern int player_out_max; // Output that can wait for a player before they get dropped, SERVER_OUT_MAX plus the RULES frame
+int player_read(Player_t* player); // Read whatever is available. Returns 0 on EOF or error
+int player_next_frame(Player_t* player, Frame_t* header, char** data); // Take a whole frame off the read buffer. Returns 1 if there is one, -1 if the header is bad
+void player_send_frame(Player_t* player, int8_t type, const void* data, int32_t data_length); // Queue and try to send a frame, unless corked
+void player_send_frame2(Player_t* player, int8_t type, const void* data, int32_t data_length, const void* tail, int32_t tail_length); // Same but the data is in two pieces
+void player_send_shared(Player_t* player, OutFrame_t* frame); // Queue a reference to a frame made by out_frame_new
+int player_flush(Player_t* player); // Write out as much as the socket will take. Returns 0 if the connection broke
+void player_cork(Player_t* player); // Hold frames back so several go out in one writev
+void player_uncork(Player_t* player); // Send whatever was held back
+OutFrame_t* out_frame_new(int8_t type, const void* data, int32_t data_length, const void* tail, int32_t tail_length); // Encode a frame once for any number of players
+OutFrame_t* out_frame_compact(const ClueCompact_t* compact, int8_t type, const void* data, int32_t data_length, const void* tail, int32_t tail_length); // Same for CLUE_PROTOCOL_V2 players, from the same v1 data
+void out_frame_release(OutFrame_t* frame); // Drop a reference, the last one frees it
+void send_error_frame(Player_t* player, const char* reason); // Send FRAME_TYPE_ERROR to a certain client
+void player_free(Player_t* player);
+
+int player_service(Player_t* player, uint32_t events); // Flush and read for an epoll event. Returns 0 if their frames should wait
+void player_close(Player_t* player); // Close the socket but keep the memory around
+void player_watch(Player_t* player, int epoll_fd); // Hear about the player's socket (and doorbell) on this epoll
+void player_unwatch(Player_t* player, int epoll_fd);
+int player_attach_shm(Player_t* player, int epoll_fd); // Answer FRAME_TYPE_SHM_ATTACH and move the player to shared memory. 0 if that failed
+
+// game.c
+Game_t* game_new(Server_t* server);
+void game_start(Server_t* server, Game_t* game); // Hand the players over to the rules engine for the first game of the series
+void game_handle_frame(Server_t* server, Game_t* game, Player_t* player, Frame_t* header, char* data);
+void game_timeout(Server_t* server, Game_t* game); // The player we were waiting on took too long
+void abort_game(Server_t* server, Game_t* game, const char* reason); // Send abort frame to everyone and start closing the players
+void game_release(Game_t* game); // Drop a reference, the last one frees the game and its players
+
+// log.c
+#define LOG_LEVEL_ERROR 0 // Only what stops the server from running (-q)
+#define LOG_LEVEL_INFO 1 // Connections, game starts and how games ended (default)
+#define LOG_LEVEL_EVENTS 2 // Every move of every game (-v)
+extern int log_level;
+void log_start(const ClueRules_t* rules, int level); // Start the thread that does all the writing
+void log_stop(); // Write out whatever is left and stop the thread
+void log_printf(int level, const char* format, ...) __attribute__((format(printf, 2, 3))); // Formatted here, written later
+void log_event(const Game_t* game, const ClueEvent_t* event); // Copied here, formatted and written later
+void log_gamelog(ClueGameLogBuffer_t* buffer); // Its finished games are taken here, written later
+
+// metrics.c
+void metrics_start(const char* path, int interval); // Dump to path every interval seconds and on SIGUSR1, which every thread must already block
+void metrics_stop(); // One last dump
+MetricsBot_t* metrics_bot(const char* name); // Everyone with the same name shares histograms. NULL if metrics are off
+void metrics_decision(MetricsBot_t* bot, int clue_state, int64_t micros); // How long a player took to answer in that CLUE_STATE_*
+void metrics_timeout(MetricsBot_t* bot); // Didn't answer at all
+void metrics_frame_in(int8_t type, int32_t length);
+void metrics_frame_out(int8_t type, int32_t length);
+void metrics_game_over(const ClueEvent_t* event); // The CLUE_EVENT_OVER of every game
+
+// worker.c
+void workers_start(Server_t* server, int num_workers);
+void worker_adopt(Worker_t* worker, Game_t* game); // Called by the lobby thread, the worker owns the game from now on
+void worker_schedule(Worker_t* worker, Game_t* game); // game->deadline moved. Any thread, with the game locked
+
+// headless.c
+int run_headless(ClueRules_t* rules, int num_games, char* roster, int num_threads, uint64_t seed, ClueGameLog_t* game_log); // Play games between in-process bots. seed can be 0, game_log can be NULL
+int replay_game(ClueRules_t* rules, char* roster, uint64_t seed); // Play and narrate one game with the given ClueGame_t.seed
+
+// match.c
+int match_spawn(const char* roster_path, pid_t* pids, int* fds); // Start every bot in the roster file on a socketpair. Returns how many, 0 on failure
+int match_reap(pid_t* pids, int num_bots, int grace_ms); // Wait for the bots to exit, killing whoever takes longer than grace_ms. Returns 1 if they all exited with 0
+
+#endif
@@ -0,0 +1,370 @@
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "server.h"
+
+// Games and the lobby thread drop records into a ring and get straight back to work. One thread
+// drains the ring, formats the records and does all the writing, so nobody else ever waits on
+// the terminal. Producers claim space with a CAS on head, fill it in and publish it by setting
+// kind last. The drain thread reads records in order and zeroes them, then moves tail past. When
+// the ring is full the record is dropped and counted rather than waiting for room. A drain thread
+// that finds nothing spins a little, then raises sleeping and waits on it as a futex. Producers look
+// at sleeping after publishing and only then make the system call to wake it, like clue/shm.h does.
+// Finished games for the game log (-l) are handed over too, and the drain thread writes them once
+// it has CLUE_GAMELOG_BATCH bytes, whenever it runs out of records, and on the way out
+
+#define LOG_RING_SIZE (1024 * 1024)
+#define LOG_SPINS 256 // Looks at an empty ring before the drain thread goes to sleep
+
+#define LOG_RECORD_PAD 1 // Filler up to the end of the ring, the next record is at the start
+#define LOG_RECORD_TEXT 2
+#define LOG_RECORD_EVENT 3
+
+typedef struct {
+    atomic_int kind; // 0 until the producer is done with it
+    int32_t length; // Whole record, header included, a multiple of 8
+} LogRecord_t;
+
+typedef struct {
+    LogRecord_t record;
+    int32_t text_length;
+    char text[];
+} LogText_t;
+
+// A ClueEvent_t copied out, so the game can be long gone by the time it gets formatted
+typedef struct {
+    LogRecord_t record;
+    int game_id;
+    int16_t games_played;
+    int16_t series_length;
+    int8_t type;
+    int8_t player;
+    int8_t correct;
+    int8_t frame_type;
+    int8_t aborted;
+    int8_t name_length;
+    int16_t num_cards;
+    int16_t reason_length;
+    char data[]; // Cards, then the player's name, then the reason
+} LogEvent_t;
+
+int log_level = LOG_LEVEL_INFO;
+
+static struct {
+    const ClueRules_t* rules;
+    char* ring;
+    atomic_llong head; // Next byte producers will claim
+    atomic_llong tail; // Next byte the drain thread will read
+    atomic_llong dropped;
+    atomic_int stop;
+    atomic_int sleeping; // The drain thread found the ring empty and waits to be woken
+    pthread_mutex_t games_lock; // Guards games and games_closed
+    ClueGameLogBuffer_t games; // Finished games handed over since the drain thread last looked
+    int games_closed; // The drain thread took its last look, whoever comes later writes their own
+    atomic_int games_waiting; // games has something in it
+    int running;
+    pthread_t thread;
+} logger;
+
+static LogRecord_t* log_claim(int length); // Room for a record, NULL if the ring is full
+static void log_wake(); // After publishing a record, wake the drain thread if it is asleep
+static void* log_drain(void* arg); // The drain thread
+static int log_ready(); // The record at tail is published, games are waiting, or there will be none
+static void log_take_games(ClueGameLogBuffer_t* batch, int last); // Move the handed over games to batch
+static void log_format_event(const LogEvent_t* event);
+static void log_print_cards(const int16_t* cards, int num_cards); // "(id) name, (id) name\n"
+
+void log_start(const ClueRules_t* rules, int level) {
+    log_level = level;
+    logger.rules = rules;
+    logger.ring = calloc(1, LOG_RING_SIZE);
+    atomic_init(&logger.head, 0);
+    atomic_init(&logger.tail, 0);
+    atomic_init(&logger.dropped, 0);
+    atomic_init(&logger.stop, 0);
+    atomic_init(&logger.sleeping, 0);
+    pthread_mutex_init(&logger.games_lock, NULL);
+    atomic_init(&logger.games_waiting, 0);
+    logger.running = 1;
+    pthread_create(&logger.thread, NULL, log_drain, NULL);
+}
+
+void log_stop() {
+    if (!logger.running) {
+        return;
+    }
+    logger.running = 0;
+    atomic_store(&logger.stop, 1);
+    log_wake();
+    pthread_join(logger.thread, NULL);
+    long long dropped = atomic_load(&logger.dropped);
+    if (dropped > 0) {
+        printf("Dropped %lld log records, the ring was full\n", dropped);
+    }
+    fflush(stdout);
+}
+
+void log_printf(int level, const char* format, ...) {
+    if (level > log_level || atomic_load_explicit(&logger.stop, memory_order_relaxed)) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    int text_length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    LogText_t* text = (LogText_t*)log_claim(sizeof(LogText_t) + text_length + 1);
+    if (text == NULL) {
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(text->text, text_length + 1, format, args);
+    va_end(args);
+    text->text_length = text_length;
+    atomic_store_explicit(&text->record.kind, LOG_RECORD_TEXT, memory_order_release);
+    log_wake();
+}
+
+void log_event(const Game_t* game, const ClueEvent_t* event) {
+    // How it ended is worth knowing by default, the blow by blow is not
+    int level = event->type == CLUE_EVENT_OVER ? LOG_LEVEL_INFO : LOG_LEVEL_EVENTS;
+    if (level > log_level || atomic_load_explicit(&logger.stop, memory_order_relaxed)) {
+        return;
+    }
+    const CluePlayer_t* player = event->player >= 0 ? &game->clue->players[event->player] : NULL;
+    int name_length = player ? player->name_length : 0;
+    int reason_length = event->reason ? strlen(event->reason) : 0;
+    int cards_length = event->num_cards * sizeof(int16_t);
+    LogEvent_t* record = (LogEvent_t*)log_claim(sizeof(LogEvent_t) + cards_length + name_length + reason_length);
+    if (record == NULL) {
+        return;
+    }
+    record->game_id = game->id;
+    record->games_played = game->games_played;
+    record->series_length = game->series_length;
+    record->type = event->type;
+    record->player = event->player;
+    record->correct = event->correct;
+    record->frame_type = event->frame_type;
+    record->aborted = event->aborted;
+    record->name_length = name_length;
+    record->num_cards = event->num_cards;
+    record->reason_length = reason_length;
+    memcpy(record->data, event->cards, cards_length);
+    memcpy(record->data + cards_length, player ? player->name : "", name_length);
+    memcpy(record->data + cards_length + name_length, event->reason, reason_length);
+    atomic_store_explicit(&record->record.kind, LOG_RECORD_EVENT, memory_order_release);
+    log_wake();
+}
+
+void log_gamelog(ClueGameLogBuffer_t* buffer) {
+    pthread_mutex_lock(&logger.games_lock);
+    if (logger.games_closed) {
+        // Nobody left to write them
+        clue_gamelog_flush(buffer);
+    } else {
+        clue_gamelog_take(&logger.games, buffer);
+        atomic_store_explicit(&logger.games_waiting, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&logger.games_lock);
+    log_wake();
+}
+
+static LogRecord_t* log_claim(int length) {
+    length = (length + 7) & ~7;
+    long long head = atomic_load_explicit(&logger.head, memory_order_relaxed);
+    long long pos;
+    long long pad;
+    do {
+        // A record never wraps around, if it doesn't fit at the end it goes at the start
+        pos = head % LOG_RING_SIZE;
+        pad = pos + length > LOG_RING_SIZE ? LOG_RING_SIZE - pos : 0;
+        if (head + pad + length - atomic_load_explicit(&logger.tail, memory_order_acquire) > LOG_RING_SIZE) {
+            atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&logger.head, &head, head + pad + length, memory_order_relaxed, memory_order_relaxed));
+    if (pad > 0) {
+        LogRecord_t* filler = (LogRecord_t*)(logger.ring + pos);
+        filler->length = pad;
+        atomic_store_explicit(&filler->kind, LOG_RECORD_PAD, memory_order_release);
+        pos = 0;
+    }
+    LogRecord_t* record = (LogRecord_t*)(logger.ring + pos);
+    record->length = length;
+    return record;
+}
+
+static void log_wake() {
+    // Pairs with the fence in log_drain: either it sees our record, or we see it asleep
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&logger.sleeping, memory_order_relaxed) && atomic_exchange(&logger.sleeping, 0)) {
+        syscall(SYS_futex, &logger.sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static void* log_drain(void* arg) {
+    int written = 0;
+    ClueGameLogBuffer_t batch = {}; // Games taken off logger.games, written from here
+    for (;;) {
+        if (atomic_load_explicit(&logger.games_waiting, memory_order_relaxed)) {
+            log_take_games(&batch, 0);
+            if (batch.game_start >= CLUE_GAMELOG_BATCH) {
+                clue_gamelog_flush(&batch);
+            }
+        }
+        long long tail = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+        LogRecord_t* record = (LogRecord_t*)(logger.ring + tail % LOG_RING_SIZE);
+        int kind = atomic_load_explicit(&record->kind, memory_order_acquire);
+        if (kind == 0) {
+            // Either empty or somebody is still filling in the next record
+            if (atomic_load(&logger.stop) && tail == atomic_load(&logger.head)) {
+                break;
+            }
+            int spins = 0;
+            while (spins < LOG_SPINS && !log_ready()) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+                spins++;
+            }
+            if (spins < LOG_SPINS) {
+                continue;
+            }
+            if (written) {
+                fflush(stdout);
+                written = 0;
+            }
+            if (batch.game_start > 0) {
+                clue_gamelog_flush(&batch);
+                continue;
+            }
+            atomic_store(&logger.sleeping, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (!log_ready()) {
+                // Whoever publishes next clears sleeping before waking us, so this returns right
+                // away if that already happened
+                syscall(SYS_futex, &logger.sleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+            }
+            atomic_store(&logger.sleeping, 0);
+            continue;
+        }
+        int length = record->length;
+        if (kind == LOG_RECORD_TEXT) {
+            LogText_t* text = (LogText_t*)record;
+            fwrite(text->text, 1, text->text_length, stdout);
+            written = 1;
+        } else if (kind == LOG_RECORD_EVENT) {
+            log_format_event((LogEvent_t*)record);
+            written = 1;
+        }
+        // Wherever the next record headers land must read as 0 until they are published
+        memset(record, 0, length);
+        atomic_store_explicit(&logger.tail, tail + length, memory_order_release);
+    }
+    // Flushes whatever is left
+    log_take_games(&batch, 1);
+    clue_gamelog_buffer_free(&batch);
+    return NULL;
+}
+
+static int log_ready() {
+    long long tail = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+    LogRecord_t* record = (LogRecord_t*)(logger.ring + tail % LOG_RING_SIZE);
+    return atomic_load_explicit(&record->kind, memory_order_acquire) || atomic_load_explicit(&logger.games_waiting, memory_order_relaxed) || atomic_load(&logger.stop);
+}
+
+static void log_take_games(ClueGameLogBuffer_t* batch, int last) {
+    pthread_mutex_lock(&logger.games_lock);
+    clue_gamelog_take(batch, &logger.games);
+    atomic_store_explicit(&logger.games_waiting, 0, memory_order_relaxed);
+    logger.games_closed = last;
+    pthread_mutex_unlock(&logger.games_lock);
+}
+
+static void log_format_event(const LogEvent_t* event) {
+    const ClueRules_t* rules = logger.rules;
+    const int16_t* cards = (const int16_t*)event->data;
+    const char* name = event->data + event->num_cards * sizeof(int16_t);
+    const char* reason = name + event->name_length;
+    int id = event->game_id;
+    int player_id = event->player;
+    int name_length = event->name_length;
+    switch (event->type) {
+    case CLUE_EVENT_SOLUTION:
+        printf("[%d] Solution: ", id);
+        log_print_cards(cards, event->num_cards);
+        break;
+    case CLUE_EVENT_HAND:
+        printf("[%d] (%d) %.*s's hand:\n", id, player_id, name_length, name);
+        for (int i = 0; i < event->num_cards; i++) {
+            printf("  (%d) %s\n", cards[i], rules->card_names[cards[i]]);
+        }
+        break;
+    case CLUE_EVENT_TURN:
+        printf("[%d] (%d) %.*s's turn\n", id, player_id, name_length, name);
+        break;
+    case CLUE_EVENT_SUGGESTION:
+    case CLUE_EVENT_ILLEGAL_SUGGESTION:
+        printf("[%d] (%d) %.*s suggests: ", id, player_id, name_length, name);
+        log_print_cards(cards, event->num_cards);
+        if (event->type == CLUE_EVENT_ILLEGAL_SUGGESTION) {
+            printf("[%d] But it was illegal...\n", id);
+        }
+        break;
+    case CLUE_EVENT_QUERY:
+        printf("[%d] (%d) %.*s is obligated to show\n", id, player_id, name_length, name);
+        break;
+    case CLUE_EVENT_PASS:
+        printf("[%d] (%d) %.*s passed\n", id, player_id, name_length, name);
+        break;
+    case CLUE_EVENT_SHOW:
+        printf("[%d] (%d) %.*s shows ", id, player_id, name_length, name);
+        log_print_cards(cards, event->num_cards);
+        break;
+    case CLUE_EVENT_CHEAT:
+        printf("[%d] (%d) %.*s tried to cheat by showing ", id, player_id, name_length, name);
+        log_print_cards(cards, event->num_cards);
+        break;
+    case CLUE_EVENT_SOLVE_ATTEMPT:
+        printf("[%d] (%d) %.*s attempted to solve: ", id, player_id, name_length, name);
+        log_print_cards(cards, event->num_cards);
+        if (event->correct) {
+            printf("[%d] (%d) %.*s won!\n", id, player_id, name_length, name);
+        } else {
+            printf("[%d] (%d) %.*s was eliminated\n", id, player_id, name_length, name);
+        }
+        break;
+    case CLUE_EVENT_FORFEIT:
+        printf("[%d] (%d) %.*s ran out of time and forfeits\n", id, player_id, name_length, name);
+        break;
+    case CLUE_EVENT_ERROR:
+        printf("[%d] Sending error frame to (%d) %.*s: %.*s\n", id, player_id, name_length, name, event->reason_length, reason);
+        break;
+    case CLUE_EVENT_BAD_FRAME:
+        printf("[%d] (%d) %.*s sent bad frame %d\n", id, player_id, name_length, name, event->frame_type);
+        break;
+    case CLUE_EVENT_OVER:
+        if (event->aborted) {
+            printf("[%d] Aborting game with reason: %.*s\n", id, event->reason_length, reason);
+        } else {
+            printf("[%d] Game %d of %d over: %.*s\n", id, event->games_played + 1, event->series_length, event->reason_length, reason);
+        }
+        break;
+    }
+}
+
+static void log_print_cards(const int16_t* cards, int num_cards) {
+    const ClueRules_t* rules = logger.rules;
+    for (int i = 0; i < num_cards; i++) {
+        int known_card = cards[i] >= 0 && cards[i] < rules->total_cards;
+        printf("(%d) %s%s", cards[i], known_card ? rules->card_names[cards[i]] : "?", i == num_cards - 1 ? "\n" : ", ");
+    }
+}
@@ -0,0 +1,107 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "server.h"
+
+#define MATCH_MAX_LINE 4096
+
+static pid_t spawn_bot(const char* command, int* fd); // Start command with one end of a socketpair as its stdin and stdout. Returns the pid, -1 on failure
+
+int match_spawn(const char* roster_path, pid_t* pids, int* fds) {
+    FILE* roster = fopen(roster_path, "r");
+    if (roster == NULL) {
+        perror(roster_path);
+        return 0;
+    }
+
+    // One shell command per line, blank lines and lines starting with # don't count
+    int num_bots = 0;
+    char line[MATCH_MAX_LINE];
+    while (fgets(line, sizeof(line), roster)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char* command = line + strspn(line, " \t");
+        if (command[0] == '\0' || command[0] == '#') {
+            continue;
+        }
+        if (num_bots >= SERVER_MAX_PLAYERS) {
+            printf("Too many bots (maximum %d)\n", SERVER_MAX_PLAYERS);
+            break;
+        }
+        pids[num_bots] = spawn_bot(command, &fds[num_bots]);
+        if (pids[num_bots] == -1) {
+            break;
+        }
+        num_bots++;
+    }
+    int complete = feof(roster);
+    fclose(roster);
+    if (!complete) {
+        // Whoever got started already won't get a game
+        for (int i = 0; i < num_bots; i++) {
+            close(fds[i]);
+        }
+        match_reap(pids, num_bots, SERVER_CLOSE_GRACE_TIME * 1000);
+        return 0;
+    }
+    if (num_bots == 0) {
+        printf("No bots to play with!\n");
+    }
+    return num_bots;
+}
+
+int match_reap(pid_t* pids, int num_bots, int grace_ms) {
+    // Their sockets are closed, so well behaved bots are on their way out already
+    int clean = 1;
+    int64_t deadline = now_ms() + grace_ms;
+    for (int i = 0; i < num_bots; i++) {
+        int status;
+        pid_t rc;
+        while ((rc = waitpid(pids[i], &status, WNOHANG)) == 0 && now_ms() < deadline) {
+            usleep(1000);
+        }
+        if (rc == 0) {
+            printf("Bot %d (pid %d) is still running, killing it\n", i, (int)pids[i]);
+            kill(-pids[i], SIGKILL);
+            rc = waitpid(pids[i], &status, 0);
+        }
+        if (rc == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            clean = 0;
+        }
+    }
+    return clean;
+}
+
+static pid_t spawn_bot(const char* command, int* fd) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) == -1) {
+        perror(NULL);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror(NULL);
+        close(pair[0]);
+        close(pair[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // dup2 drops CLOEXEC, so the bot keeps these two and nothing else of ours
+        dup2(pair[1], STDIN_FILENO);
+        dup2(pair[1], STDOUT_FILENO);
+        signal(SIGPIPE, SIG_DFL); // Ignoring it would survive exec
+        setpgid(0, 0); // Whatever the shell starts can be killed along with it
+        execl("/bin/sh", "sh", "-c", command, (char*)NULL);
+        _exit(127);
+    }
+    close(pair[1]);
+    fcntl(pair[0], F_SETFL, O_NONBLOCK); // Only our end, the bot gets a plain blocking socket
+    *fd = pair[0];
+    return pid;
+}
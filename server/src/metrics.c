@@ -0,0 +1,355 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "server.h"
+
+// Counters that are cheap enough to leave on. Frames are counted by whichever thread sends or reads
+// them into a shard of its own, so the hot path is a plain add with nobody to fight over the cache
+// line. Decision times go into per-bot log-linear histograms (HDR style: 16 buckets per power of 2,
+// so any value is off by at most 6%) with one relaxed atomic add each. A thread of its own sums it
+// all up and writes JSON every few seconds and on SIGUSR1, so reading never gets in anybody's way
+
+#define METRICS_SUB_BITS 4 // 16 buckets per power of 2
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_MAX_MAGNITUDE 40 // Microseconds, anything past 12 days goes in the last bucket
+#define METRICS_BUCKETS ((METRICS_MAX_MAGNITUDE - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+#define METRICS_MAX_BOTS 64 // Names after this are all counted as METRICS_OTHER_BOTS
+#define METRICS_OTHER_BOTS "(others)"
+#define METRICS_MAX_REASONS 32
+
+typedef struct {
+    atomic_ullong counts[METRICS_BUCKETS];
+    atomic_ullong sum;
+    atomic_ullong max;
+} Histogram_t;
+
+struct MetricsBot_t {
+    char* name;
+    Histogram_t turn; // FRAME_TYPE_TURN to FRAME_TYPE_TURN_RESPONSE or FRAME_TYPE_SOLVE_ATTEMPT
+    Histogram_t query; // FRAME_TYPE_QUERY to FRAME_TYPE_QUERY_RESPONSE
+    atomic_ullong timeouts;
+};
+
+// Only its own thread writes to a shard, anyone may read it
+typedef struct MetricsShard_t {
+    atomic_ullong frames[2][256]; // In and out, by frame type
+    atomic_ullong bytes[2][256];
+    struct MetricsShard_t* next;
+} MetricsShard_t;
+
+static struct {
+    int enabled;
+    const char* path;
+    int interval;
+    int64_t start; // now_ms() when metrics_start was called
+    int64_t last_dump;
+    uint64_t last_games;
+    pthread_t thread;
+
+    pthread_mutex_t lock; // Guards the lists below, not the counters in them
+    MetricsShard_t* shards;
+    MetricsBot_t bots[METRICS_MAX_BOTS];
+    int num_bots;
+    char* reasons[METRICS_MAX_REASONS];
+    atomic_ullong reason_counts[METRICS_MAX_REASONS];
+    int num_reasons;
+
+    atomic_ullong games; // Finished, however they ended
+} metrics = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static _Thread_local MetricsShard_t* shard;
+
+static void* metrics_main(void* arg); // Dump on a timer and on SIGUSR1
+static void metrics_dump(); // Write everything to metrics.path
+static void metrics_count_frame(int direction, int8_t type, int32_t length);
+static void histogram_record(Histogram_t* histogram, uint64_t value);
+static void histogram_write(FILE* out, const Histogram_t* histogram);
+static void json_string(FILE* out, const char* string); // Quoted and escaped
+
+static inline void shard_add(atomic_ullong* counter, uint64_t amount) {
+    // The only writer, so no need for a locked add
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+static inline int histogram_bucket(uint64_t value) {
+    if (value < METRICS_SUB_BUCKETS) {
+        return value;
+    }
+    int magnitude = 63 - __builtin_clzll(value);
+    if (magnitude >= METRICS_MAX_MAGNITUDE) {
+        return METRICS_BUCKETS - 1;
+    }
+    int shift = magnitude - METRICS_SUB_BITS;
+    return (shift + 1) * METRICS_SUB_BUCKETS + (int)((value >> shift) - METRICS_SUB_BUCKETS);
+}
+
+static inline uint64_t histogram_bucket_start(int bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / METRICS_SUB_BUCKETS - 1;
+    return (uint64_t)(bucket % METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS) << shift;
+}
+
+void metrics_start(const char* path, int interval) {
+    metrics.enabled = 1;
+    metrics.path = path;
+    metrics.interval = interval;
+    metrics.start = now_ms();
+    metrics.last_dump = metrics.start;
+    pthread_create(&metrics.thread, NULL, metrics_main, NULL);
+}
+
+void metrics_stop() {
+    if (metrics.enabled) {
+        metrics_dump();
+    }
+}
+
+MetricsBot_t* metrics_bot(const char* name) {
+    if (!metrics.enabled) {
+        return NULL;
+    }
+    pthread_mutex_lock(&metrics.lock);
+    MetricsBot_t* bot = NULL;
+    for (int i = 0; i < metrics.num_bots && bot == NULL; i++) {
+        if (strcmp(metrics.bots[i].name, name) == 0) {
+            bot = &metrics.bots[i];
+        }
+    }
+    if (bot == NULL) {
+        // Out of room, the last one takes in everyone else
+        if (metrics.num_bots == METRICS_MAX_BOTS - 1) {
+            name = METRICS_OTHER_BOTS;
+        }
+        if (metrics.num_bots == METRICS_MAX_BOTS) {
+            bot = &metrics.bots[METRICS_MAX_BOTS - 1];
+        } else {
+            bot = &metrics.bots[metrics.num_bots++];
+            bot->name = strdup(name);
+        }
+    }
+    pthread_mutex_unlock(&metrics.lock);
+    return bot;
+}
+
+void metrics_decision(MetricsBot_t* bot, int clue_state, int64_t micros) {
+    if (bot == NULL) {
+        return;
+    }
+    histogram_record(clue_state == CLUE_STATE_QUERY ? &bot->query : &bot->turn, micros < 0 ? 0 : micros);
+}
+
+void metrics_timeout(MetricsBot_t* bot) {
+    if (bot == NULL) {
+        return;
+    }
+    atomic_fetch_add_explicit(&bot->timeouts, 1, memory_order_relaxed);
+}
+
+void metrics_frame_in(int8_t type, int32_t length) {
+    metrics_count_frame(0, type, length);
+}
+
+void metrics_frame_out(int8_t type, int32_t length) {
+    metrics_count_frame(1, type, length);
+}
+
+void metrics_game_over(const ClueEvent_t* event) {
+    if (!metrics.enabled) {
+        return;
+    }
+    atomic_fetch_add_explicit(&metrics.games, 1, memory_order_relaxed);
+    if (!event->aborted) {
+        return;
+    }
+    // Once a game at most, and there are only a handful of reasons
+    pthread_mutex_lock(&metrics.lock);
+    int idx = -1;
+    for (int i = 0; i < metrics.num_reasons && idx == -1; i++) {
+        if (strcmp(metrics.reasons[i], event->reason) == 0) {
+            idx = i;
+        }
+    }
+    if (idx == -1 && metrics.num_reasons < METRICS_MAX_REASONS) {
+        idx = metrics.num_reasons++;
+        metrics.reasons[idx] = strdup(event->reason);
+    }
+    if (idx != -1) {
+        atomic_fetch_add_explicit(&metrics.reason_counts[idx], 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&metrics.lock);
+}
+
+static void metrics_count_frame(int direction, int8_t type, int32_t length) {
+    if (!metrics.enabled) {
+        return;
+    }
+    if (shard == NULL) {
+        shard = calloc(1, sizeof(MetricsShard_t));
+        pthread_mutex_lock(&metrics.lock);
+        shard->next = metrics.shards;
+        metrics.shards = shard;
+        pthread_mutex_unlock(&metrics.lock);
+    }
+    shard_add(&shard->frames[direction][(uint8_t)type], 1);
+    shard_add(&shard->bytes[direction][(uint8_t)type], length);
+}
+
+static void* metrics_main(void* arg) {
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    struct timespec interval = { metrics.interval, 0 };
+    while (1) {
+        sigtimedwait(&usr1, NULL, &interval);
+        metrics_dump();
+    }
+    return NULL;
+}
+
+static void metrics_dump() {
+    // The timer and exit can both get here
+    static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&dump_lock);
+
+    // Written next to the real file and renamed over it, so readers never see half of one
+    size_t path_length = strlen(metrics.path);
+    char tmp_path[path_length + 5];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics.path);
+    FILE* out = fopen(tmp_path, "w");
+    if (out == NULL) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to write metrics to %s\n", tmp_path);
+        pthread_mutex_unlock(&dump_lock);
+        return;
+    }
+
+    int64_t now = now_ms();
+    uint64_t games = atomic_load(&metrics.games);
+    double since_last = (now - metrics.last_dump) / 1000.0;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"uptime_seconds\": %.3f,\n", (now - metrics.start) / 1000.0);
+    fprintf(out, "  \"games\": %llu,\n", (unsigned long long)games);
+    fprintf(out, "  \"games_per_second\": %.3f,\n", since_last > 0 ? (games - metrics.last_games) / since_last : 0.0);
+    metrics.last_dump = now;
+    metrics.last_games = games;
+
+    pthread_mutex_lock(&metrics.lock);
+    fprintf(out, "  \"aborts\": {");
+    for (int i = 0; i < metrics.num_reasons; i++) {
+        fprintf(out, "%s\n    ", i > 0 ? "," : "");
+        json_string(out, metrics.reasons[i]);
+        fprintf(out, ": %llu", (unsigned long long)atomic_load(&metrics.reason_counts[i]));
+    }
+    fprintf(out, "%s},\n", metrics.num_reasons > 0 ? "\n  " : "");
+
+    // Keyed by frame type, see clue/frames.h
+    static const char* directions[] = { "frames_in", "frames_out" };
+    for (int direction = 0; direction < 2; direction++) {
+        fprintf(out, "  \"%s\": {", directions[direction]);
+        int first = 1;
+        for (int type = 0; type < 256; type++) {
+            uint64_t frames = 0;
+            uint64_t bytes = 0;
+            for (MetricsShard_t* s = metrics.shards; s; s = s->next) {
+                frames += atomic_load_explicit(&s->frames[direction][type], memory_order_relaxed);
+                bytes += atomic_load_explicit(&s->bytes[direction][type], memory_order_relaxed);
+            }
+            if (frames == 0) {
+                continue;
+            }
+            fprintf(out, "%s\n    \"%d\": { \"frames\": %llu, \"bytes\": %llu }", first ? "" : ",", type, (unsigned long long)frames, (unsigned long long)bytes);
+            first = 0;
+        }
+        fprintf(out, "%s},\n", first ? "" : "\n  ");
+    }
+
+    fprintf(out, "  \"bots\": {");
+    for (int i = 0; i < metrics.num_bots; i++) {
+        MetricsBot_t* bot = &metrics.bots[i];
+        fprintf(out, "%s\n    ", i > 0 ? "," : "");
+        json_string(out, bot->name);
+        fprintf(out, ": {\n      \"timeouts\": %llu,\n      \"turn\": ", (unsigned long long)atomic_load(&bot->timeouts));
+        histogram_write(out, &bot->turn);
+        fprintf(out, ",\n      \"query\": ");
+        histogram_write(out, &bot->query);
+        fprintf(out, "\n    }");
+    }
+    fprintf(out, "%s}\n", metrics.num_bots > 0 ? "\n  " : "");
+    pthread_mutex_unlock(&metrics.lock);
+    fprintf(out, "}\n");
+
+    fclose(out);
+    if (rename(tmp_path, metrics.path) == -1) {
+        log_printf(LOG_LEVEL_ERROR, "Failed to move metrics into %s\n", metrics.path);
+    }
+    pthread_mutex_unlock(&dump_lock);
+}
+
+static void histogram_record(Histogram_t* histogram, uint64_t value) {
+    atomic_fetch_add_explicit(&histogram->counts[histogram_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void histogram_write(FILE* out, const Histogram_t* histogram) {
+    // Counts can move while we read, so work from one copy
+    uint64_t counts[METRICS_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        counts[i] = atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        total += counts[i];
+    }
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    uint64_t sum = atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+    fprintf(out, "{ \"count\": %llu, \"mean_us\": %.1f, \"max_us\": %llu", (unsigned long long)total, total > 0 ? (double)sum / total : 0.0, (unsigned long long)max);
+
+    // A percentile is reported as the top of its bucket, so it errs on the slow side
+    static const double percentiles[] = { 50, 90, 99, 99.9 };
+    static const char* percentile_names[] = { "p50", "p90", "p99", "p999" };
+    for (int p = 0; p < 4; p++) {
+        uint64_t rank = total * percentiles[p] / 100;
+        uint64_t seen = 0;
+        uint64_t value = 0;
+        for (int i = 0; i < METRICS_BUCKETS && total > 0; i++) {
+            seen += counts[i];
+            if (seen > rank || seen == total) {
+                value = i + 1 < METRICS_BUCKETS ? histogram_bucket_start(i + 1) - 1 : max;
+                break;
+            }
+        }
+        fprintf(out, ", \"%s_us\": %llu", percentile_names[p], (unsigned long long)(value < max ? value : max));
+    }
+
+    // Only the buckets with something in them, as [lowest value, count]
+    fprintf(out, ", \"buckets\": [");
+    int first = 1;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        if (counts[i] > 0) {
+            fprintf(out, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long)histogram_bucket_start(i), (unsigned long long)counts[i]);
+            first = 0;
+        }
+    }
+    fprintf(out, "] }");
+}
+
+static void json_string(FILE* out, const char* string) {
+    fputc('"', out);
+    for (const char* c = string; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
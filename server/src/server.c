@@ -1,3 +1,5 @@
+#define _GNU_SOURCE // accept4
+
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
@@ -9,51 +11,151 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-#include "frames.h"
-
-typedef struct {
-    uint16_t port;
-    int8_t num_categories;
-    int16_t* num_cards;
-    char*** card_names;
-} Settings_t;
-
-typedef struct {
-    int fd;
-    int eliminated;
-    struct sockaddr_in6 address;
-    int8_t id;
-    int8_t name_length;
-    char* name;
-    int16_t hand_size;
-    int16_t* hand;
-} Player_t;
-
-#define SERVER_LOBBY_WAIT_TIME 10
-#define SERVER_SOCKET_TIMEOUT 3
-
-Settings_t* read_settings_file(char* file_path); // Read settings.txt into the Settings_t structure
-int open_socket(uint16_t port); // Open TCP server socket on specified port and return fd
-void send_error_frame(int fd, const char* reason); // Send FRAME_TYPE_ERROR to a certain client fd
-Player_t* get_players(int fd, RulesFrame_t* rules, int rules_len, int* num_players); // Wait for SERVER_LOBBY_WAIT_TIME seconds for players to connect
+#include "server.h"
+
+#define SERVER_MAX_EVENTS 64
+
+static const char* unix_socket_path; // Set once we are listening on it
+
+int open_socket(uint16_t port); // Open non-blocking TCP server socket on specified port and return fd
+int open_unix_socket(const char* path); // Same for a Unix domain socket at path, replacing whatever was left there
+void remove_unix_socket(); // atexit, so the next run can bind the path again
 void handle_sigint(int signum); // Handle SIGINT by exiting to clean up sockets
-void start_game(Settings_t* settings, char** card_names, int total_cards, Player_t* players, int num_players); // Setup the game
-void shuffle(void* arr, int n, size_t size); // Fisher-Yates shuffle
-void run_game(Settings_t* settings, char** card_names, int16_t* solution, Player_t* players, int num_players); // Setup complete, begin player 1 turn
-void abort_game(Player_t* players, int num_players, const char* reason); // Send abort frame to everyone
-int qsort_int16s(const void* left, const void* right);
-int player_has_card(Player_t* player, int16_t card);
+void run_server(Server_t* server); // Event loop, never returns
+void accept_players(Server_t* server, int listen_fd); // Accept everyone waiting on a listening socket
+void handle_player_event(Server_t* server, Player_t* player, uint32_t events);
+void handle_connect_frame(Server_t* server, Player_t* player, Frame_t* header, char* data); // Validate FRAME_TYPE_CONNECT and put the player in the lobby
+void start_lobby(Server_t* server); // The lobby becomes a game and the next player opens a new one
+void hand_off_games(Server_t* server); // Started games leave the lobby thread for a worker
+void check_deadlines(Server_t* server); // Start lobbies, time out slow connections
+void drop_player(Server_t* server, Player_t* player); // Remove a loose player from the list and free it
+void end_match(Server_t* server); // server -x is done: reap the bots and exit
 
 int main(int argc, char** argv) {
     signal(SIGINT, handle_sigint);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Options first, then the settings file
+    int headless_games = 0;
+    int series_length = 1;
+    int lobby_quorum = 0;
+    int lobby_wait = SERVER_LOBBY_WAIT_TIME * 1000;
+    char* roster = "randy,randy,randy";
+    char* game_log_path = NULL;
+    uint64_t seed = 0;
+    int replay = 0;
+    int level = LOG_LEVEL_INFO;
+    char* metrics_path = NULL;
+    char* socket_path = NULL;
+    char* match_path = NULL;
+    int metrics_interval = SERVER_METRICS_INTERVAL;
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    TimeControl_t time_control = {};
+    time_control.move_ms = SERVER_MOVE_TIME * 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:w:n:H:b:t:l:s:r:qvm:M:T:C:Fu:x:")) != -1) {
+        switch (opt) {
+        case 'p':
+            lobby_quorum = atoi(optarg);
+            if (lobby_quorum < 1 || lobby_quorum > SERVER_MAX_PLAYERS) {
+                printf("Player count must be between 1 and %d\n", SERVER_MAX_PLAYERS);
+                exit(1);
+            }
+            break;
+        case 'w':
+            lobby_wait = atof(optarg) * 1000;
+            break;
+        case 'n':
+            series_length = atoi(optarg);
+            if (series_length < 1 || series_length > 0x7FFF) {
+                printf("Series length must be between 1 and 32767\n");
+                exit(1);
+            }
+            break;
+        case 'H':
+            headless_games = atoi(optarg);
+            break;
+        case 'b':
+            roster = optarg;
+            break;
+        case 't':
+            num_threads = atoi(optarg);
+            if (num_threads < 1) {
+                printf("Need at least one thread\n");
+                exit(1);
+            }
+            break;
+        case 'l':
+            game_log_path = optarg;
+            break;
+        case 's':
+        case 'r':
+            seed = strtoull(optarg, NULL, 0);
+            if (seed == 0) {
+                printf("Seed must be a positive integer\n");
+                exit(1);
+            }
+            replay = opt == 'r';
+            break;
+        case 'q':
+            level = LOG_LEVEL_ERROR;
+            break;
+        case 'v':
+            level = LOG_LEVEL_EVENTS;
+            break;
+        case 'm':
+            metrics_path = optarg;
+            break;
+        case 'M':
+            metrics_interval = atoi(optarg);
+            if (metrics_interval < 1) {
+                printf("Metrics interval must be at least 1 second\n");
+                exit(1);
+            }
+            break;
+        case 'T':
+            time_control.move_ms = atof(optarg) * 1000;
+            if (time_control.move_ms < 0) {
+                printf("Move time can't be negative, 0 means no limit\n");
+                exit(1);
+            }
+            break;
+        case 'C': {
+            // Seconds for the whole game, optionally +seconds back after every answer
+            char* increment = strchr(optarg, '+');
+            time_control.clock_ms = atof(optarg) * 1000;
+            time_control.increment_ms = increment ? atof(increment + 1) * 1000 : 0;
+            if (time_control.clock_ms <= 0 || time_control.increment_ms < 0) {
+                printf("Clock must be positive seconds, optionally +increment_seconds\n");
+                exit(1);
+            }
+            break;
+        }
+        case 'F':
+            time_control.forfeit = 1;
+            break;
+        case 'u':
+            socket_path = optarg;
+            break;
+        case 'x':
+            match_path = optarg;
+            break;
+        default:
+            printf("Usage: %s [-p players] [-w max_lobby_seconds] [-n series_length] [-H games] [-b bot,bot,...] [-t threads] [-l game_log] [-s seed] [-r game_seed] [-q | -v] [-m metrics.json] [-M metrics_seconds] [-T move_seconds] [-C clock_seconds[+increment_seconds]] [-F] [-u socket_path] [-x roster_file] [settings.txt]\n", argv[0]);
+            exit(1);
+        }
+    }
 
     // Read the settings file
     char* config_file = "settings.txt";
-    if (argc >= 2) {
-        config_file = argv[1];
+    if (optind < argc) {
+        config_file = argv[optind];
     }
     Settings_t* settings = read_settings_file(config_file);
     if (settings == NULL) {
@@ -61,207 +163,191 @@ int main(int argc, char** argv) {
         exit(1);
     }
 
-    // Open server socket
-    int sock_fd = open_socket(settings->port);
-    if (sock_fd == -1) {
-        printf("Failed to open socket\n");
-        exit(1);
-    }
-
-    // Print out info about the game and sum up the lengths of the card names
-    int all_names_len = 0;
+    // Flatten the categories into what the rules engine wants
     int total_cards = 0;
-    printf("Started server on port %d\n", settings->port);
     for (int i = 0; i < settings->num_categories; i++) {
-        printf("\nCategory %d (%d cards)\n", i, settings->num_cards[i]);
-        for (int j = 0; j < settings->num_cards[i]; j++) {
-            total_cards++;
-            all_names_len += strlen(settings->card_names[i][j]);
-            printf("%s\n", settings->card_names[i][j]);
-        }
+        total_cards += settings->num_cards[i];
     }
-    printf("\n");
-
-    // Prepare the rules frame for anyone who connects
-    char** card_names_debug = malloc(total_cards * sizeof(char*));
-    int rules_len = sizeof(RulesFrame_t) + settings->num_categories * sizeof(int16_t) + total_cards * sizeof(int16_t) + total_cards + all_names_len;
-    RulesFrame_t* rules = malloc(rules_len);
-    int16_t* rules_category_sizes = (int16_t*)&rules->num_cards_in_category;
-    int16_t* rules_category_card_ids = (int16_t*)((char*)rules_category_sizes + settings->num_categories * sizeof(int16_t));
-    char* rules_card_names = (char*)rules_category_card_ids + total_cards * sizeof(int16_t);
-    rules->player_id = 0;
-    rules->num_categories = settings->num_categories;
-    rules->num_cards = total_cards;
+    ClueRules_t clue_rules = {};
+    clue_rules.num_categories = settings->num_categories;
+    clue_rules.num_cards = settings->num_cards;
+    clue_rules.total_cards = total_cards;
+    clue_rules.card_names = malloc(total_cards * sizeof(char*));
     int card_idx = 0;
     for (int i = 0; i < settings->num_categories; i++) {
-        rules_category_sizes[i] = settings->num_cards[i];
         for (int j = 0; j < settings->num_cards[i]; j++) {
-            rules_category_card_ids[card_idx] = card_idx; // Only after writing this do I realize it's unnecessary... but it's good QoL
-            card_names_debug[card_idx] = settings->card_names[i][j];
-            card_idx++;
-            int8_t name_length = strlen(settings->card_names[i][j]);
-            *rules_card_names = name_length;
-            rules_card_names++;
-            memcpy(rules_card_names, settings->card_names[i][j], name_length);
-            rules_card_names += name_length;
+            clue_rules.card_names[card_idx++] = settings->card_names[i][j];
         }
     }
 
-    // Allow some players to connect before the game begins
-    listen(sock_fd, 127);
-    printf("Waiting for players...\n");
-    int num_players;
-    Player_t* players = get_players(sock_fd, rules, rules_len, &num_players);
-    if (num_players <= 0) {
-        printf("No players connected!\n");
-        exit(0);
+    if (replay) {
+        // Seeing the game is the whole point
+        log_start(&clue_rules, LOG_LEVEL_EVENTS);
+        int status = replay_game(&clue_rules, roster, seed);
+        log_stop();
+        exit(status);
     }
-    printf("\n");
-
-    // Now start the game
-    printf("Starting game\n");
-    start_game(settings, card_names_debug, total_cards, players, num_players);
 
-    // We don't actually need to free since the OS will do it for us
-    // but I want to visualize what is allocated
-    for (int i = 0; i < num_players; i++) {
-        close(players[i].fd);
-        free(players[i].name);
+    // Every event of every game, in binary (see clue/gamelog.h)
+    ClueGameLog_t* game_log = NULL;
+    if (game_log_path) {
+        game_log = clue_gamelog_open(game_log_path, &clue_rules);
+        if (game_log == NULL) {
+            exit(1);
+        }
     }
-    free(players);
-    free(rules);
-    free(card_names_debug);
-    for (int i = 0; i < settings->num_categories; i++) {
-        for (int j = 0; j < settings->num_cards[i]; j++) {
-            free(settings->card_names[i][j]);
+
+    if (headless_games > 0) {
+        int status = run_headless(&clue_rules, headless_games, roster, num_threads, seed, game_log);
+        if (game_log) {
+            clue_gamelog_close(game_log);
         }
-        free(settings->card_names[i]);
+        exit(status);
     }
-    free(settings->card_names); // 3 layers of allocation wow
-    free(settings->num_cards);
-    free(settings);
 
-    printf("Server shut down gracefully\n");
-    exit(0);
-}
+    // A match runner starts its own bots and has no use for a port. Before any thread starts, so
+    // fork only has to think about this one
+    pid_t bots[SERVER_MAX_PLAYERS];
+    int bot_fds[SERVER_MAX_PLAYERS];
+    int num_bots = 0;
+    if (match_path) {
+        num_bots = match_spawn(match_path, bots, bot_fds);
+        if (num_bots == 0) {
+            exit(1);
+        }
+    }
 
-Settings_t* read_settings_file(char* file_path) {
-    FILE* fp = fopen(file_path, "r");
-    if (fp == NULL) {
-        perror(NULL);
-        return NULL;
-    }
-    Settings_t* settings = malloc(sizeof(Settings_t));
-    char line[256];
-    int line_number = 0;
-    
-    // The first line of the file should be the port
-    if (fgets(line, sizeof(line), fp) == NULL) {
-        printf("Expected integer port number on line %d\n", line_number);
-        free(settings);
-        return NULL;
-    }
-    line_number++;
-    settings->port = atoi(line);
-    if (settings->port == 0) {
-        printf("Expected integer port number on line %d\n", line_number);
-        free(settings);
-        return NULL;
-    }
-
-    // Then there should be an empty line
-    if (fgets(line, sizeof(line), fp) == NULL) {
-        printf("Expected blank line on line %d\n", line_number);
-        free(settings);
-        return NULL;
-    }
-    line_number++;
-    if (strlen(line) > 1) {
-        printf("Expected blank line on line %d\n", line_number);
-        free(settings);
-        return NULL;
-    }
-
-    // Now we need to set up the categories
-    int total_cards = 0;
-    int categories_len = 0;
-    int categories_size = 10;
-    int16_t* categories_lengths = malloc(categories_size * sizeof(int16_t));
-    char*** categories_names = malloc(categories_size * sizeof(char**));
-    int category_len = 0;
-    int category_size = 10;
-    char** category_names = malloc(category_size * sizeof(char*));
-    while (1) {
-        if (fgets(line, sizeof(line), fp) == NULL) {
-            // Done with the file
-            break;
+    // Open server socket, and the Unix one for bots on this machine
+    int sock_fd = -1;
+    if (!match_path) {
+        sock_fd = open_socket(settings->port);
+        if (sock_fd == -1) {
+            printf("Failed to open socket\n");
+            exit(1);
         }
-        line_number++;
-        int line_length = strlen(line);
-        if (line_length <= 1) {
-            // The line is blank, advance to the next category
-            if (category_len == 0) {
-                continue;
-            }
-            if (categories_len >= categories_size) {
-                categories_size *= 2;
-                categories_lengths = realloc(categories_lengths, categories_size * sizeof(int16_t));
-                categories_names = realloc(categories_names, categories_size * sizeof(char**));
-            }
-            categories_lengths[categories_len] = category_len;
-            categories_names[categories_len] = realloc(category_names, category_len * sizeof(char*));
-            categories_len++;
-            category_len = 0;
-            category_size = 10;
-            category_names = malloc(category_size * sizeof(char*));
-        } else if (line_length > 127) {
-            // Too long to store the length in a int8
-            printf("Card name too long on line %d (max length 127)\n", line_number);
-        } else {
-            // Add to current category
-            if (category_len >= category_size) {
-                category_size *= 2;
-                category_names = realloc(category_names, category_size * sizeof(char*));
-            }
-            char* new_string = malloc(line_length);
-            memcpy(new_string, line, line_length);
-            new_string[line_length - 1] = '\0';
-            category_names[category_len] = new_string;
-            category_len++;
-            total_cards++;
+    }
+    int unix_fd = -1;
+    if (socket_path && !match_path) {
+        unix_fd = open_unix_socket(socket_path);
+        if (unix_fd == -1) {
+            printf("Failed to open Unix socket %s\n", socket_path);
+            exit(1);
         }
+        atexit(remove_unix_socket);
     }
 
-    if (category_len > 0) {
-        if (categories_len >= categories_size) {
-            categories_size *= 2;
-            categories_lengths = realloc(categories_lengths, categories_size * sizeof(int16_t));
-            categories_names = realloc(categories_names, categories_size * sizeof(char**));
-        }
-        categories_lengths[categories_len] = category_len;
-        categories_names[categories_len] = realloc(category_names, category_len * sizeof(char*));
-        categories_len++;
+    // Print out info about the game
+    if (match_path) {
+        printf("Running a match between %d bots\n", num_bots);
     } else {
-        free(category_names);
+        printf("Started server on port %d\n", settings->port);
+    }
+    if (unix_fd != -1) {
+        printf("Also listening on %s\n", socket_path);
+    }
+    for (int i = 0; i < settings->num_categories; i++) {
+        printf("\nCategory %d (%d cards)\n", i, settings->num_cards[i]);
+        if (settings->num_cards[i] > SERVER_MAX_LISTED_CARDS) {
+            // A big deck would bury everything else
+            continue;
+        }
+        for (int j = 0; j < settings->num_cards[i]; j++) {
+            printf("%s\n", settings->card_names[i][j]);
+        }
+    }
+    printf("\n");
+
+    // SIGUSR1 only ever goes to the metrics thread, so it's blocked before the first thread starts
+    // and every one after inherits that. The bots are already forked, they keep the default
+    if (metrics_path) {
+        sigset_t usr1;
+        sigemptyset(&usr1);
+        sigaddset(&usr1, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &usr1, NULL);
     }
 
-    fclose(fp);
+    // From here on everything goes through the log thread. exit runs log_stop, so ^C loses nothing
+    log_start(&clue_rules, level);
+    atexit(log_stop);
+    if (metrics_path) {
+        metrics_start(metrics_path, metrics_interval);
+        atexit(metrics_stop);
+    }
 
-    if (total_cards > 0x7FFF) {
-        // Too big for an int16
-        printf("Too many cards %d (maximum 32767)\n", total_cards);
+    // Prepare the rules frame for anyone who connects
+    int rules_len;
+    char* rules = clue_rules_frame(&clue_rules, &rules_len);
+    player_out_max = SERVER_OUT_MAX + rules_len; // A big deck's RULES alone can be more than SERVER_OUT_MAX
+
+    // Everything from here on happens in the event loop
+    Server_t server = {};
+    server.settings = settings;
+    server.clue_rules = clue_rules;
+    server.series_length = series_length;
+    server.game_log = game_log;
+    server.seed = seed;
+    server.time_control = time_control;
+    server.lobby_quorum = lobby_quorum;
+    server.lobby_wait = lobby_wait;
+    server.rules = rules;
+    server.rules_len = rules_len;
+    clue_compact_init(&server.compact, clue_rules.num_categories, clue_rules.num_cards);
+    server.listen_fd = sock_fd;
+    server.unix_fd = unix_fd;
+    server.match_fd = -1;
+    server.epoll_fd = epoll_create1(0);
+    if (server.epoll_fd == -1) {
+        perror(NULL);
+        exit(1);
+    }
+    struct epoll_event listen_event = {};
+    listen_event.events = EPOLLIN;
+    if (sock_fd != -1) {
+        listen_event.data.ptr = &server.listen_fd; // A pointer to one of the listening fds means accept
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, sock_fd, &listen_event);
+    }
+    if (unix_fd != -1) {
+        listen_event.data.ptr = &server.unix_fd;
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, unix_fd, &listen_event);
+    }
+    if (match_path) {
+        // The bots are already connected, the game starts the moment the last one says hello
+        server.bots = bots;
+        server.num_bots = num_bots;
+        server.lobby_quorum = num_bots;
+        server.lobby_wait = SERVER_SOCKET_TIMEOUT * 1000;
+        server.match_fd = eventfd(0, EFD_CLOEXEC);
+        if (server.match_fd == -1) {
+            perror(NULL);
+            exit(1);
+        }
+        listen_event.data.ptr = &server.match_fd;
+        epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.match_fd, &listen_event);
+        struct sockaddr_storage address = {};
+        address.ss_family = AF_UNIX;
+        for (int i = 0; i < num_bots; i++) {
+            add_loose_player(&server, bot_fds[i], &address);
+        }
     }
 
-    settings->num_categories = categories_len;
-    settings->num_cards = categories_lengths;
-    settings->card_names = categories_names;
-    
-    return settings;
+    workers_start(&server, num_threads);
+    if (sock_fd != -1) {
+        listen(sock_fd, 127);
+    }
+    if (unix_fd != -1) {
+        listen(unix_fd, 127);
+    }
+    if (match_path) {
+        log_printf(LOG_LEVEL_INFO, "Waiting for %d bots on %d threads...\n", num_bots, num_threads);
+    } else {
+        log_printf(LOG_LEVEL_INFO, "Waiting for players on %d threads...\n", num_threads);
+    }
+    run_server(&server);
 }
 
 int open_socket(uint16_t port) {
     int rc;
-    int socket_fd = socket(AF_INET6, SOCK_STREAM, 0);
+    int socket_fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (socket_fd == -1) {
         perror(NULL);
         return -1;
@@ -272,10 +358,8 @@ int open_socket(uint16_t port) {
         perror(NULL);
         return -1;
     }
-    struct timeval timeout;
-    timeout.tv_sec = SERVER_SOCKET_TIMEOUT;
-    timeout.tv_usec = 0;
-    rc = setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int opt_true = 1;
+    rc = setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &opt_true, sizeof(opt_true)); // Batch runs restart us back to back
     if (rc == -1) {
         perror(NULL);
         return -1;
@@ -295,542 +379,323 @@ int open_socket(uint16_t port) {
     return socket_fd;
 }
 
-void send_error_frame(int fd, const char* reason) {
-    // Don't bother waiting
-    printf("Sending error frame: %s\n", reason);
-    Frame_t header = {};
-    ErrorFrame_t error = {};
-    error.error_length = strlen(reason);
-    header.type = FRAME_TYPE_ERROR;
-    header.data_length = sizeof(error) + error.error_length;
-    send(fd, &header, sizeof(header), MSG_DONTWAIT);
-    send(fd, &error, sizeof(error), MSG_DONTWAIT);
-    send(fd, reason, error.error_length, 0); // Going to block on this because the game is probably about to abort (read: close the socket)
+int open_unix_socket(const char* path) {
+    struct sockaddr_un socket_address = {};
+    socket_address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(socket_address.sun_path)) {
+        printf("Socket path too long (max %d)\n", (int)sizeof(socket_address.sun_path) - 1);
+        return -1;
+    }
+    strcpy(socket_address.sun_path, path);
+    int socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (socket_fd == -1) {
+        perror(NULL);
+        return -1;
+    }
+    // Left behind by a run that didn't get to clean up. Same idea as SO_REUSEADDR
+    unlink(path);
+    if (bind(socket_fd, (const struct sockaddr*)&socket_address, sizeof(socket_address)) == -1) {
+        perror(NULL);
+        close(socket_fd);
+        return -1;
+    }
+    unix_socket_path = path;
+    return socket_fd;
 }
 
-Player_t* get_players(int fd, RulesFrame_t* rules, int rules_len, int* num_players) {
-    *num_players = 0;
-    int size_players = 10;
-    Player_t* players = malloc(sizeof(Player_t) * size_players);
-    time_t begin_time;
-    begin_time = time(0) + SERVER_LOBBY_WAIT_TIME;
-    while (time(0) < begin_time && *num_players < 128) {
-        struct sockaddr_in6 client_address;
-        socklen_t client_address_length = sizeof(client_address);
-        int client_fd = accept(fd, (struct sockaddr*)&client_address, &client_address_length);
-        if (client_fd == -1) {
-            if (errno == EAGAIN) {
-                // Accept timed out, expected since we block
-                continue;
-            }
-            perror(NULL);
-            exit(1);
-        }
+void remove_unix_socket() {
+    if (unix_socket_path) {
+        unlink(unix_socket_path);
+    }
+}
 
-        // Got a real connection, await a connect frame
-        Frame_t frame_header;
-        size_t data_len = recv(client_fd, &frame_header, sizeof(frame_header), MSG_WAITALL);
-        if (data_len < sizeof(frame_header)) {
-            if (data_len == -1 && errno == EAGAIN) {  
-                send_error_frame(client_fd, "Timed out");
-            } else {
-                send_error_frame(client_fd, "Incomplete frame header");
-            }
-            close(client_fd);
-            continue;
+void handle_sigint(int signum) {
+    // Tired of the port being bound
+    exit(0);
+}
+
+int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void run_server(Server_t* server) {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (1) {
+        // Sleep until something happens or the closest deadline passes
+        int64_t next_deadline = -1;
+        if (server->lobby) {
+            next_deadline = server->lobby->deadline;
         }
-        ConnectFrame_t connect_frame;
-        data_len = recv(client_fd, &connect_frame, sizeof(connect_frame), MSG_WAITALL);
-        if (data_len < sizeof(connect_frame)) {
-            if (data_len == -1 && errno == EAGAIN) {  
-                send_error_frame(client_fd, "Timed out");
-            } else {
-                send_error_frame(client_fd, "Incomplete connect frame");
+        for (Player_t* player = server->loose_players; player; player = player->next) {
+            if (next_deadline == -1 || player->deadline < next_deadline) {
+                next_deadline = player->deadline;
             }
-            close(client_fd);
-            continue;
         }
-        if (connect_frame.name_length < 0) {
-            send_error_frame(client_fd, "Negative name length not allowed");
-            close(client_fd);
-            continue;
+        int timeout = -1;
+        if (next_deadline != -1) {
+            int64_t wait = next_deadline - now_ms();
+            timeout = wait < 0 ? 0 : wait + 1;
         }
-        char* player_name = malloc(connect_frame.name_length + 1);
-        data_len = recv(client_fd, player_name, connect_frame.name_length, MSG_WAITALL);
-        if (data_len < connect_frame.name_length) {
-            if (data_len == -1 && errno == EAGAIN) {  
-                send_error_frame(client_fd, "Timed out");
+
+        int num_events = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, timeout);
+        if (num_events == -1 && errno != EINTR) {
+            perror(NULL);
+            exit(1);
+        }
+        for (int i = 0; i < num_events; i++) {
+            if (events[i].data.ptr == &server->listen_fd || events[i].data.ptr == &server->unix_fd) {
+                accept_players(server, *(int*)events[i].data.ptr);
+            } else if (events[i].data.ptr == &server->match_fd) {
+                end_match(server);
             } else {
-                send_error_frame(client_fd, "Incomplete connect frame name");
+                handle_player_event(server, events[i].data.ptr, events[i].events);
             }
-            close(client_fd);
-            free(player_name);
-            continue;
         }
-        if (strnlen(player_name, connect_frame.name_length) < connect_frame.name_length) {
-            // This guy thinks he's really funny sending a null character in the name
-            send_error_frame(client_fd, "Null character not allowed in name");
-            close(client_fd);
-            free(player_name);
-            continue;
+        check_deadlines(server);
+        hand_off_games(server);
+        if (server->match_fd != -1 && server->next_game_id == 0 && server->loose_players == NULL) {
+            log_printf(LOG_LEVEL_ERROR, "None of the bots connected\n");
+            end_match(server);
         }
-        player_name[connect_frame.name_length] = '\0';
-
-        // Got a full connect frame, send rules and add the player to the list
-        Frame_t rules_frame_header = {};
-        rules_frame_header.type = FRAME_TYPE_RULES;
-        rules_frame_header.data_length = rules_len;
-        send(client_fd, &rules_frame_header, sizeof(rules_frame_header), MSG_DONTWAIT);
-        rules->player_id = *num_players;
-        if (send(client_fd, rules, rules_len, 0) < 0) {
-            perror(NULL);
-            close(client_fd);
-            free(player_name);
-            continue;
-        }
-
-        char ip_tmp[128];
-        inet_ntop(AF_INET6, &client_address.sin6_addr, ip_tmp, sizeof(struct in6_addr));
-        printf("%s connected from %s %d\n", player_name, ip_tmp, client_address.sin6_port);
-        if (*num_players >= size_players) {
-            size_players *= 2;
-            players = realloc(players, size_players * sizeof(Player_t));
-        }
-        players[*num_players].fd = client_fd;
-        players[*num_players].eliminated = 0;
-        players[*num_players].name_length = connect_frame.name_length;
-        players[*num_players].name = player_name;
-        players[*num_players].id = *num_players;
-        players[*num_players].address = client_address;
-        (*num_players)++;
     }
-
-    return realloc(players, *num_players * sizeof(Player_t));
 }
 
-void handle_sigint(int signum) {
-    // Tired of the port being bound
-    exit(0);
-}
-
-void start_game(Settings_t* settings, char** card_names, int total_cards, Player_t* players, int num_players) {
-    srand(time(0));
-    assert(settings->num_categories > 0);
-    assert(total_cards - settings->num_categories > 0);
-
-    // Pick out the cards that are in the solution and put the rest in the deck
-    printf("Solution: ");
-    int16_t base_idx = 0;
-    int16_t solution[settings->num_categories];
-    int deck_len = 0;
-    int16_t deck[total_cards - settings->num_categories];
-    for (int i = 0; i < settings->num_categories; i++) {
-        // Choose the solution for this card
-        solution[i] = base_idx + rand() % settings->num_cards[i];
-        if (i == settings->num_categories - 1) {
-            printf("(%d) %s\n", solution[i], card_names[solution[i]]);
-        } else {
-            printf("(%d) %s, ", solution[i], card_names[solution[i]]);
-        }
-        
-        // Put the rest in the deck
-        for (int j = 0; j < settings->num_cards[i]; j++) {
-            if (base_idx + j == solution[i]) {
-                continue;
+void accept_players(Server_t* server, int listen_fd) {
+    while (1) {
+        struct sockaddr_storage client_address = {};
+        socklen_t client_address_length = sizeof(client_address);
+        int client_fd = accept4(listen_fd, (struct sockaddr*)&client_address, &client_address_length, SOCK_NONBLOCK);
+        if (client_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror(NULL);
             }
-            deck[deck_len++] = base_idx + j;
+            return;
         }
 
-        base_idx += settings->num_cards[i];
+        add_loose_player(server, client_fd, &client_address);
     }
-    assert(deck_len == total_cards - settings->num_categories);
+}
 
-    // Shuffle the deck and shuffle the player order. Also need to total player name lengths
-    int total_player_name_length = 0;
-    shuffle(deck, deck_len, sizeof(int16_t));
-    shuffle(players, num_players, sizeof(Player_t));
-    for (int i = 0; i < num_players; i++) {
-        players[i].hand = malloc((deck_len / num_players + 1) * sizeof(int16_t));
-        total_player_name_length += players[i].name_length;
-    }
+void add_loose_player(Server_t* server, int fd, const struct sockaddr_storage* address) {
+    // Got a real connection, it has SERVER_SOCKET_TIMEOUT seconds to send a connect frame
+    Player_t* player = calloc(1, sizeof(Player_t));
+    player->fd = fd;
+    player->state = PLAYER_STATE_CONNECTING;
+    player->address = *address;
+    player->deadline = now_ms() + SERVER_SOCKET_TIMEOUT * 1000;
+    player->doorbell = -1;
+    clue_stream_init(&player->in, 4096);
+    player->next = server->loose_players;
+    server->loose_players = player;
+    player_watch(player, server->epoll_fd);
+}
 
-    // Deal the player hands
-    int deal_idx = 0;
-    for (int i = 0; i < deck_len; i++) {
-        players[deal_idx].hand[players[deal_idx].hand_size++] = deck[i];
-        deal_idx++;
-        deal_idx = deal_idx % num_players;
+void handle_player_event(Server_t* server, Player_t* player, uint32_t events) {
+    if (player->disconnected || player->state == PLAYER_STATE_PLAYING) {
+        // Lobby players who dropped wait for the game to notice. Anyone playing belongs to a worker
+        return;
+    }
+    if (!player_service(player, events)) {
+        return;
     }
 
-    // Send everyone the game start frame which is personalized
-    for (int i = 0; i < num_players; i++) {
-        // We are going to sneak and sort the player's hand here to make things easier
-        qsort(players[i].hand, players[i].hand_size, sizeof(int16_t), qsort_int16s);
-
-        printf("(%d) %s's hand:\n", players[i].id, players[i].name);
-        for (int j = 0; j < players[i].hand_size; j++) {
-            printf("  (%d) %s\n", players[i].hand[j], card_names[players[i].hand[j]]);
+    // Hand every whole frame to whoever is responsible for this player
+    Frame_t header;
+    char* data;
+    while (!player->disconnected && player->state != PLAYER_STATE_PLAYING) {
+        if (player->out_queued > SERVER_OUT_HIGH_WATER) {
+            // The rest waits until their output drains
+            player->read_paused = 1;
+            break;
         }
-
-        Frame_t header = {};
-        header.type = FRAME_TYPE_START;
-        header.data_length = sizeof(StartFrame_t) +
-            sizeof(int16_t) * players[i].hand_size + // your_hand
-            sizeof(int8_t) * num_players + // num_players
-            sizeof(int16_t) * num_players + // player_hand_sizes
-            sizeof(int8_t) * num_players + // name_length
-            total_player_name_length; // name
-
-        StartFrame_t* start_frame = calloc(header.data_length, 1);
-        start_frame->your_hand_size = players[i].hand_size;
-        start_frame->num_players = num_players;
-        int16_t* your_hand = (int16_t*)&start_frame->your_hand;
-        int8_t* player_order = (int8_t*)((char*)your_hand + players[i].hand_size * sizeof(int16_t));
-        int16_t* player_hand_sizes = (int16_t*)((char*)player_order + num_players * sizeof(int8_t));
-        char* player_names = (char*)player_hand_sizes + sizeof(int16_t) * num_players;
-
-        memcpy(your_hand, players[i].hand, sizeof(int16_t) * players[i].hand_size);
-        for (int j = 0; j < num_players; j++) {
-            player_order[j] = players[j].id;
-            player_hand_sizes[j] = players[j].hand_size;
-            *player_names++ = players[j].name_length;
-            memcpy(player_names, players[j].name, players[j].name_length);
-            player_names += players[j].name_length;
+        int rc = player_next_frame(player, &header, &data);
+        if (rc == 0) {
+            break;
+        } else if (rc == -1) {
+            send_error_frame(player, "Bad frame length");
+            player->disconnected = 1;
+            break;
         }
-
-        send(players[i].fd, &header, sizeof(header), MSG_DONTWAIT);
-        if (send(players[i].fd, start_frame, header.data_length, 0) < 0) {
-            abort_game(players, num_players, "Player disconnected");
+        if (player->state == PLAYER_STATE_CONNECTING && header.type == FRAME_TYPE_SHM_ATTACH) {
+            // Everything else they send comes through shared memory. Only makes sense on this machine
+            if (player->address.ss_family != AF_UNIX || player->shm || header.data_length != 0) {
+                send_error_frame(player, "Shared memory is only for the Unix socket, and only as the first frame");
+                player->disconnected = 1;
+            } else if (!player_attach_shm(player, server->epoll_fd)) {
+                player->disconnected = 1;
+            }
+        } else if (player->state == PLAYER_STATE_CONNECTING) {
+            handle_connect_frame(server, player, &header, data);
+        } else if (player->state == PLAYER_STATE_LOBBY) {
+            send_error_frame(player, "Game has not started");
         }
-        free(start_frame);
     }
 
-    run_game(settings, card_names, solution, players, num_players);
-}
-
-void shuffle(void* arr, int n, size_t size) {
-    // Shuffle array in place via Fisher-Yates
-    char tmp[size];
-    for (int i = 0; i < n; i++) {
-        int idx = rand() % (i + 1);
-        memcpy(tmp, (char*)arr + size * idx, size);
-        memcpy((char*)arr + size * idx, (char*)arr + size * i, size);
-        memcpy((char*)arr + size * i, tmp, size);
+    if (player->disconnected && player->state == PLAYER_STATE_CONNECTING) {
+        drop_player(server, player);
     }
+    // Lobby players stay put until the game starts and notices
 }
 
-void run_game(Settings_t* settings, char** card_names, int16_t* solution, Player_t* players, int num_players) {
-    int turn_idx = -1; // Since we index at the start
-    int received_size;
-    while (1) {
-        turn_idx++;
-        turn_idx = turn_idx % num_players;
-
-        // First: are all the players eliminated?
-        int not_eliminated = 0;
-        for (int i = 0; i < num_players; i++) {
-            if (!players[i].eliminated) {
-                not_eliminated++;
-            }
-        }
-        if (not_eliminated == 0) {
-            abort_game(players, num_players, "All players eliminated");
-        }
+void handle_connect_frame(Server_t* server, Player_t* player, Frame_t* header, char* data) {
+    if (header->type != FRAME_TYPE_CONNECT || header->data_length < (int)sizeof(ConnectFrame_t)) {
+        send_error_frame(player, "Incomplete connect frame");
+        player->disconnected = 1;
+        return;
+    }
+    ConnectFrame_t* connect_frame = (ConnectFrame_t*)data;
+    if (connect_frame->name_length < 0) {
+        send_error_frame(player, "Negative name length not allowed");
+        player->disconnected = 1;
+        return;
+    }
+    if (header->data_length < (int)sizeof(ConnectFrame_t) + connect_frame->name_length) {
+        send_error_frame(player, "Incomplete connect frame name");
+        player->disconnected = 1;
+        return;
+    }
+    if (strnlen(connect_frame->name, connect_frame->name_length) < connect_frame->name_length) {
+        // This guy thinks he's really funny sending a null character in the name
+        send_error_frame(player, "Null character not allowed in name");
+        player->disconnected = 1;
+        return;
+    }
+    // Anything after the name is the protocol they want, and then their flags
+    int8_t version = CLUE_PROTOCOL_V1;
+    uint8_t flags = 0;
+    int options_length = header->data_length - (int)sizeof(ConnectFrame_t) - connect_frame->name_length;
+    if (options_length > 0) {
+        version = connect_frame->name[connect_frame->name_length];
+    }
+    if (options_length > 1) {
+        flags = connect_frame->name[connect_frame->name_length + 1];
+    }
+    if (version != CLUE_PROTOCOL_V1 && version != CLUE_PROTOCOL_V2) {
+        send_error_frame(player, "Unsupported protocol version");
+        player->disconnected = 1;
+        return;
+    }
+    if (flags & ~CLUE_CONNECT_AUTO_SHOW) {
+        send_error_frame(player, "Unsupported connect flags");
+        player->disconnected = 1;
+        return;
+    }
+    char* player_name = malloc(connect_frame->name_length + 1);
+    memcpy(player_name, connect_frame->name, connect_frame->name_length);
+    player_name[connect_frame->name_length] = '\0';
 
-        // The game continues. Skip anyone who is eliminated
-        while (players[turn_idx].eliminated) {
-            turn_idx++;
-            turn_idx = turn_idx % num_players;
+    // Got a full connect frame, put them in the lobby
+    if (server->lobby == NULL) {
+        server->lobby = game_new(server);
+    }
+    Game_t* lobby = server->lobby;
+    if (lobby->num_players >= lobby->size_players) {
+        lobby->size_players *= 2;
+        lobby->players = realloc(lobby->players, lobby->size_players * sizeof(Player_t*));
+    }
+    player->id = lobby->num_players;
+    player->name_length = connect_frame->name_length;
+    player->name = player_name;
+    player->metrics = metrics_bot(player_name);
+    player->compact = version == CLUE_PROTOCOL_V2 ? &server->compact : NULL;
+    player->auto_show = (flags & CLUE_CONNECT_AUTO_SHOW) != 0;
+    player->game = lobby;
+    player->state = PLAYER_STATE_LOBBY;
+    lobby->players[lobby->num_players++] = player;
+
+    // Not loose anymore
+    for (Player_t** link = &server->loose_players; *link; link = &(*link)->next) {
+        if (*link == player) {
+            *link = player->next;
+            break;
         }
+    }
+    player->next = NULL;
 
-        // It's someones turn. Tell everyone and await their response
-        printf("(%d) %s's turn\n", players[turn_idx].id, players[turn_idx].name);
-        TurnFrame_t turn_frame = {};
-        turn_frame.player_id = players[turn_idx].id;
-        Frame_t turn_frame_header = {};
-        turn_frame_header.type = FRAME_TYPE_TURN;
-        turn_frame_header.data_length = sizeof(turn_frame);
-        for (int i = 0; i < num_players; i++) {
-            // Note: we won't bother checking for send timeouts, only receive timeouts
-            send(players[i].fd, &turn_frame_header, sizeof(turn_frame_header), MSG_DONTWAIT);
-            send(players[i].fd, &turn_frame, turn_frame_header.data_length, MSG_DONTWAIT);
-        }
+    // Send rules
+    RulesFrame_t* rules = (RulesFrame_t*)CLUE_PAYLOAD(server->rules);
+    rules->player_id = player->id;
+    player_send_frame(player, FRAME_TYPE_RULES, rules, server->rules_len - sizeof(Frame_t));
 
-        // We expect to get their response
-        Frame_t turn_response_frame_header = {};
-        received_size = recv(players[turn_idx].fd, &turn_response_frame_header, sizeof(turn_response_frame_header), 0);
-        if (received_size < (int)sizeof(turn_response_frame_header)) {
-            if (received_size == -1) {
-                if (errno == EAGAIN) {
-                    send_error_frame(players[turn_idx].fd, "Timed out");
-                } else {
-                    perror(NULL);
-                }
-            } else {
-                send_error_frame(players[turn_idx].fd, "Incomplete frame header");
-            }
-            abort_game(players, num_players, "Communication error");
-        }
+    if (player->address.ss_family == AF_UNIX) {
+        log_printf(LOG_LEVEL_INFO, "[%d] %s connected over %s\n", lobby->id, player_name, player->shm ? "shared memory" : server->match_fd != -1 ? "its socketpair" : "the Unix socket");
+    } else {
+        struct sockaddr_in6* address = (struct sockaddr_in6*)&player->address;
+        char ip_tmp[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, &address->sin6_addr, ip_tmp, sizeof(ip_tmp));
+        log_printf(LOG_LEVEL_INFO, "[%d] %s connected from %s %d\n", lobby->id, player_name, ip_tmp, address->sin6_port);
+    }
 
-        // They can either take a stab at the answer...
-        if (turn_response_frame_header.type == FRAME_TYPE_SOLVE_ATTEMPT) {
-            int expectected_len = settings->num_categories * sizeof(int16_t);
-            int16_t* client_guess = malloc(expectected_len);
-            received_size = recv(players[turn_idx].fd, client_guess, expectected_len, 0);
-            if (received_size < (int)expectected_len || expectected_len != turn_response_frame_header.data_length) {
-                if (received_size == -1) {
-                    if (errno == EAGAIN) {
-                        send_error_frame(players[turn_idx].fd, "Timed out");
-                    } else {
-                        perror(NULL);
-                    }
-                } else {
-                    send_error_frame(players[turn_idx].fd, "Incomplete solution attempt");
-                }
-                // Technically recoverable
-                continue;
-            }
+    if (lobby->num_players >= SERVER_MAX_PLAYERS || (server->lobby_quorum > 0 && lobby->num_players >= server->lobby_quorum)) {
+        // Everyone we were waiting for is here, no reason to keep waiting
+        start_lobby(server);
+    }
+}
 
-            printf("(%d) %s attempted to solve: ", players[turn_idx].id, players[turn_idx].name);
-            int wrong = 0;
-            for (int i = 0; i < settings->num_categories; i++) {
-                if (i == settings->num_categories - 1) {
-                    printf("(%d) %s\n", client_guess[i], card_names[client_guess[i]]);
-                } else {
-                    printf("(%d) %s, ", client_guess[i], card_names[client_guess[i]]);
-                }
-
-                // n^2 because lazy and probably faster than sorting
-                int found = 0;
-                for (int j = 0; j < settings->num_categories; j++) {
-                    if (solution[i] == client_guess[j]) {
-                        found++;
-                        break;
-                    }
-                }
-                if (found == 0) {
-                    wrong = 1;
-                }
-            }
+void start_lobby(Server_t* server) {
+    Game_t* game = server->lobby;
+    server->lobby = NULL;
+    game->next = server->starting;
+    server->starting = game;
+    game_start(server, game);
+}
 
-            Frame_t solve_broadcast_frame_header = {};
-            solve_broadcast_frame_header.type = FRAME_TYPE_SOLVE_RESULT;
-            solve_broadcast_frame_header.data_length = sizeof(SolveResultFrame_t) + settings->num_categories * sizeof(int16_t);
-            SolveResultFrame_t* solve_broadcast_frame = malloc(solve_broadcast_frame_header.data_length);
-            solve_broadcast_frame->player = players[turn_idx].id;
-            solve_broadcast_frame->correct = wrong ? 0 : 1;
-            memcpy(solve_broadcast_frame->cards, client_guess, settings->num_categories * sizeof(int16_t));
-            for (int i = 0; i < num_players; i++) {
-                send(players[i].fd, &solve_broadcast_frame_header, sizeof(solve_broadcast_frame_header), MSG_DONTWAIT);
-                send(players[i].fd, &solve_broadcast_frame, solve_broadcast_frame_header.data_length, MSG_DONTWAIT);
-            }
-            if (!wrong) {
-                printf("(%d) %s won!\n", players[turn_idx].id, players[turn_idx].name);
-                break;
-            } else {
-                printf("(%d) %s was eliminated\n", players[turn_idx].id, players[turn_idx].name);
-                players[turn_idx].eliminated = 1;
-            }
+void hand_off_games(Server_t* server) {
+    // Called between event batches, so nothing we are holding still points at these players
+    while (server->starting) {
+        Game_t* game = server->starting;
+        server->starting = game->next;
+        for (int i = 0; i < game->num_players; i++) {
+            player_unwatch(game->players[i], server->epoll_fd);
         }
-        // or do a suggestion
-        else if (turn_response_frame_header.type == FRAME_TYPE_TURN_RESPONSE) {
-            int expectected_len = settings->num_categories * sizeof(int16_t);
-            int16_t* client_suggestion = malloc(expectected_len);
-            received_size = recv(players[turn_idx].fd, client_suggestion, expectected_len, 0);
-            if (received_size < (int)expectected_len || expectected_len != turn_response_frame_header.data_length) {
-                if (received_size == -1) {
-                    if (errno == EAGAIN) {
-                        send_error_frame(players[turn_idx].fd, "Timed out");
-                    } else {
-                        perror(NULL);
-                    }
-                } else {
-                    send_error_frame(players[turn_idx].fd, "Incomplete suggestion");
-                }
-                // Technically recoverable
-                continue;
-            }
+        worker_adopt(&server->workers[server->next_worker], game);
+        server->next_worker = (server->next_worker + 1) % server->num_workers;
+    }
+}
 
-            // This time we are going to sort the client input for validation purposes
-            qsort(client_suggestion, settings->num_categories, sizeof(int16_t), qsort_int16s);
-
-            // Did the client supply a valid suggestion?
-            printf("(%d) %s suggests: ", players[turn_idx].id, players[turn_idx].name);
-            int base_idx = 0;
-            int legal = 1;
-            for (int i = 0; i < settings->num_categories; i++) {
-                if (i == settings->num_categories - 1) {
-                    printf("(%d) %s\n", client_suggestion[i], card_names[client_suggestion[i]]);
-                } else {
-                    printf("(%d) %s, ", client_suggestion[i], card_names[client_suggestion[i]]);
-                }
-                int offset_in_category = client_suggestion[i] - base_idx;
-                if (offset_in_category < 0 || offset_in_category >= settings->num_cards[i]) {
-                    // No lol
-                    legal = 0;
-                }
-                base_idx += settings->num_cards[i];
-            }
-            if (!legal) {
-                printf("But it was illegal...\n");
-                send_error_frame(players[turn_idx].fd, "Not one card per category suggested");
-                continue;
-            }
+void check_deadlines(Server_t* server) {
+    int64_t now = now_ms();
 
-            // The suggestion is valid... go around
-            for (int suggestion_turn_idx = (turn_idx + 1) % num_players; suggestion_turn_idx != turn_idx; suggestion_turn_idx = (suggestion_turn_idx + 1) % num_players) {
-                Frame_t query_frame_header = {};
-                query_frame_header.data_length = sizeof(QueryFrame_t) + sizeof(int16_t) * settings->num_categories;
-                query_frame_header.type = FRAME_TYPE_QUERY;
-                QueryFrame_t* query_frame = malloc(query_frame_header.data_length);
-                query_frame->player_id = players[suggestion_turn_idx].id;
-                memcpy(query_frame->suggestion, client_suggestion, settings->num_categories * sizeof(int16_t));
-                for (int i = 0; i < num_players; i++) {
-                    send(players[i].fd, &query_frame_header, sizeof(query_frame_header), MSG_DONTWAIT);
-                    send(players[i].fd, query_frame, query_frame_header.data_length, MSG_DONTWAIT);
-                }
-                free(query_frame);
-
-                int has_one = 0;
-                for (int i = 0; i < settings->num_categories; i++) {
-                    if (player_has_card(&players[suggestion_turn_idx], client_suggestion[i])) {
-                        has_one = 1;
-                        break;
-                    }
-                }
-                if (has_one) {
-                    // This player has a card and we need to ask them which one they want to show
-                    printf("(%d) %s is obligated to show\n", players[suggestion_turn_idx].id, players[suggestion_turn_idx].name);
-
-                    // And they respond
-                    Frame_t query_response_frame_header = {};
-                    QueryResponseFrame_t query_response_frame = {};
-                    received_size = recv(players[suggestion_turn_idx].fd, &query_response_frame_header, sizeof(query_response_frame_header), 0);
-                    if (received_size < sizeof(query_response_frame_header)) {
-                        if (received_size == -1) {
-                            if (errno == EAGAIN) {
-                                send_error_frame(players[suggestion_turn_idx].fd, "Timed out");
-                            } else {
-                                perror(NULL);
-                            }
-                        } else {
-                            send_error_frame(players[suggestion_turn_idx].fd, "Obligated to respond");
-                        }
-                        // Bricked
-                        abort_game(players, num_players, "Player failed to respond to suggestion");
-                    }
-                    assert(query_response_frame_header.data_length == sizeof(query_response_frame));
-                    received_size = recv(players[suggestion_turn_idx].fd, &query_response_frame, sizeof(query_response_frame_header), 0);
-                    if (received_size < query_response_frame_header.data_length) {
-                        if (received_size == -1) {
-                            if (errno == EAGAIN) {
-                                send_error_frame(players[suggestion_turn_idx].fd, "Timed out");
-                            } else {
-                                perror(NULL);
-                            }
-                        } else {
-                            send_error_frame(players[suggestion_turn_idx].fd, "Incomplete query response");
-                        }
-                        // Bricked
-                        abort_game(players, num_players, "Player failed to respond to suggestion");
-                    }
-
-                    // Do they actually have that card?
-                    if (!player_has_card(&players[suggestion_turn_idx], query_response_frame.card_id)) {
-                        printf("(%d) %s tried to cheat by showing (%d) %s\n",
-                            players[suggestion_turn_idx].id, players[suggestion_turn_idx].name, query_response_frame.card_id, card_names[query_response_frame.card_id]);
-                        abort_game(players, num_players, "Player responded to a suggestion illegally");
-                    }
-                    printf("(%d) %s shows (%d) %s\n",
-                            players[suggestion_turn_idx].id, players[suggestion_turn_idx].name, query_response_frame.card_id, card_names[query_response_frame.card_id]);
-
-                    // This player has a card so we will broadcast that
-                    QueryAnouncementFrame_t show_frame = {};
-                    show_frame.player_id = players[suggestion_turn_idx].id;
-                    show_frame.card_id = -1;
-                    Frame_t show_frame_header = {};
-                    show_frame_header.type = FRAME_TYPE_QUERY_RETURN;
-                    show_frame_header.data_length = sizeof(show_frame);
-                    for (int i = 0; i < num_players; i++) {
-                        if (i == suggestion_turn_idx) {
-                            // No need to poke the shower
-                            continue;
-                        } else if (i == turn_idx) {
-                            show_frame.card_id = query_response_frame.card_id;
-                        } else {
-                            show_frame.card_id = 0;
-                        }
-                        send(players[i].fd, &show_frame_header, sizeof(show_frame_header), MSG_DONTWAIT);
-                        send(players[i].fd, &show_frame, show_frame_header.data_length, MSG_DONTWAIT);
-                    }
-                    break;
-                } else {
-                    // This player doesn't have a card so we will broadcast that
-                    printf("(%d) %s passed\n", players[suggestion_turn_idx].id, players[suggestion_turn_idx].name);
-                    QueryAnouncementFrame_t noshow_frame = {};
-                    noshow_frame.player_id = players[suggestion_turn_idx].id;
-                    noshow_frame.card_id = -1;
-                    Frame_t noshow_frame_header = {};
-                    noshow_frame_header.type = FRAME_TYPE_QUERY_RETURN;
-                    noshow_frame_header.data_length = sizeof(noshow_frame);
-                    for (int i = 0; i < num_players; i++) {
-                        send(players[i].fd, &noshow_frame_header, sizeof(noshow_frame_header), MSG_DONTWAIT);
-                        send(players[i].fd, &noshow_frame, noshow_frame_header.data_length, MSG_DONTWAIT);
-                    }
-                }
-            }
-        }
-        // or they messed up
-        else {
-            printf("(%d) %s sent bad frame %d\n", players[turn_idx].id, players[turn_idx].name, turn_response_frame_header.type);
-            send_error_frame(players[turn_idx].fd, "Expected either FRAME_TYPE_TURN_RESPONSE or FRAME_TYPE_SOLVE_ATTEMPT");
-            char* garbage = malloc(turn_response_frame_header.data_length);
-            recv(players[turn_idx].fd, garbage, turn_response_frame_header.data_length, 0); // Really wish I could just NULL here...
-            free(garbage);
-
-            // Technically recoverable
-            continue;
-        }
+    // Lobby closes and the game begins
+    if (server->lobby && server->lobby->deadline <= now) {
+        start_lobby(server);
     }
 
-    abort_game(players, num_players, "Game ended");
-}
-
-void abort_game(Player_t* players, int num_players, const char* reason) {
-    Frame_t header = {};
-    ErrorFrame_t error = {};
-    error.error_length = strlen(reason);
-    header.type = FRAME_TYPE_ABORT;
-    header.data_length = sizeof(error) + error.error_length;
-    for (int i = 0; i < num_players; i++) {
-        send(players[i].fd, &header, sizeof(header), MSG_DONTWAIT);
-        send(players[i].fd, &error, sizeof(error), MSG_DONTWAIT);
-        send(players[i].fd, reason, error.error_length, MSG_DONTWAIT);
-    }
-    printf("Aborting game with reason: %s\n", reason);
-    exit(1);
+    // Anyone taking too long to connect
+    for (Player_t* player = server->loose_players; player;) {
+        Player_t* next = player->next;
+        if (player->deadline <= now) {
+            send_error_frame(player, "Timed out");
+            drop_player(server, player);
+        }
+        player = next;
+    }
 }
 
-int qsort_int16s(const void* left, const void* right) {
-    // Lame
-    int16_t* left_int = (int16_t*)left;
-    int16_t* right_int = (int16_t*)right;
-    return *left_int - *right_int;
+void drop_player(Server_t* server, Player_t* player) {
+    for (Player_t** link = &server->loose_players; *link; link = &(*link)->next) {
+        if (*link == player) {
+            *link = player->next;
+            break;
+        }
+    }
+    player_free(player);
 }
 
-int player_has_card(Player_t* player, int16_t card) {
-    // Does the player have the card?
-    int low_idx = 0;
-    int high_idx = player->hand_size - 1;
-    while (low_idx <= high_idx) {
-        int mid_idx = (high_idx + low_idx) / 2;
-        if (card < player->hand[mid_idx]) {
-            high_idx = mid_idx - 1;
-        } else if (card > player->hand[mid_idx]) {
-            low_idx = mid_idx + 1;
-        } else {
-            return 1;
-        }
+void end_match(Server_t* server) {
+    // Every player is closed, so the bots have their EOF and should be on their way out
+    int played = server->next_game_id > 0;
+    int clean = match_reap(server->bots, server->num_bots, SERVER_CLOSE_GRACE_TIME * 1000);
+    if (!clean) {
+        log_printf(LOG_LEVEL_ERROR, "Not every bot exited cleanly\n");
     }
-    return 0;
-}
\ No newline at end of file
+    exit(played && clean ? 0 : 1);
+}
@@ -0,0 +1,174 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "server.h"
+
+#define SETTINGS_MAP_SIZE (64 * 1024) // Files this big get mapped instead of read
+
+static const char* next_line(const char** cursor, const char* end, int* length); // The line at *cursor without its newline, NULL past the end of the file
+static Settings_t* parse_settings(const char* data, const char* end); // Parse a whole settings file sitting in memory
+
+Settings_t* read_settings_file(char* file_path) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd == -1) {
+        perror(NULL);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror(NULL);
+        close(fd);
+        return NULL;
+    }
+
+    // The whole file at once instead of a line at a time, a big deck has thousands of them. Small
+    // files are quicker to read than to map
+    char* data;
+    int mapped = st.st_size >= SETTINGS_MAP_SIZE;
+    if (mapped) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(NULL);
+            close(fd);
+            return NULL;
+        }
+    } else {
+        data = malloc(st.st_size + 1);
+        if (read(fd, data, st.st_size) != st.st_size) {
+            perror(NULL);
+            free(data);
+            close(fd);
+            return NULL;
+        }
+    }
+    close(fd);
+    Settings_t* settings = parse_settings(data, data + st.st_size);
+    if (mapped) {
+        munmap(data, st.st_size);
+    } else {
+        free(data);
+    }
+    return settings;
+}
+
+void free_settings(Settings_t* settings) {
+    // Everything came with it in one allocation
+    free(settings);
+}
+
+static Settings_t* parse_settings(const char* data, const char* end) {
+    const char* cursor = data;
+    const char* line;
+    int length;
+
+    // The first line of the file should be the port
+    line = next_line(&cursor, end, &length);
+    int port = 0;
+    for (int i = 0; line && i < length && line[i] >= '0' && line[i] <= '9' && port <= 0xFFFF; i++) {
+        port = port * 10 + line[i] - '0';
+    }
+    if (port <= 0 || port > 0xFFFF) {
+        printf("Expected integer port number on line 1\n");
+        return NULL;
+    }
+
+    // Then there should be an empty line
+    line = next_line(&cursor, end, &length);
+    if (line == NULL || length > 0) {
+        printf("Expected blank line on line 2\n");
+        return NULL;
+    }
+
+    // First pass counts, so everything fits in one allocation. Blank lines separate categories
+    const char* cards_start = cursor;
+    int num_categories = 0;
+    int total_cards = 0;
+    size_t name_bytes = 0;
+    int in_category = 0;
+    for (int line_number = 3; (line = next_line(&cursor, end, &length)); line_number++) {
+        if (length == 0) {
+            in_category = 0;
+            continue;
+        }
+        if (length > 127) {
+            // Too long to store the length in a int8
+            printf("Card name too long on line %d (max length 127)\n", line_number);
+            return NULL;
+        }
+        if (!in_category) {
+            num_categories++;
+            in_category = 1;
+        }
+        total_cards++;
+        name_bytes += length + 1;
+    }
+    if (num_categories > 127) {
+        // Too many for an int8
+        printf("Too many categories %d (maximum 127)\n", num_categories);
+        return NULL;
+    }
+    if (total_cards > 0x7FFF) {
+        // Too big for an int16
+        printf("Too many cards %d (maximum 32767)\n", total_cards);
+        return NULL;
+    }
+
+    // Widest types first so everything stays aligned
+    size_t size = sizeof(Settings_t) + num_categories * sizeof(char**) + total_cards * sizeof(char*) + num_categories * sizeof(int16_t) + name_bytes;
+    char* block = malloc(size);
+    Settings_t* settings = (Settings_t*)block;
+    block += sizeof(Settings_t);
+    settings->port = port;
+    settings->num_categories = num_categories;
+    settings->card_names = (char***)block;
+    block += num_categories * sizeof(char**);
+    char** names = (char**)block;
+    block += total_cards * sizeof(char*);
+    settings->num_cards = (int16_t*)block;
+    block += num_categories * sizeof(int16_t);
+    char* name = block;
+
+    // Second pass fills it in
+    cursor = cards_start;
+    int category = -1;
+    in_category = 0;
+    while ((line = next_line(&cursor, end, &length))) {
+        if (length == 0) {
+            in_category = 0;
+            continue;
+        }
+        if (!in_category) {
+            category++;
+            settings->card_names[category] = names;
+            settings->num_cards[category] = 0;
+            in_category = 1;
+        }
+        memcpy(name, line, length);
+        name[length] = '\0';
+        *names++ = name;
+        name += length + 1;
+        settings->num_cards[category]++;
+    }
+    return settings;
+}
+
+static const char* next_line(const char** cursor, const char* end, int* length) {
+    const char* line = *cursor;
+    if (line >= end) {
+        return NULL;
+    }
+    const char* newline = memchr(line, '\n', end - line);
+    if (newline == NULL) {
+        // Last line without a newline
+        newline = end;
+    }
+    *length = newline - line > 0x7FFFFFFF ? 0x7FFFFFFF : newline - line;
+    *cursor = newline < end ? newline + 1 : end;
+    return line;
+}
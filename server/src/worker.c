@@ -0,0 +1,482 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "server.h"
+
+#define WORKER_MAX_EVENTS 64
+#define WORKER_MAX_DUE 64 // Timers taken off the heap at once
+#define WORKER_BUSY_RETRY 1 // Milliseconds until a timer for a game somebody else is running goes off again
+
+static void* worker_main(void* arg); // Event loop of one worker thread
+static void worker_queue(Worker_t* worker, Game_t* game); // Put a game with pending events in our deque
+static Game_t* worker_pop(Worker_t* worker); // Newest ready game of our own
+static Game_t* worker_steal(Worker_t* worker); // Oldest ready game of somebody else
+static void worker_run(Worker_t* worker, Game_t* game); // Handle every pending event of the game's players
+static void worker_wake(Worker_t* worker);
+static void worker_run_timers(Worker_t* worker); // Timeouts and closing for every game whose timer is due
+static int worker_close_players(Game_t* game, int64_t now); // Close whoever is done. 1 the first time everyone is
+static void worker_retire(Game_t* game); // Hand a closed game back to its owner to let go of
+static void worker_bury(Worker_t* worker); // Drop our reference to every game of ours that got closed
+static void timer_set(Worker_t* worker, Game_t* game, int64_t when); // Add the game's timer, or move it. With the worker locked
+static Game_t* timer_pop(Worker_t* worker); // Game of the earliest timer, with the worker locked
+static void timer_remove(Worker_t* worker, Game_t* game); // With the worker locked
+static void timer_sift(Worker_t* worker, int idx); // Put timers[idx] where it belongs after its when changed
+static void timer_arm(Worker_t* worker); // Point timer_fd at the earliest timer, with the worker locked
+static void handle_game_player(Server_t* server, Game_t* game, Player_t* player, uint32_t events);
+
+void workers_start(Server_t* server, int num_workers) {
+    server->workers = calloc(num_workers, sizeof(Worker_t));
+    server->num_workers = num_workers;
+    for (int i = 0; i < num_workers; i++) {
+        Worker_t* worker = &server->workers[i];
+        worker->server = server;
+        worker->id = i;
+        worker->epoll_fd = epoll_create1(0);
+        worker->wake_fd = eventfd(0, EFD_NONBLOCK);
+        worker->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if (worker->epoll_fd == -1 || worker->wake_fd == -1 || worker->timer_fd == -1) {
+            perror(NULL);
+            exit(1);
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN | EPOLLET;
+        event.data.ptr = NULL; // NULL means the wake fd
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &event);
+        event.data.ptr = worker; // The worker itself means the timer fd
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->timer_fd, &event);
+        atomic_init(&worker->idle, 0);
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->deque_size = 64;
+        worker->deque = malloc(worker->deque_size * sizeof(Game_t*));
+        worker->size_timers = 64;
+        worker->timers = malloc(worker->size_timers * sizeof(WorkerTimer_t));
+        worker->armed = -1;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pthread_create(&server->workers[i].thread, NULL, worker_main, &server->workers[i]);
+    }
+}
+
+void worker_adopt(Worker_t* worker, Game_t* game) {
+    // The lobby's reference is the owner's from here on, and whatever deadline the game started
+    // with gets a timer
+    pthread_mutex_lock(&game->lock);
+    game->worker = worker;
+    worker_schedule(worker, game);
+    pthread_mutex_unlock(&game->lock);
+
+    // From here on the worker hears about the sockets. Anything already readable fires right away
+    for (int i = 0; i < game->num_players; i++) {
+        player_watch(game->players[i], worker->epoll_fd);
+    }
+}
+
+void worker_schedule(Worker_t* worker, Game_t* game) {
+    // The game is locked and referenced by whoever moved the deadline, so the timer's reference
+    // can't be the last one when it gets dropped here
+    int released = 0;
+    pthread_mutex_lock(&worker->lock);
+    if (game->deadline != INT64_MAX) {
+        if (game->timer == -1) {
+            atomic_fetch_add(&game->refs, 1);
+        }
+        timer_set(worker, game, game->deadline);
+    } else if (game->timer != -1) {
+        // No time limits anymore, nothing to wake up for
+        timer_remove(worker, game);
+        released = 1;
+    }
+    timer_arm(worker);
+    pthread_mutex_unlock(&worker->lock);
+    if (released) {
+        game_release(game);
+    }
+}
+
+static void* worker_main(void* arg) {
+    Worker_t* worker = arg;
+    struct epoll_event events[WORKER_MAX_EVENTS];
+    while (1) {
+        // Not while any events are in hand, those point into the players
+        worker_bury(worker);
+
+        // Only sleep if there is nothing to run here or anywhere else. Deadlines wake us through
+        // the timer fd, so there is no timeout to work out
+        pthread_mutex_lock(&worker->lock);
+        int timeout = worker->deque_count > 0 ? 0 : -1;
+        pthread_mutex_unlock(&worker->lock);
+        atomic_store(&worker->idle, timeout != 0);
+        int num_events = epoll_wait(worker->epoll_fd, events, WORKER_MAX_EVENTS, timeout);
+        atomic_store(&worker->idle, 0);
+        if (num_events == -1 && errno != EINTR) {
+            perror(NULL);
+            exit(1);
+        }
+        for (int i = 0; i < num_events; i++) {
+            Player_t* player = events[i].data.ptr;
+            if (player == NULL) {
+                uint64_t count;
+                while (read(worker->wake_fd, &count, sizeof(count)) > 0) {
+                }
+                continue;
+            }
+            if ((void*)player == worker) {
+                uint64_t count;
+                while (read(worker->timer_fd, &count, sizeof(count)) > 0) {
+                }
+                worker_run_timers(worker);
+                continue;
+            }
+            // Whoever runs the game handles the events, it might not be us
+            atomic_fetch_or(&player->pending, events[i].events);
+            if (!atomic_exchange(&player->game->queued, 1)) {
+                worker_queue(worker, player->game);
+            }
+        }
+
+        for (int i = 0; i < SERVER_WORKER_BATCH; i++) {
+            Game_t* game = worker_pop(worker);
+            if (game == NULL) {
+                game = worker_steal(worker);
+            }
+            if (game == NULL) {
+                break;
+            }
+            worker_run(worker, game);
+        }
+    }
+    return NULL;
+}
+
+static void worker_queue(Worker_t* worker, Game_t* game) {
+    atomic_fetch_add(&game->refs, 1);
+    pthread_mutex_lock(&worker->lock);
+    if (worker->deque_count == worker->deque_size) {
+        // Grow the ring, unwrapping it on the way
+        Game_t** deque = malloc(worker->deque_size * 2 * sizeof(Game_t*));
+        for (int i = 0; i < worker->deque_count; i++) {
+            deque[i] = worker->deque[(worker->deque_first + i) % worker->deque_size];
+        }
+        free(worker->deque);
+        worker->deque = deque;
+        worker->deque_first = 0;
+        worker->deque_size *= 2;
+    }
+    worker->deque[(worker->deque_first + worker->deque_count) % worker->deque_size] = game;
+    worker->deque_count++;
+    int backlog = worker->deque_count > 1;
+    pthread_mutex_unlock(&worker->lock);
+
+    if (backlog) {
+        // More than we can run right now, get someone who is sleeping to help out
+        Server_t* server = worker->server;
+        for (int i = 1; i < server->num_workers; i++) {
+            Worker_t* other = &server->workers[(worker->id + i) % server->num_workers];
+            if (atomic_load(&other->idle)) {
+                worker_wake(other);
+                break;
+            }
+        }
+    }
+}
+
+static Game_t* worker_pop(Worker_t* worker) {
+    Game_t* game = NULL;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->deque_count > 0) {
+        worker->deque_count--;
+        game = worker->deque[(worker->deque_first + worker->deque_count) % worker->deque_size];
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return game;
+}
+
+static Game_t* worker_steal(Worker_t* worker) {
+    Server_t* server = worker->server;
+    for (int i = 1; i < server->num_workers; i++) {
+        Worker_t* victim = &server->workers[(worker->id + i) % server->num_workers];
+        if (pthread_mutex_trylock(&victim->lock) != 0) {
+            // Busy, plenty of other places to look
+            continue;
+        }
+        Game_t* game = NULL;
+        if (victim->deque_count > 0) {
+            game = victim->deque[victim->deque_first];
+            victim->deque_first = (victim->deque_first + 1) % victim->deque_size;
+            victim->deque_count--;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (game) {
+            return game;
+        }
+    }
+    return NULL;
+}
+
+static void worker_run(Worker_t* worker, Game_t* game) {
+    pthread_mutex_lock(&game->lock);
+    // Events that come in from now on need another run
+    atomic_store(&game->queued, 0);
+    for (int i = 0; i < game->num_players; i++) {
+        Player_t* player = game->players[i];
+        uint32_t events = atomic_exchange(&player->pending, 0);
+        if (events) {
+            handle_game_player(worker->server, game, player, events);
+        }
+    }
+    // Players who were only waiting to get the rest of their data might be done now
+    int closed = game->state == GAME_STATE_OVER && worker_close_players(game, now_ms());
+    pthread_mutex_unlock(&game->lock);
+    if (closed) {
+        worker_retire(game);
+    }
+    game_release(game);
+}
+
+static void worker_wake(Worker_t* worker) {
+    uint64_t one = 1;
+    if (write(worker->wake_fd, &one, sizeof(one)) == -1) {
+        // Already has a wakeup pending
+    }
+}
+
+static void worker_run_timers(Worker_t* worker) {
+    Server_t* server = worker->server;
+    while (1) {
+        // Take the due timers off first, games get locked before workers and never the other way
+        // Their timers' references are ours now
+        int64_t now = now_ms();
+        Game_t* due[WORKER_MAX_DUE];
+        int num_due = 0;
+        pthread_mutex_lock(&worker->lock);
+        while (num_due < WORKER_MAX_DUE && worker->num_timers > 0 && worker->timers[0].when <= now) {
+            due[num_due++] = timer_pop(worker);
+        }
+        timer_arm(worker);
+        pthread_mutex_unlock(&worker->lock);
+
+        for (int i = 0; i < num_due; i++) {
+            Game_t* game = due[i];
+            if (pthread_mutex_trylock(&game->lock) != 0) {
+                // Somebody is running it and will probably move the deadline, look again soon. If
+                // they already did, the game has its timer back and ours goes
+                pthread_mutex_lock(&worker->lock);
+                int rearmed = game->timer != -1;
+                if (!rearmed) {
+                    timer_set(worker, game, now + WORKER_BUSY_RETRY);
+                    timer_arm(worker);
+                }
+                pthread_mutex_unlock(&worker->lock);
+                if (rearmed) {
+                    game_release(game);
+                }
+                continue;
+            }
+            // Moving the deadline later already put the timer back
+            int closed = 0;
+            if (game->deadline <= now) {
+                if (game->state != GAME_STATE_OVER) {
+                    game_timeout(server, game);
+                }
+                if (game->state == GAME_STATE_OVER) {
+                    closed = worker_close_players(game, now);
+                }
+            }
+            pthread_mutex_unlock(&game->lock);
+            if (closed) {
+                worker_retire(game);
+            }
+            game_release(game);
+        }
+        if (num_due < WORKER_MAX_DUE) {
+            break;
+        }
+    }
+}
+
+static void worker_retire(Game_t* game) {
+    // The owner may still have events for these players from the epoll_wait it is working through,
+    // so the game has to outlive them. Every socket is closed, no more are coming. Nothing is left to
+    // time out either, and the owner still holds on, so the timer can let go right away
+    Worker_t* owner = game->worker;
+    pthread_mutex_lock(&owner->lock);
+    int timed = game->timer != -1;
+    if (timed) {
+        timer_remove(owner, game);
+        timer_arm(owner);
+    }
+    game->next = owner->closed;
+    owner->closed = game;
+    pthread_mutex_unlock(&owner->lock);
+    if (timed) {
+        game_release(game);
+    }
+    if (!pthread_equal(pthread_self(), owner->thread)) {
+        worker_wake(owner);
+    }
+}
+
+static void worker_bury(Worker_t* worker) {
+    pthread_mutex_lock(&worker->lock);
+    Game_t* game = worker->closed;
+    worker->closed = NULL;
+    pthread_mutex_unlock(&worker->lock);
+    while (game) {
+        Game_t* next = game->next;
+        game_release(game);
+        game = next;
+    }
+}
+
+static int worker_close_players(Game_t* game, int64_t now) {
+    if (game->closed) {
+        return 0;
+    }
+    // Closed once they have everything, or once they had long enough to take it
+    int open = 0;
+    for (int i = 0; i < game->num_players; i++) {
+        Player_t* player = game->players[i];
+        if (player->fd != -1 && (game->deadline <= now || player->out_count == 0 || player->disconnected)) {
+            player_close(player);
+        }
+        if (player->fd != -1) {
+            open = 1;
+        }
+    }
+    if (open) {
+        return 0;
+    }
+    game->closed = 1;
+    if (game->worker->server->match_fd != -1) {
+        // server -x only ever runs this one game, the lobby thread can go reap the bots
+        uint64_t one = 1;
+        if (write(game->worker->server->match_fd, &one, sizeof(one)) == -1) {
+            perror(NULL);
+        }
+    }
+    return 1;
+}
+
+static void timer_set(Worker_t* worker, Game_t* game, int64_t when) {
+    int idx = game->timer;
+    if (idx == -1) {
+        if (worker->num_timers == worker->size_timers) {
+            worker->size_timers *= 2;
+            worker->timers = realloc(worker->timers, worker->size_timers * sizeof(WorkerTimer_t));
+        }
+        idx = worker->num_timers++;
+        worker->timers[idx].game = game;
+    }
+    worker->timers[idx].when = when;
+    timer_sift(worker, idx);
+}
+
+static Game_t* timer_pop(Worker_t* worker) {
+    Game_t* game = worker->timers[0].game;
+    timer_remove(worker, game);
+    return game;
+}
+
+static void timer_remove(Worker_t* worker, Game_t* game) {
+    // The last one takes its place
+    int idx = game->timer;
+    game->timer = -1;
+    if (idx < --worker->num_timers) {
+        worker->timers[idx] = worker->timers[worker->num_timers];
+        timer_sift(worker, idx);
+    }
+}
+
+static void timer_sift(Worker_t* worker, int idx) {
+    WorkerTimer_t timer = worker->timers[idx];
+    // Up if it is earlier than its parent, otherwise down while a child is earlier. Whatever moves
+    // past it gets told where it ended up
+    while (idx > 0 && worker->timers[(idx - 1) / 2].when > timer.when) {
+        worker->timers[idx] = worker->timers[(idx - 1) / 2];
+        worker->timers[idx].game->timer = idx;
+        idx = (idx - 1) / 2;
+    }
+    while (1) {
+        int child = idx * 2 + 1;
+        if (child >= worker->num_timers) {
+            break;
+        }
+        if (child + 1 < worker->num_timers && worker->timers[child + 1].when < worker->timers[child].when) {
+            child++;
+        }
+        if (worker->timers[child].when >= timer.when) {
+            break;
+        }
+        worker->timers[idx] = worker->timers[child];
+        worker->timers[idx].game->timer = idx;
+        idx = child;
+    }
+    worker->timers[idx] = timer;
+    timer.game->timer = idx;
+}
+
+static void timer_arm(Worker_t* worker) {
+    int64_t when = worker->num_timers > 0 ? worker->timers[0].when : -1;
+    if (when == worker->armed) {
+        return;
+    }
+    // All zeros disarms it. Times are on the same clock as now_ms, and a time that already
+    // passed goes off right away
+    struct itimerspec spec = {};
+    if (when != -1) {
+        spec.it_value.tv_sec = when / 1000;
+        spec.it_value.tv_nsec = when % 1000 * 1000000;
+    }
+    timerfd_settime(worker->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    worker->armed = when;
+}
+
+static void handle_game_player(Server_t* server, Game_t* game, Player_t* player, uint32_t events) {
+    if (player->fd == -1 || player->disconnected) {
+        // Already dealt with, just waiting for the game to notice
+        return;
+    }
+    if (player->state == PLAYER_STATE_CLOSING) {
+        // Not interested in anything they have to say anymore, just get the rest out
+        if ((events & EPOLLOUT) && !player_flush(player)) {
+            player->disconnected = 1;
+        }
+        if (player->out_count == 0 || player->disconnected) {
+            player_close(player);
+        }
+        return;
+    }
+    if (!player_service(player, events)) {
+        return;
+    }
+
+    // Hand every whole frame to the game
+    Frame_t header;
+    char* data;
+    while (!player->disconnected && player->state == PLAYER_STATE_PLAYING) {
+        if (player->out_queued > SERVER_OUT_HIGH_WATER) {
+            // The rest waits until their output drains
+            player->read_paused = 1;
+            break;
+        }
+        int rc = player_next_frame(player, &header, &data);
+        if (rc == 0) {
+            break;
+        } else if (rc == -1) {
+            send_error_frame(player, "Bad frame length");
+            player->disconnected = 1;
+            break;
+        }
+        game_handle_frame(server, game, player, &header, data);
+    }
+    if (player->disconnected && player->state == PLAYER_STATE_PLAYING) {
+        abort_game(server, game, "Player disconnected");
+    }
+}